@@ -1,34 +1,23 @@
-project "RayTracing"
-   kind "ConsoleApp"
+-- build settings every RayTracing target shares, so an instruction set or compiler flag cannot drift between them
+-- call it after a project's own settings, it ends with the filter cleared
+function RayTracingCommon()
    language "C++"
    cppdialect "C++17"
-   targetdir "bin/%{cfg.buildcfg}"
    staticruntime "off"
 
-   files { "src/**.h", "src/**.cpp" }
-
-   includedirs
-   {
-      "../Walnut/vendor/imgui",
-      "../Walnut/vendor/glfw/include",
-      "../Walnut/vendor/glm",
-
-      "../Walnut/Walnut/src",
-
-      "%{IncludeDir.VulkanSDK}",
-   }
-
-   links
-   {
-       "Walnut"
-   }
-
    targetdir ("../bin/" .. outputdir .. "/%{prj.name}")
    objdir ("../bin-int/" .. outputdir .. "/%{prj.name}")
 
    filter "system:windows"
       systemversion "latest"
       defines { "WL_PLATFORM_WINDOWS" }
+      links { "ws2_32" }
+
+   filter "system:linux"
+      links { "pthread" }
+
+   filter "options:profile"
+      defines { "RT_PROFILE" }
 
    filter "configurations:Debug"
       defines { "WL_DEBUG" }
@@ -42,8 +31,111 @@ project "RayTracing"
       symbols "On"
 
    filter "configurations:Dist"
-      kind "WindowedApp"
       defines { "WL_DIST" }
       runtime "Release"
       optimize "On"
-      symbols "Off"
\ No newline at end of file
+      symbols "Off"
+
+   -- SIMD kernels are compiled per instruction set and picked at runtime, see SphereKernels.cpp
+   filter "files:src/SphereKernelsAVX2.cpp"
+      vectorextensions "AVX2"
+
+   filter { "files:src/SphereKernelsAVX512.cpp", "system:windows" }
+      buildoptions { "/arch:AVX512" }
+
+   filter { "files:src/SphereKernelsAVX512.cpp", "system:not windows" }
+      buildoptions { "-mavx512f" }
+
+   -- no fused multiply-add contraction, the SIMD paths must round exactly like the scalar ones
+   filter { "files:src/SphereKernels*.cpp or src/TriangleKernels*.cpp or src/AccumulationBuffer.cpp", "system:not windows" }
+      buildoptions { "-ffp-contract=off" }
+
+   filter {}
+end
+
+project "RayTracing"
+   kind "ConsoleApp"
+   targetdir "bin/%{cfg.buildcfg}"
+
+   files { "src/**.h", "src/**.cpp" }
+   removefiles { "src/HeadlessApp.cpp", "src/Benchmark.cpp" }
+
+   includedirs
+   {
+      "../Walnut/vendor/imgui",
+      "../Walnut/vendor/glfw/include",
+      "../Walnut/vendor/glm",
+
+      "../Walnut/Walnut/src",
+
+      "%{IncludeDir.VulkanSDK}",
+   }
+
+   links
+   {
+       "Walnut"
+   }
+
+   RayTracingCommon()
+
+   filter "configurations:Dist"
+      kind "WindowedApp"
+
+-- offline renderer without Walnut/Vulkan, for CPU-only machines with no display
+project "RayTracingHeadless"
+   kind "ConsoleApp"
+
+   files { "src/**.h", "src/**.cpp" }
+
+   removefiles { "src/WalnutApp.cpp", "src/WalnutImageSink.h", "src/Benchmark.cpp" }
+
+   includedirs
+   {
+      "../Walnut/vendor/glm",
+
+      "../Walnut/Walnut/src",
+   }
+
+   defines { "RT_HEADLESS" }
+
+   RayTracingCommon()
+
+-- fixed scenes and cameras, writes rays/s and thread scaling as JSON
+project "RayTracingBenchmark"
+   kind "ConsoleApp"
+
+   files { "src/**.h", "src/**.cpp" }
+
+   removefiles { "src/WalnutApp.cpp", "src/WalnutImageSink.h", "src/HeadlessApp.cpp" }
+
+   includedirs
+   {
+      "../Walnut/vendor/glm",
+
+      "../Walnut/Walnut/src",
+   }
+
+   defines { "RT_HEADLESS" }
+
+   RayTracingCommon()
+
+-- the renderer's own tests, exits with the number that failed
+project "RayTracingTests"
+   kind "ConsoleApp"
+
+   files { "src/**.h", "src/**.cpp", "tests/**.h", "tests/**.cpp" }
+
+   removefiles { "src/WalnutApp.cpp", "src/WalnutImageSink.h", "src/HeadlessApp.cpp", "src/Benchmark.cpp" }
+
+   includedirs
+   {
+      "src",
+
+      "../Walnut/vendor/glm",
+
+      "../Walnut/Walnut/src",
+   }
+
+   defines { "RT_HEADLESS" }
+
+   RayTracingCommon()
\ No newline at end of file
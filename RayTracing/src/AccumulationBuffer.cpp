@@ -0,0 +1,441 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: AccumulationBuffer.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/AccumulationBuffer.cpp
+*/
+
+#include "AccumulationBuffer.h"
+
+#include <array>
+#include <cmath>
+#include <cstdlib>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace utility
+{
+	static constexpr size_t kAlignment = 64;
+
+	// sRGB encoded 8 bit values of [0, 1] in kSRGBSteps even steps
+	static constexpr uint32_t kSRGBSteps = 4095;
+
+	static const uint8_t* GetSRGBTable()
+	{
+		static const std::array<uint8_t, kSRGBSteps + 1> table = []
+			{
+				std::array<uint8_t, kSRGBSteps + 1> result;
+				for (uint32_t i = 0; i <= kSRGBSteps; i++)
+				{
+					double linear = (double)i / kSRGBSteps;
+					double encoded = linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+					result[i] = (uint8_t)(encoded * 255.0 + 0.5);
+				}
+				return result;
+			}();
+		return table.data();
+	}
+
+	// the scalar and SIMD paths below do the same operations in the same order, so both give identical bytes
+	static float Tonemap(float x, Tonemapper tonemapper)
+	{
+		switch (tonemapper)
+		{
+		case Tonemapper::Reinhard: return x / (1.0f + x);
+		case Tonemapper::ACES: return (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f);
+		default: return x;
+		}
+	}
+
+	static uint32_t Encode(float x, float scale, const ToneMapping& tone_mapping)
+	{
+		float value = glm::min(Tonemap(glm::max(x * scale, 0.0f), tone_mapping.Operator), 1.0f);
+		if (tone_mapping.SRGB)
+			return GetSRGBTable()[(uint32_t)(value * (float)kSRGBSteps + 0.5f)];
+		return (uint32_t)(value * 255.0f);
+	}
+
+#if defined(__x86_64__) || defined(_M_X64)
+	// four interleaved RGB pixels in three registers to one register per channel
+	static void Transpose(__m128 v0, __m128 v1, __m128 v2, __m128& r, __m128& g, __m128& b)
+	{
+		// v0 = r0 g0 b0 r1, v1 = g1 b1 r2 g2, v2 = b2 r3 g3 b3
+		__m128 r01 = _mm_shuffle_ps(v0, v0, _MM_SHUFFLE(3, 3, 0, 0));
+		__m128 r23 = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(1, 1, 2, 2));
+		__m128 g01 = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(0, 0, 1, 1));
+		__m128 g23 = _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(2, 2, 3, 3));
+		__m128 b01 = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(1, 1, 2, 2));
+		__m128 b23 = _mm_shuffle_ps(v2, v2, _MM_SHUFFLE(3, 3, 0, 0));
+
+		r = _mm_shuffle_ps(r01, r23, _MM_SHUFFLE(2, 0, 2, 0));
+		g = _mm_shuffle_ps(g01, g23, _MM_SHUFFLE(2, 0, 2, 0));
+		b = _mm_shuffle_ps(b01, b23, _MM_SHUFFLE(2, 0, 2, 0));
+	}
+
+	static __m128 Tonemap(__m128 x, Tonemapper tonemapper)
+	{
+		switch (tonemapper)
+		{
+		case Tonemapper::Reinhard:
+			return _mm_div_ps(x, _mm_add_ps(_mm_set1_ps(1.0f), x));
+		case Tonemapper::ACES:
+		{
+			__m128 numerator = _mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.51f), x), _mm_set1_ps(0.03f)));
+			__m128 denominator = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.43f), x), _mm_set1_ps(0.59f))), _mm_set1_ps(0.14f));
+			return _mm_div_ps(numerator, denominator);
+		}
+		default:
+			return x;
+		}
+	}
+
+	static __m128i Encode(__m128 x, __m128 scale, const ToneMapping& tone_mapping)
+	{
+		__m128 value = _mm_max_ps(_mm_mul_ps(x, scale), _mm_setzero_ps());
+		value = _mm_min_ps(Tonemap(value, tone_mapping.Operator), _mm_set1_ps(1.0f));
+		if (!tone_mapping.SRGB)
+			return _mm_cvttps_epi32(_mm_mul_ps(value, _mm_set1_ps(255.0f)));
+
+		// SSE2 has no gather, the table is read one lane at a time
+		alignas(16) uint32_t steps[4];
+		_mm_store_si128((__m128i*)steps, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, _mm_set1_ps((float)kSRGBSteps)), _mm_set1_ps(0.5f))));
+		const uint8_t* table = GetSRGBTable();
+		return _mm_setr_epi32(table[steps[0]], table[steps[1]], table[steps[2]], table[steps[3]]);
+	}
+
+	static __m128i PackRGBA(__m128 r, __m128 g, __m128 b, __m128 scale, const ToneMapping& tone_mapping)
+	{
+		__m128i rgba = _mm_or_si128(Encode(r, scale, tone_mapping), _mm_slli_epi32(Encode(g, scale, tone_mapping), 8));
+		rgba = _mm_or_si128(rgba, _mm_slli_epi32(Encode(b, scale, tone_mapping), 16));
+		return _mm_or_si128(rgba, _mm_set1_epi32((int)0xff000000u));
+	}
+
+	// same rescaling as AccumulationBuffer::HalfToFloat
+	static __m128 HalfToFloat(__m128i halves)
+	{
+		__m128i magnitude = _mm_slli_epi32(_mm_and_si128(halves, _mm_set1_epi32(0x7fff)), 13);
+		__m128 value = _mm_mul_ps(_mm_castsi128_ps(magnitude), _mm_set1_ps(5.192296858534828e33f));
+		__m128i sign = _mm_slli_epi32(_mm_and_si128(halves, _mm_set1_epi32(0x8000)), 16);
+		return _mm_or_ps(value, _mm_castsi128_ps(sign));
+	}
+#endif
+}
+
+const char* GetAccumulationFormatName(AccumulationFormat format)
+{
+	switch (format)
+	{
+	case AccumulationFormat::RGB32F: return "rgb32f";
+	case AccumulationFormat::RGB16F: return "rgb16f";
+	case AccumulationFormat::Fixed64: return "fixed64";
+	}
+	return "unknown";
+}
+
+const char* GetTonemapperName(Tonemapper tonemapper)
+{
+	switch (tonemapper)
+	{
+	case Tonemapper::Clamp: return "clamp";
+	case Tonemapper::Reinhard: return "reinhard";
+	case Tonemapper::ACES: return "aces";
+	}
+	return "unknown";
+}
+
+bool ParseTonemapper(const char* name, Tonemapper& tonemapper)
+{
+	for (Tonemapper candidate : { Tonemapper::Clamp, Tonemapper::Reinhard, Tonemapper::ACES })
+	{
+		if (strcmp(name, GetTonemapperName(candidate)) == 0)
+		{
+			tonemapper = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ParseAccumulationFormat(const char* name, AccumulationFormat& format)
+{
+	for (AccumulationFormat candidate : { AccumulationFormat::RGB32F, AccumulationFormat::RGB16F, AccumulationFormat::Fixed64 })
+	{
+		if (strcmp(name, GetAccumulationFormatName(candidate)) == 0)
+		{
+			format = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+void* AllocateAligned(size_t bytes)
+{
+#if defined(_WIN32)
+	return _aligned_malloc(bytes, utility::kAlignment);
+#else
+	// aligned_alloc wants a multiple of the alignment
+	return aligned_alloc(utility::kAlignment, (bytes + utility::kAlignment - 1) / utility::kAlignment * utility::kAlignment);
+#endif
+}
+
+void FreeAligned(void* data)
+{
+#if defined(_WIN32)
+	_aligned_free(data);
+#else
+	free(data);
+#endif
+}
+
+void AccumulationBuffer::Resize(uint32_t pixels, AccumulationFormat format)
+{
+	format_ = format;
+	pixels_ = pixels;
+	data_.Resize((size_t)pixels * GetBytesPerPixel());
+	Clear();
+}
+
+void AccumulationBuffer::Clear()
+{
+	if (data_.Size() > 0)
+		memset(data_.Data(), 0, data_.Size());
+}
+
+size_t GetAccumulationBytesPerPixel(AccumulationFormat format)
+{
+	switch (format)
+	{
+	case AccumulationFormat::RGB32F: return 3 * sizeof(float);
+	case AccumulationFormat::RGB16F: return 3 * sizeof(uint16_t);
+	case AccumulationFormat::Fixed64: return 3 * sizeof(int64_t);
+	}
+	return 0;
+}
+
+size_t AccumulationBuffer::GetBytesPerPixel() const
+{
+	return GetAccumulationBytesPerPixel(format_);
+}
+
+glm::vec3 AccumulationBuffer::GetMean(uint32_t pixel, uint32_t sample_count) const
+{
+	switch (format_)
+	{
+	case AccumulationFormat::RGB32F:
+	{
+		const float* sum = (const float*)data_.Data() + pixel * 3;
+		return glm::vec3(sum[0], sum[1], sum[2]) / (float)sample_count;
+	}
+	case AccumulationFormat::RGB16F:
+	{
+		const uint16_t* mean = (const uint16_t*)data_.Data() + pixel * 3;
+		return glm::vec3(HalfToFloat(mean[0]), HalfToFloat(mean[1]), HalfToFloat(mean[2]));
+	}
+	case AccumulationFormat::Fixed64:
+	{
+		const int64_t* sum = (const int64_t*)data_.Data() + pixel * 3;
+		double scale = 1.0 / (kFixedScale * (double)sample_count);
+		return glm::vec3((float)((double)sum[0] * scale), (float)((double)sum[1] * scale), (float)((double)sum[2] * scale));
+	}
+	}
+	return glm::vec3(0.0f);
+}
+
+void AccumulationBuffer::Set(uint32_t pixel, const glm::vec3& mean, uint32_t sample_count)
+{
+	switch (format_)
+	{
+	case AccumulationFormat::RGB32F:
+	{
+		float* sum = (float*)data_.Data() + pixel * 3;
+		for (int i = 0; i < 3; i++)
+			sum[i] = mean[i] * (float)sample_count;
+		break;
+	}
+	case AccumulationFormat::RGB16F:
+	{
+		uint16_t* value = (uint16_t*)data_.Data() + pixel * 3;
+		for (int i = 0; i < 3; i++)
+			value[i] = FloatToHalf(mean[i]);
+		break;
+	}
+	case AccumulationFormat::Fixed64:
+	{
+		int64_t* sum = (int64_t*)data_.Data() + pixel * 3;
+		for (int i = 0; i < 3; i++)
+			sum[i] = (int64_t)((double)mean[i] * (double)sample_count * kFixedScale + 0.5);
+		break;
+	}
+	}
+}
+
+void AccumulationBuffer::Merge(const uint8_t* other, uint32_t sample_count, uint32_t other_sample_count)
+{
+	size_t values = (size_t)pixels_ * 3;
+
+	switch (format_)
+	{
+	case AccumulationFormat::RGB32F:
+	{
+		float* sum = (float*)data_.Data();
+		const float* other_sum = (const float*)other;
+		for (size_t i = 0; i < values; i++)
+			sum[i] += other_sum[i];
+		break;
+	}
+	case AccumulationFormat::RGB16F:
+	{
+		uint32_t total = sample_count + other_sample_count;
+		if (total == 0)
+			break;
+
+		float weight = (float)other_sample_count / (float)total;
+		uint16_t* mean = (uint16_t*)data_.Data();
+		const uint16_t* other_mean = (const uint16_t*)other;
+		for (size_t i = 0; i < values; i++)
+		{
+			float value = HalfToFloat(mean[i]);
+			mean[i] = FloatToHalf(value + (HalfToFloat(other_mean[i]) - value) * weight);
+		}
+		break;
+	}
+	case AccumulationFormat::Fixed64:
+	{
+		// integer sums, so the order buffers are merged in makes no difference
+		int64_t* sum = (int64_t*)data_.Data();
+		const int64_t* other_sum = (const int64_t*)other;
+		for (size_t i = 0; i < values; i++)
+			sum[i] += other_sum[i];
+		break;
+	}
+	}
+}
+
+uint32_t AccumulationBuffer::ToRGBA(const glm::vec3& color, const ToneMapping& tone_mapping)
+{
+	float scale = std::exp2(tone_mapping.Exposure);
+	uint32_t r = utility::Encode(color.r, scale, tone_mapping);
+	uint32_t g = utility::Encode(color.g, scale, tone_mapping);
+	uint32_t b = utility::Encode(color.b, scale, tone_mapping);
+	return 0xff000000u | (b << 16) | (g << 8) | r;
+}
+
+void AccumulationBuffer::Resolve(uint32_t first, uint32_t count, const uint32_t* sample_counts, uint32_t* rgba, const ToneMapping& tone_mapping) const
+{
+	uint32_t i = 0;
+
+#if defined(__x86_64__) || defined(_M_X64)
+	// four pixels at a time
+	__m128 r, g, b;
+	__m128 scale = _mm_set1_ps(std::exp2(tone_mapping.Exposure));
+	switch (format_)
+	{
+	case AccumulationFormat::RGB32F:
+	{
+		const float* sum = (const float*)data_.Data() + (size_t)first * 3;
+		for (; i + 4 <= count; i += 4)
+		{
+			utility::Transpose(_mm_loadu_ps(sum + i * 3), _mm_loadu_ps(sum + i * 3 + 4), _mm_loadu_ps(sum + i * 3 + 8), r, g, b);
+
+			__m128 samples = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(sample_counts + i)));
+			r = _mm_div_ps(r, samples);
+			g = _mm_div_ps(g, samples);
+			b = _mm_div_ps(b, samples);
+			_mm_storeu_si128((__m128i*)(rgba + i), utility::PackRGBA(r, g, b, scale, tone_mapping));
+		}
+		break;
+	}
+	case AccumulationFormat::RGB16F:
+	{
+		const uint16_t* mean = (const uint16_t*)data_.Data() + (size_t)first * 3;
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + 4 <= count; i += 4)
+		{
+			// 12 halves, widened to 32 bits
+			__m128i low = _mm_loadu_si128((const __m128i*)(mean + i * 3));
+			__m128i high = _mm_loadl_epi64((const __m128i*)(mean + i * 3 + 8));
+			__m128 v0 = utility::HalfToFloat(_mm_unpacklo_epi16(low, zero));
+			__m128 v1 = utility::HalfToFloat(_mm_unpackhi_epi16(low, zero));
+			__m128 v2 = utility::HalfToFloat(_mm_unpacklo_epi16(high, zero));
+
+			utility::Transpose(v0, v1, v2, r, g, b);
+			_mm_storeu_si128((__m128i*)(rgba + i), utility::PackRGBA(r, g, b, scale, tone_mapping));
+		}
+		break;
+	}
+	case AccumulationFormat::Fixed64:
+	{
+		// SSE2 has no 64 bit integer conversions, so only the packing is vectorised
+		alignas(16) float means[12];
+		for (; i + 4 <= count; i += 4)
+		{
+			for (uint32_t j = 0; j < 4; j++)
+			{
+				glm::vec3 mean = GetMean(first + i + j, sample_counts[i + j]);
+				means[j * 3 + 0] = mean.r;
+				means[j * 3 + 1] = mean.g;
+				means[j * 3 + 2] = mean.b;
+			}
+
+			utility::Transpose(_mm_load_ps(means), _mm_load_ps(means + 4), _mm_load_ps(means + 8), r, g, b);
+			_mm_storeu_si128((__m128i*)(rgba + i), utility::PackRGBA(r, g, b, scale, tone_mapping));
+		}
+		break;
+	}
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		rgba[i] = ToRGBA(GetMean(first + i, sample_counts[i]), tone_mapping);
+	}
+}
+
+uint16_t AccumulationBuffer::FloatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(float));
+
+	uint32_t sign = bits & 0x80000000u;
+	bits ^= sign;
+
+	uint16_t result;
+	if (bits >= (uint32_t)(127 + 16) << 23)
+	{
+		// too large for a half, infinity, or nan
+		result = bits > 0x7f800000u ? 0x7e00 : 0x7c00;
+	}
+	else if (bits < (uint32_t)113 << 23)
+	{
+		// denormal, adding the magic number lets the float addition do the rounding
+		const uint32_t magic_bits = (uint32_t)((127 - 15) + (23 - 10) + 1) << 23;
+		float magic, shifted;
+		memcpy(&magic, &magic_bits, sizeof(float));
+		memcpy(&shifted, &bits, sizeof(float));
+		shifted += magic;
+
+		uint32_t shifted_bits;
+		memcpy(&shifted_bits, &shifted, sizeof(float));
+		result = (uint16_t)(shifted_bits - magic_bits);
+	}
+	else
+	{
+		// rebias the exponent and round the mantissa to nearest even
+		uint32_t odd = (bits >> 13) & 1u;
+		bits += ((uint32_t)(15 - 127) << 23) + 0xfffu + odd;
+		result = (uint16_t)(bits >> 13);
+	}
+
+	return (uint16_t)(result | (sign >> 16));
+}
@@ -0,0 +1,211 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: AccumulationBuffer.h
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/AccumulationBuffer.h
+*/
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+// storage of the accumulated samples, per pixel
+enum class AccumulationFormat
+{
+	// float sum of each channel, 12 bytes
+	RGB32F,
+
+	// half float running mean of each channel, 6 bytes
+	// updates smaller than half precision are lost, so it stops converging after a few hundred samples
+	RGB16F,
+
+	// 32.32 fixed point sum of each channel, 24 bytes
+	// integer sums do not depend on the order samples are added in
+	Fixed64
+};
+
+const char* GetAccumulationFormatName(AccumulationFormat format);
+bool ParseAccumulationFormat(const char* name, AccumulationFormat& format);
+size_t GetAccumulationBytesPerPixel(AccumulationFormat format);
+
+// curve that maps the mean colour into [0, 1] before it is quantised to 8 bits
+enum class Tonemapper
+{
+	// cuts off everything above 1
+	Clamp,
+
+	// x / (1 + x), never saturates
+	Reinhard,
+
+	// Narkowicz's fit of the ACES filmic curve
+	ACES
+};
+
+const char* GetTonemapperName(Tonemapper tonemapper);
+bool ParseTonemapper(const char* name, Tonemapper& tonemapper);
+
+struct ToneMapping
+{
+	Tonemapper Operator = Tonemapper::Clamp;
+
+	// in stops, the colour is scaled by 2^Exposure before the curve
+	float Exposure = 0.0f;
+
+	// encode with the sRGB transfer function, otherwise the 8 bit values are linear
+	bool SRGB = false;
+};
+
+void* AllocateAligned(size_t bytes);
+void FreeAligned(void* data);
+
+// 64 byte aligned array that only reallocates when it has to grow
+// the contents are undefined after a Resize
+template<typename T>
+class AlignedBuffer
+{
+public:
+	AlignedBuffer() = default;
+	~AlignedBuffer() { FreeAligned(data_); }
+
+	AlignedBuffer(const AlignedBuffer&) = delete;
+	AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+	void Resize(size_t size)
+	{
+		if (size > capacity_)
+		{
+			FreeAligned(data_);
+			data_ = (T*)AllocateAligned(size * sizeof(T));
+			capacity_ = size;
+		}
+		size_ = size;
+	}
+
+	T* Data() { return data_; }
+	const T* Data() const { return data_; }
+	size_t Size() const { return size_; }
+
+	T& operator[](size_t index) { return data_[index]; }
+	const T& operator[](size_t index) const { return data_[index]; }
+
+	// exchanges the allocations, e.g. to read last frame's contents while writing this frame's
+	void Swap(AlignedBuffer& other)
+	{
+		std::swap(data_, other.data_);
+		std::swap(size_, other.size_);
+		std::swap(capacity_, other.capacity_);
+	}
+private:
+	T* data_ = nullptr;
+	size_t size_ = 0;
+	size_t capacity_ = 0;
+};
+
+class AccumulationBuffer
+{
+public:
+	// keeps the allocation when it is large enough, the contents are cleared
+	void Resize(uint32_t pixels, AccumulationFormat format);
+	void Clear();
+
+	AccumulationFormat GetFormat() const { return format_; }
+	size_t GetBytesPerPixel() const;
+
+	// sample_count includes this sample
+	void Add(uint32_t pixel, const glm::vec3& color, uint32_t sample_count)
+	{
+		switch (format_)
+		{
+		case AccumulationFormat::RGB32F:
+		{
+			float* sum = (float*)data_.Data() + pixel * 3;
+			sum[0] += color.r;
+			sum[1] += color.g;
+			sum[2] += color.b;
+			break;
+		}
+		case AccumulationFormat::RGB16F:
+		{
+			uint16_t* mean = (uint16_t*)data_.Data() + pixel * 3;
+			for (int i = 0; i < 3; i++)
+			{
+				float value = HalfToFloat(mean[i]);
+				mean[i] = FloatToHalf(value + (color[i] - value) / (float)sample_count);
+			}
+			break;
+		}
+		case AccumulationFormat::Fixed64:
+		{
+			int64_t* sum = (int64_t*)data_.Data() + pixel * 3;
+			for (int i = 0; i < 3; i++)
+				sum[i] += (int64_t)((double)color[i] * kFixedScale + 0.5);
+			break;
+		}
+		}
+	}
+
+	// raw contents, GetSize bytes in the layout of the format
+	const uint8_t* GetData() const { return data_.Data(); }
+	size_t GetSize() const { return (size_t)pixels_ * GetBytesPerPixel(); }
+
+	// replaces the contents with GetSize bytes in the layout of the format, e.g. read back from a checkpoint
+	void Assign(const uint8_t* data) { memcpy(data_.Data(), data, GetSize()); }
+
+	// exchanges the contents, size and format with another buffer
+	void Swap(AccumulationBuffer& other)
+	{
+		std::swap(format_, other.format_);
+		std::swap(pixels_, other.pixels_);
+		data_.Swap(other.data_);
+	}
+
+	// adds the contents of another buffer of the same size and format, e.g. one sent by another process
+	// every pixel here holds sample_count samples and every pixel of other holds other_sample_count,
+	// sums are added and running means are weighted by the counts
+	void Merge(const uint8_t* other, uint32_t sample_count, uint32_t other_sample_count);
+
+	// mean colour of one pixel, unclamped
+	glm::vec3 GetMean(uint32_t pixel, uint32_t sample_count) const;
+
+	// makes one pixel hold sample_count samples whose mean is mean, e.g. samples carried over from another pixel
+	void Set(uint32_t pixel, const glm::vec3& mean, uint32_t sample_count);
+
+	// tone mapped 8 bit RGBA means of count pixels from first, alpha is 255
+	void Resolve(uint32_t first, uint32_t count, const uint32_t* sample_counts, uint32_t* rgba, const ToneMapping& tone_mapping) const;
+
+	// one colour through the same tone mapping as Resolve
+	static uint32_t ToRGBA(const glm::vec3& color, const ToneMapping& tone_mapping);
+
+	static uint16_t FloatToHalf(float value);
+	static float HalfToFloat(uint16_t value)
+	{
+		// moving the exponent and mantissa up and rescaling handles denormals too
+		uint32_t bits = (uint32_t)(value & 0x7fffu) << 13;
+		float magnitude;
+		memcpy(&magnitude, &bits, sizeof(float));
+		magnitude *= 5.192296858534828e33f; // 2^112
+
+		uint32_t result;
+		memcpy(&result, &magnitude, sizeof(float));
+		result |= (uint32_t)(value & 0x8000u) << 16;
+
+		float half;
+		memcpy(&half, &result, sizeof(float));
+		return half;
+	}
+private:
+	static constexpr double kFixedScale = 4294967296.0;
+
+	AccumulationFormat format_ = AccumulationFormat::RGB32F;
+	uint32_t pixels_ = 0;
+	AlignedBuffer<uint8_t> data_;
+};
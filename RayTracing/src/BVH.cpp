@@ -0,0 +1,428 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: BVH.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/BVH.cpp
+*/
+
+#include "BVH.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace utility
+{
+	// number of bins per axis for the SAH sweep
+	static constexpr int kBins = 16;
+
+	// cost of visiting a node relative to testing one primitive
+	static constexpr float kTraversalCost = 1.0f;
+
+	static int BinIndex(float center, float center_min, float scale)
+	{
+		return std::min(kBins - 1, (int)((center - center_min) * scale));
+	}
+}
+
+void BVH::Build(const std::vector<AABB>& bounds, uint32_t leaf_width)
+{
+	uint32_t count = (uint32_t)bounds.size();
+	leaf_width_ = leaf_width > 0 ? leaf_width : 1;
+
+	indices_.resize(count);
+	std::iota(indices_.begin(), indices_.end(), 0);
+
+	nodes_.clear();
+	parents_.clear();
+	leaves_.clear();
+	build_cost_ = 0.0f;
+	area_cost_ = 0.0;
+
+	if (count == 0)
+		return;
+
+	// a binary tree with n leaves has at most 2n - 1 nodes
+	// node 1 is left unused so every pair of children starts on an even index
+	nodes_.resize((size_t)count * 2 + 1);
+	nodes_used_ = 2;
+
+	BVHNode& root = nodes_[0];
+	root.LeftFirst = 0;
+	root.Count = count;
+	nodes_[1] = root;
+	UpdateNodeBounds(0, bounds);
+
+	std::vector<glm::vec3> centers(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		centers[i] = bounds[i].Center();
+	}
+
+	Subdivide(bounds, centers);
+
+	nodes_.resize(nodes_used_);
+	nodes_.shrink_to_fit();
+
+	BuildLinks();
+	UpdateAreaCost();
+	build_cost_ = Cost();
+}
+
+bool BVH::Assign(std::vector<BVHNode> nodes, std::vector<uint32_t> indices, uint32_t leaf_width)
+{
+	nodes_.clear();
+	indices_.clear();
+	parents_.clear();
+	leaves_.clear();
+	build_cost_ = 0.0f;
+	area_cost_ = 0.0;
+	leaf_width_ = leaf_width > 0 ? leaf_width : 1;
+
+	uint32_t count = (uint32_t)indices.size();
+	if (nodes.empty())
+		return count == 0;
+
+	// the indices must name every primitive exactly once
+	std::vector<uint8_t> listed(count, 0);
+	for (uint32_t index : indices)
+	{
+		if (index >= count || listed[index])
+			return false;
+		listed[index] = 1;
+	}
+
+	// children must come after their parent and within the array, which also rules out cycles,
+	// and no path may be deeper than the traversal stack
+	std::vector<uint32_t> depth(nodes.size(), 0);
+	std::vector<uint8_t> parents(nodes.size(), 0);
+	std::vector<uint8_t> covered(count, 0);
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		if (i == 1)
+			continue;
+
+		// every node but the root hangs off exactly one parent, so none is orphaned or shared
+		// and a parent always comes first, so its count is final by now
+		if ((i == 0) != (parents[i] == 0) || parents[i] > 1)
+			return false;
+
+		const BVHNode& node = nodes[i];
+		if (node.IsLeaf())
+		{
+			if ((uint64_t)node.LeftFirst + node.Count > count)
+				return false;
+
+			// leaf ranges may not overlap
+			for (uint32_t j = node.LeftFirst; j < node.LeftFirst + node.Count; j++)
+			{
+				if (covered[j])
+					return false;
+				covered[j] = 1;
+			}
+			continue;
+		}
+
+		if (node.LeftFirst <= i || node.LeftFirst < 2 || (size_t)node.LeftFirst + 1 >= nodes.size() || depth[i] + 1 >= kMaxDepth)
+			return false;
+
+		depth[node.LeftFirst] = depth[i] + 1;
+		depth[node.LeftFirst + 1] = depth[i] + 1;
+		parents[node.LeftFirst] = (uint8_t)std::min(parents[node.LeftFirst] + 1, 2);
+		parents[node.LeftFirst + 1] = (uint8_t)std::min(parents[node.LeftFirst + 1] + 1, 2);
+	}
+
+	// and together the leaves hold every primitive
+	if (std::find(covered.begin(), covered.end(), 0) != covered.end())
+		return false;
+
+	nodes_ = std::move(nodes);
+	indices_ = std::move(indices);
+	nodes_used_ = (uint32_t)nodes_.size();
+
+	BuildLinks();
+	UpdateAreaCost();
+	build_cost_ = Cost();
+	return true;
+}
+
+void BVH::Refit(const std::vector<AABB>& bounds)
+{
+	// children are always stored after their parent, so a reverse sweep is bottom up
+	for (int32_t i = (int32_t)nodes_.size() - 1; i >= 0; i--)
+	{
+		if (i == 1)
+			continue;
+
+		BVHNode& node = nodes_[i];
+		if (node.IsLeaf())
+		{
+			UpdateNodeBounds(i, bounds);
+			continue;
+		}
+
+		const BVHNode& left = nodes_[node.LeftFirst];
+		const BVHNode& right = nodes_[node.LeftFirst + 1];
+		node.Min = glm::min(left.Min, right.Min);
+		node.Max = glm::max(left.Max, right.Max);
+	}
+
+	UpdateAreaCost();
+}
+
+void BVH::Refit(const std::vector<AABB>& bounds, const std::vector<uint32_t>& primitives)
+{
+	for (uint32_t primitive : primitives)
+	{
+		uint32_t node_index = leaves_[primitive];
+
+		area_cost_ -= NodeCost(nodes_[node_index]);
+		UpdateNodeBounds(node_index, bounds);
+		area_cost_ += NodeCost(nodes_[node_index]);
+
+		// once a parent's box stays the same, so do all of its ancestors'
+		while (node_index != 0)
+		{
+			node_index = parents_[node_index];
+			BVHNode& node = nodes_[node_index];
+
+			const BVHNode& left = nodes_[node.LeftFirst];
+			const BVHNode& right = nodes_[node.LeftFirst + 1];
+			glm::vec3 min = glm::min(left.Min, right.Min);
+			glm::vec3 max = glm::max(left.Max, right.Max);
+			if (min == node.Min && max == node.Max)
+				break;
+
+			area_cost_ -= NodeCost(node);
+			node.Min = min;
+			node.Max = max;
+			area_cost_ += NodeCost(node);
+		}
+	}
+}
+
+uint32_t BVH::GetSlot(uint32_t primitive) const
+{
+	const BVHNode& leaf = nodes_[leaves_[primitive]];
+	for (uint32_t i = leaf.LeftFirst; i < leaf.LeftFirst + leaf.Count; i++)
+	{
+		if (indices_[i] == primitive)
+			return i;
+	}
+	return leaf.LeftFirst;
+}
+
+void BVH::BuildLinks()
+{
+	parents_.assign(nodes_.size(), 0);
+	leaves_.assign(indices_.size(), 0);
+
+	for (uint32_t i = 0; i < (uint32_t)nodes_.size(); i++)
+	{
+		if (i == 1)
+			continue;
+
+		const BVHNode& node = nodes_[i];
+		if (node.IsLeaf())
+		{
+			for (uint32_t j = node.LeftFirst; j < node.LeftFirst + node.Count; j++)
+				leaves_[indices_[j]] = i;
+		}
+		else
+		{
+			parents_[node.LeftFirst] = i;
+			parents_[node.LeftFirst + 1] = i;
+		}
+	}
+}
+
+float BVH::Cost() const
+{
+	if (nodes_.empty())
+		return 0.0f;
+
+	AABB root{ nodes_[0].Min, nodes_[0].Max };
+	float root_area = root.HalfArea();
+	return root_area > 0.0f ? (float)(area_cost_ / root_area) : 0.0f;
+}
+
+double BVH::NodeCost(const BVHNode& node) const
+{
+	AABB box{ node.Min, node.Max };
+	return (double)box.HalfArea() * (node.IsLeaf() ? LeafCost(node.Count) : utility::kTraversalCost);
+}
+
+void BVH::UpdateAreaCost()
+{
+	area_cost_ = 0.0;
+	for (size_t i = 0; i < nodes_.size(); i++)
+	{
+		if (i != 1)
+			area_cost_ += NodeCost(nodes_[i]);
+	}
+}
+
+void BVH::UpdateNodeBounds(uint32_t node_index, const std::vector<AABB>& bounds)
+{
+	BVHNode& node = nodes_[node_index];
+
+	AABB box;
+	for (uint32_t i = 0; i < node.Count; i++)
+	{
+		box.Grow(bounds[indices_[node.LeftFirst + i]]);
+	}
+
+	node.Min = box.Min;
+	node.Max = box.Max;
+}
+
+void BVH::Subdivide(const std::vector<AABB>& bounds, const std::vector<glm::vec3>& centers)
+{
+	struct Task
+	{
+		uint32_t Node;
+		uint32_t Depth;
+	};
+
+	// explicit work list rather than recursion, degenerate scenes can get deep
+	std::vector<Task> tasks;
+	tasks.push_back({ 0, 0 });
+
+	while (!tasks.empty())
+	{
+		Task task = tasks.back();
+		tasks.pop_back();
+
+		BVHNode& node = nodes_[task.Node];
+		if (node.Count <= 1 || task.Depth + 1 >= kMaxDepth)
+			continue;
+
+		uint32_t first = node.LeftFirst;
+		uint32_t last = first + node.Count;
+
+		// centroid bounds decide the bin layout on each axis
+		AABB center_bounds;
+		for (uint32_t i = first; i < last; i++)
+		{
+			center_bounds.Grow(centers[indices_[i]]);
+		}
+
+		struct Bin
+		{
+			AABB Bounds;
+			uint32_t Count = 0;
+		};
+
+		// bin every primitive on all three axes in a single pass
+		Bin bins[3][utility::kBins];
+		float scale[3];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float extent = center_bounds.Max[axis] - center_bounds.Min[axis];
+			scale[axis] = extent > 0.0f ? (float)utility::kBins / extent : 0.0f;
+		}
+
+		for (uint32_t i = first; i < last; i++)
+		{
+			uint32_t primitive = indices_[i];
+			const glm::vec3& center = centers[primitive];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				Bin& bin = bins[axis][utility::BinIndex(center[axis], center_bounds.Min[axis], scale[axis])];
+				bin.Count++;
+				bin.Bounds.Grow(bounds[primitive]);
+			}
+		}
+
+		// find the cheapest split plane over all axes
+		int best_axis = -1;
+		int best_bin = 0;
+		float best_cost = FLT_MAX;
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			// every centre lies on the same plane
+			if (scale[axis] == 0.0f)
+				continue;
+
+			// sweep from both sides to get the area and count left and right of each plane
+			float left_area[utility::kBins - 1], right_area[utility::kBins - 1];
+			uint32_t left_count[utility::kBins - 1], right_count[utility::kBins - 1];
+
+			AABB left_box, right_box;
+			uint32_t left_sum = 0, right_sum = 0;
+			for (int i = 0; i < utility::kBins - 1; i++)
+			{
+				const Bin& left_bin = bins[axis][i];
+				left_sum += left_bin.Count;
+				left_count[i] = left_sum;
+				left_box.Grow(left_bin.Bounds);
+				left_area[i] = left_box.HalfArea();
+
+				const Bin& right_bin = bins[axis][utility::kBins - 1 - i];
+				right_sum += right_bin.Count;
+				right_count[utility::kBins - 2 - i] = right_sum;
+				right_box.Grow(right_bin.Bounds);
+				right_area[utility::kBins - 2 - i] = right_box.HalfArea();
+			}
+
+			for (int i = 0; i < utility::kBins - 1; i++)
+			{
+				if (left_count[i] == 0 || right_count[i] == 0)
+					continue;
+
+				float cost = LeafCost(left_count[i]) * left_area[i] + LeafCost(right_count[i]) * right_area[i];
+				if (cost < best_cost)
+				{
+					best_cost = cost;
+					best_axis = axis;
+					best_bin = i;
+				}
+			}
+		}
+
+		if (best_axis < 0)
+			continue;
+
+		// compare against not splitting at all, both in units of the node's area
+		AABB node_box{ node.Min, node.Max };
+		float node_area = node_box.HalfArea();
+		float split_cost = utility::kTraversalCost + (node_area > 0.0f ? best_cost / node_area : 0.0f);
+		if (split_cost >= LeafCost(node.Count))
+			continue;
+
+		// partition the primitive indices around the split plane
+		uint32_t* middle = std::partition(indices_.data() + first, indices_.data() + last,
+			[&](uint32_t primitive)
+			{
+				return utility::BinIndex(centers[primitive][best_axis], center_bounds.Min[best_axis], scale[best_axis]) <= best_bin;
+			});
+
+		uint32_t left_count = (uint32_t)(middle - (indices_.data() + first));
+		if (left_count == 0 || left_count == node.Count)
+			continue;
+
+		uint32_t left_index = nodes_used_;
+		nodes_used_ += 2;
+
+		BVHNode& left = nodes_[left_index];
+		left.LeftFirst = first;
+		left.Count = left_count;
+
+		BVHNode& right = nodes_[left_index + 1];
+		right.LeftFirst = first + left_count;
+		right.Count = node.Count - left_count;
+
+		node.LeftFirst = left_index;
+		node.Count = 0;
+
+		UpdateNodeBounds(left_index, bounds);
+		UpdateNodeBounds(left_index + 1, bounds);
+
+		tasks.push_back({ left_index, task.Depth + 1 });
+		tasks.push_back({ left_index + 1, task.Depth + 1 });
+	}
+}
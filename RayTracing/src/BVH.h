@@ -0,0 +1,254 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: BVH.h
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/BVH.h
+*/
+
+#pragma once
+
+#include "Ray.h"
+
+#include <glm/glm.hpp>
+
+#include <cfloat>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+struct AABB
+{
+	glm::vec3 Min{ FLT_MAX };
+	glm::vec3 Max{ -FLT_MAX };
+
+	void Grow(const glm::vec3& point) { Min = glm::min(Min, point); Max = glm::max(Max, point); }
+	void Grow(const AABB& other) { Min = glm::min(Min, other.Min); Max = glm::max(Max, other.Max); }
+
+	glm::vec3 Center() const { return (Min + Max) * 0.5f; }
+
+	// half of the surface area, which is all the SAH needs
+	float HalfArea() const
+	{
+		glm::vec3 extent = Max - Min;
+		return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+	}
+};
+
+// 32 bytes, so both children of a node share one 64 byte cache line
+struct BVHNode
+{
+	glm::vec3 Min;
+	// first primitive if this is a leaf, otherwise the index of the left child
+	// the right child is always LeftFirst + 1
+	uint32_t LeftFirst;
+	glm::vec3 Max;
+	// number of primitives, 0 for interior nodes
+	uint32_t Count;
+
+	bool IsLeaf() const { return Count > 0; }
+};
+
+// bounding volume hierarchy over a list of primitive bounds
+// built with a binned surface area heuristic and stored as a flat node array
+class BVH
+{
+public:
+	// deeper subtrees are collapsed into leaves, this bounds the traversal stack
+	static constexpr uint32_t kMaxDepth = 64;
+
+	// builds the hierarchy from scratch
+	// leaf_width is how many primitives are tested at once, e.g. the SIMD lane count
+	// leaves are then costed per batch of leaf_width rather than per primitive
+	void Build(const std::vector<AABB>& bounds, uint32_t leaf_width = 1);
+
+	// adopts a tree built earlier, e.g. one stored in a scene file
+	// returns false and leaves the BVH empty if the nodes do not form a valid tree over the indices,
+	// one where every node but the root has one parent and every primitive sits in exactly one leaf
+	bool Assign(std::vector<BVHNode> nodes, std::vector<uint32_t> indices, uint32_t leaf_width);
+
+	// recomputes node bounds after primitives moved, keeping the topology
+	void Refit(const std::vector<AABB>& bounds);
+
+	// same, but only for the leaves holding these primitives and the nodes above them
+	// the walk up stops early at the first node whose box does not change
+	void Refit(const std::vector<AABB>& bounds, const std::vector<uint32_t>& primitives);
+
+	// SAH cost of the current tree relative to the cost right after the last build
+	// a refitted tree gets worse as primitives move, so callers can rebuild past a threshold
+	float GetCostRatio() const { return build_cost_ > 0.0f ? Cost() / build_cost_ : 1.0f; }
+
+	bool Empty() const { return nodes_.empty(); }
+	uint32_t GetPrimitiveCount() const { return (uint32_t)indices_.size(); }
+	uint32_t GetLeafWidth() const { return leaf_width_; }
+
+	const std::vector<BVHNode>& GetNodes() const { return nodes_; }
+
+	// primitive indices in leaf order, a leaf covers [LeftFirst, LeftFirst + Count)
+	const std::vector<uint32_t>& GetIndices() const { return indices_; }
+
+	// position of a primitive in GetIndices(), e.g. its slot in a SoA mirror
+	uint32_t GetSlot(uint32_t primitive) const;
+
+	// closest hit traversal
+	// intersect_leaf(first, count, hit_distance) tests the primitives of a leaf and lowers hit_distance on a hit
+	// nodes further away than hit_distance are skipped
+	template<typename IntersectLeaf>
+	void Traverse(const Ray& ray, float& hit_distance, IntersectLeaf&& intersect_leaf) const;
+
+	// any hit traversal for shadow rays, nodes are visited in any order
+	// occluded_leaf(first, count) returns true if a primitive of the leaf blocks the ray before max_distance,
+	// which ends the traversal
+	template<typename OccludedLeaf>
+	bool Occluded(const Ray& ray, float max_distance, OccludedLeaf&& occluded_leaf) const;
+private:
+	float Cost() const;
+	double NodeCost(const BVHNode& node) const;
+	void UpdateAreaCost();
+
+	// parent of every node and leaf of every primitive, for partial refits
+	void BuildLinks();
+	float LeafCost(uint32_t count) const { return (float)((count + leaf_width_ - 1) / leaf_width_); }
+	void Subdivide(const std::vector<AABB>& bounds, const std::vector<glm::vec3>& centers);
+	void UpdateNodeBounds(uint32_t node_index, const std::vector<AABB>& bounds);
+
+	static float IntersectAABB(const Ray& ray, const glm::vec3& inverse_direction, const BVHNode& node, float hit_distance);
+private:
+	std::vector<BVHNode> nodes_;
+	std::vector<uint32_t> indices_;
+	uint32_t nodes_used_ = 0;
+	uint32_t leaf_width_ = 1;
+	float build_cost_ = 0.0f;
+
+	// SAH cost before dividing by the root's area, kept up to date by refits
+	double area_cost_ = 0.0;
+
+	std::vector<uint32_t> parents_;
+	std::vector<uint32_t> leaves_;
+};
+
+inline float BVH::IntersectAABB(const Ray& ray, const glm::vec3& inverse_direction, const BVHNode& node, float hit_distance)
+{
+	// slab test, returns the entry distance or FLT_MAX on a miss
+	glm::vec3 t0 = (node.Min - ray.Origin) * inverse_direction;
+	glm::vec3 t1 = (node.Max - ray.Origin) * inverse_direction;
+
+	glm::vec3 t_near = glm::min(t0, t1);
+	glm::vec3 t_far = glm::max(t0, t1);
+
+	float t_enter = glm::max(glm::max(t_near.x, t_near.y), t_near.z);
+	float t_exit = glm::min(glm::min(t_far.x, t_far.y), t_far.z);
+
+	if (t_exit >= t_enter && t_exit > 0.0f && t_enter < hit_distance)
+		return t_enter;
+
+	return FLT_MAX;
+}
+
+template<typename IntersectLeaf>
+void BVH::Traverse(const Ray& ray, float& hit_distance, IntersectLeaf&& intersect_leaf) const
+{
+	if (nodes_.empty())
+		return;
+
+	glm::vec3 inverse_direction = 1.0f / ray.Direction;
+
+	struct StackEntry
+	{
+		uint32_t Node;
+		float Distance;
+	};
+
+	StackEntry stack[kMaxDepth];
+	uint32_t stack_size = 0;
+
+	const BVHNode* node = &nodes_[0];
+	if (IntersectAABB(ray, inverse_direction, *node, hit_distance) == FLT_MAX)
+		return;
+
+	while (true)
+	{
+		if (node->IsLeaf())
+		{
+			intersect_leaf(node->LeftFirst, node->Count, hit_distance);
+		}
+		else
+		{
+			uint32_t near_child = node->LeftFirst;
+			uint32_t far_child = node->LeftFirst + 1;
+
+			float near_distance = IntersectAABB(ray, inverse_direction, nodes_[near_child], hit_distance);
+			float far_distance = IntersectAABB(ray, inverse_direction, nodes_[far_child], hit_distance);
+
+			// visit the nearer child first so hit_distance shrinks as early as possible
+			if (far_distance < near_distance)
+			{
+				std::swap(near_child, far_child);
+				std::swap(near_distance, far_distance);
+			}
+
+			if (near_distance != FLT_MAX)
+			{
+				if (far_distance != FLT_MAX)
+					stack[stack_size++] = { far_child, far_distance };
+
+				node = &nodes_[near_child];
+				continue;
+			}
+		}
+
+		// pop the next node, skipping any that are now behind the closest hit
+		node = nullptr;
+		while (stack_size > 0)
+		{
+			const StackEntry& entry = stack[--stack_size];
+			if (entry.Distance < hit_distance)
+			{
+				node = &nodes_[entry.Node];
+				break;
+			}
+		}
+
+		if (!node)
+			return;
+	}
+}
+
+template<typename OccludedLeaf>
+bool BVH::Occluded(const Ray& ray, float max_distance, OccludedLeaf&& occluded_leaf) const
+{
+	if (nodes_.empty())
+		return false;
+
+	glm::vec3 inverse_direction = 1.0f / ray.Direction;
+
+	uint32_t stack[kMaxDepth];
+	uint32_t stack_size = 0;
+
+	if (IntersectAABB(ray, inverse_direction, nodes_[0], max_distance) == FLT_MAX)
+		return false;
+
+	stack[stack_size++] = 0;
+	while (stack_size > 0)
+	{
+		const BVHNode& node = nodes_[stack[--stack_size]];
+		if (node.IsLeaf())
+		{
+			if (occluded_leaf(node.LeftFirst, node.Count))
+				return true;
+			continue;
+		}
+
+		// the first hit ends the search, so there is no point ordering the children
+		for (uint32_t child = node.LeftFirst; child < node.LeftFirst + 2; child++)
+		{
+			if (IntersectAABB(ray, inverse_direction, nodes_[child], max_distance) != FLT_MAX)
+				stack[stack_size++] = child;
+		}
+	}
+
+	return false;
+}
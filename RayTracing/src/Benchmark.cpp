@@ -0,0 +1,383 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: Benchmark.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/Benchmark.cpp
+
+	Notes: Renders a fixed set of scenes with fixed cameras, resolutions and sample counts,
+	and writes rays/s, ns/ray, per bounce timings and thread scaling as JSON.
+*/
+
+#include "Walnut/Timer.h"
+
+#include "Camera.h"
+#include "Renderer.h"
+#include "Scenes.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace utility
+{
+	struct BenchmarkCase
+	{
+		const char* Name;
+		std::function<Scene()> Build;
+		glm::vec3 Position;
+		glm::vec3 Direction;
+
+		// full size run, --quick divides the resolution by 2 and the samples by 4
+		uint32_t Width, Height;
+		uint32_t Samples;
+	};
+
+	// time of one pass over every sample at a given thread count
+	struct ScalingResult
+	{
+		uint32_t Threads;
+		float Milliseconds;
+	};
+
+	// camera in front of the random sphere cube, far enough back to see all of it
+	static glm::vec3 RandomSpheresCamera(uint32_t count)
+	{
+		return { 0.0f, 0.0f, 4.0f * scenes::RandomSpheresExtent(count) };
+	}
+
+	static std::vector<BenchmarkCase> GetCases()
+	{
+		return {
+			{ "default", [] { return scenes::Default(); }, { 0.0f, 0.0f, 6.0f }, { 0.0f, 0.0f, -1.0f }, 640, 360, 32 },
+			{ "random-1k", [] { return scenes::RandomSpheres(1000); }, RandomSpheresCamera(1000), { 0.0f, 0.0f, -1.0f }, 640, 360, 16 },
+			{ "random-100k", [] { return scenes::RandomSpheres(100000); }, RandomSpheresCamera(100000), { 0.0f, 0.0f, -1.0f }, 640, 360, 16 },
+			{ "random-1m", [] { return scenes::RandomSpheres(1000000); }, RandomSpheresCamera(1000000), { 0.0f, 0.0f, -1.0f }, 640, 360, 8 },
+			{ "emissive-grid", [] { return scenes::EmissiveGrid(16); }, { 0.0f, 8.0f, 14.0f }, { 0.0f, -0.6f, -1.0f }, 640, 360, 32 },
+			{ "instanced-100k", [] { return scenes::InstancedClusters(100000, 100); }, RandomSpheresCamera(100000), { 0.0f, 0.0f, -1.0f }, 640, 360, 8 },
+		};
+	}
+
+	// 1, 2, 4, ... up to and including max_threads
+	static std::vector<uint32_t> GetThreadCounts(uint32_t max_threads)
+	{
+		std::vector<uint32_t> counts;
+		for (uint32_t threads = 1; threads < max_threads; threads *= 2)
+		{
+			counts.push_back(threads);
+		}
+		counts.push_back(max_threads);
+		return counts;
+	}
+
+	static void PrintUsage(const char* program)
+	{
+		printf("usage: %s [options]\n", program);
+		printf("  --output <file>          JSON results, default is standard output\n");
+		printf("  --scene <name>           only run this scene, one of\n");
+		printf("                          ");
+		for (const BenchmarkCase& benchmark : GetCases())
+		{
+			printf(" %s", benchmark.Name);
+		}
+		printf("\n");
+		printf("  --quick                  half resolution and a quarter of the samples\n");
+		printf("  --accumulation <format>  rgb32f, rgb16f or fixed64 accumulation storage (default rgb32f)\n");
+		printf("  --threads <n>            most threads of the scaling curve (default every hardware thread)\n");
+		printf("  --no-simd                use the scalar intersection kernel\n");
+		printf("  --wavefront              trace one bounce of every path in a tile at a time\n");
+		printf("  --sort-rays              with --wavefront, group each bounce's rays by direction\n");
+		printf("  --nee                    sample emissive spheres directly at every bounce\n");
+		printf("  --max-depth <n>          most rays per path, including the primary ray (default 5)\n");
+		printf("  --roulette               with --nee, end dark paths early with Russian roulette\n");
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string output, only_scene;
+	bool quick = false, simd = true, wavefront = false, sort_rays = false, next_event_estimation = false;
+	bool russian_roulette = false;
+	uint32_t max_depth = 5;
+	AccumulationFormat accumulation = AccumulationFormat::RGB32F;
+	uint32_t max_threads = ThreadPool::GetHardwareThreadCount();
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+		{
+			utility::PrintUsage(argv[0]);
+			return 0;
+		}
+
+		if (strcmp(arg, "--quick") == 0)
+		{
+			quick = true;
+			continue;
+		}
+
+		if (strcmp(arg, "--no-simd") == 0)
+		{
+			simd = false;
+			continue;
+		}
+
+		if (strcmp(arg, "--wavefront") == 0)
+		{
+			wavefront = true;
+			continue;
+		}
+
+		if (strcmp(arg, "--sort-rays") == 0)
+		{
+			sort_rays = true;
+			continue;
+		}
+
+		if (strcmp(arg, "--nee") == 0)
+		{
+			next_event_estimation = true;
+			continue;
+		}
+
+		if (strcmp(arg, "--roulette") == 0)
+		{
+			russian_roulette = true;
+			continue;
+		}
+
+		// every other option takes a value
+		if (!value)
+		{
+			fprintf(stderr, "missing value for %s\n", arg);
+			return 1;
+		}
+
+		bool ok = true;
+		if (strcmp(arg, "--output") == 0)
+			output = value;
+		else if (strcmp(arg, "--scene") == 0)
+			only_scene = value;
+		else if (strcmp(arg, "--max-depth") == 0)
+			ok = (max_depth = (uint32_t)atoi(value)) > 0;
+		else if (strcmp(arg, "--accumulation") == 0)
+			ok = ParseAccumulationFormat(value, accumulation);
+		else if (strcmp(arg, "--threads") == 0)
+			ok = (max_threads = (uint32_t)atoi(value)) > 0;
+		else
+			ok = false;
+
+		if (!ok)
+		{
+			fprintf(stderr, "invalid option %s %s\n", arg, value);
+			utility::PrintUsage(argv[0]);
+			return 1;
+		}
+		i++;
+	}
+
+	std::vector<utility::BenchmarkCase> cases = utility::GetCases();
+	if (!only_scene.empty())
+	{
+		cases.erase(std::remove_if(cases.begin(), cases.end(),
+			[&](const utility::BenchmarkCase& benchmark) { return only_scene != benchmark.Name; }), cases.end());
+
+		if (cases.empty())
+		{
+			fprintf(stderr, "unknown scene %s\n", only_scene.c_str());
+			return 1;
+		}
+	}
+
+	FILE* file = output.empty() ? stdout : fopen(output.c_str(), "w");
+	if (!file)
+	{
+		fprintf(stderr, "could not open %s\n", output.c_str());
+		return 1;
+	}
+
+	std::vector<uint32_t> thread_counts = utility::GetThreadCounts(max_threads);
+	kernels::ISA isa = simd ? kernels::GetBestISA() : kernels::ISA::Scalar;
+
+	fprintf(file, "{\n");
+	fprintf(file, "  \"isa\": \"%s\",\n", kernels::GetISAName(isa));
+	fprintf(file, "  \"hardware_threads\": %u,\n", ThreadPool::GetHardwareThreadCount());
+	fprintf(file, "  \"quick\": %s,\n", quick ? "true" : "false");
+	fprintf(file, "  \"integrator\": \"%s\",\n", wavefront ? (sort_rays ? "wavefront-sorted" : "wavefront") : "path");
+	fprintf(file, "  \"next_event_estimation\": %s,\n", next_event_estimation ? "true" : "false");
+	fprintf(file, "  \"max_depth\": %u,\n", max_depth);
+	fprintf(file, "  \"russian_roulette\": %s,\n", russian_roulette ? "true" : "false");
+	fprintf(file, "  \"accumulation\": \"%s\",\n", GetAccumulationFormatName(accumulation));
+	fprintf(file, "  \"scenes\": [\n");
+
+	for (size_t case_index = 0; case_index < cases.size(); case_index++)
+	{
+		const utility::BenchmarkCase& benchmark = cases[case_index];
+
+		uint32_t width = quick ? benchmark.Width / 2 : benchmark.Width;
+		uint32_t height = quick ? benchmark.Height / 2 : benchmark.Height;
+		uint32_t samples = quick ? std::max(benchmark.Samples / 4, 1u) : benchmark.Samples;
+
+		// progress goes to stderr so stdout stays valid JSON
+		fprintf(stderr, "%s: %ux%u, %u samples per pixel\n", benchmark.Name, width, height, samples);
+
+		Walnut::Timer scene_timer;
+		Scene scene = benchmark.Build();
+		float scene_time = scene_timer.ElapsedMillis();
+
+		Camera camera(45.0f, 0.1f, 100.0f);
+		camera.OnResize(width, height);
+		camera.LookAt(benchmark.Position, benchmark.Direction);
+
+		// a fixed seed traces the same paths in every pass, so the ray count of the
+		// stats pass is also the ray count of the timed passes
+		Renderer renderer;
+		Renderer::Settings& settings = renderer.GetSettings();
+		settings.SIMD = simd;
+		settings.Wavefront = wavefront;
+		settings.SortRays = sort_rays;
+		settings.NextEventEstimation = next_event_estimation;
+		settings.MaxDepth = max_depth;
+		settings.RussianRoulette = russian_roulette;
+		settings.Accumulation = accumulation;
+		settings.DeterministicSeed = true;
+		settings.Seed = 1;
+		settings.ThreadCount = max_threads;
+		renderer.OnResize(width, height);
+
+		// the first frame also builds the BVH
+		Walnut::Timer first_frame_timer;
+		renderer.Render(scene, camera);
+		float first_frame_time = first_frame_timer.ElapsedMillis();
+
+		// stats pass, rays per bounce and the time spent tracing them
+		settings.CollectStats = true;
+		renderer.ResetStats();
+		renderer.ResetFrameIndex();
+		for (uint32_t i = 0; i < samples; i++)
+		{
+			renderer.Render(scene, camera);
+		}
+		settings.CollectStats = false;
+
+		std::vector<Renderer::BounceStats> bounces = renderer.GetBounceStats();
+		uint64_t rays = 0;
+		for (const Renderer::BounceStats& bounce : bounces)
+		{
+			rays += bounce.Rays;
+		}
+
+		// the primary rays again as visibility queries on one thread, against the depth 0 closest hit cost
+		std::vector<Ray> occlusion_rays((size_t)width * height);
+		for (uint32_t y = 0; y < height; y++)
+		{
+			for (uint32_t x = 0; x < width; x++)
+			{
+				Ray& ray = occlusion_rays[(size_t)y * width + x];
+				ray.Origin = camera.GetPosition();
+				ray.Direction = camera.GetRayDirection(x, y);
+			}
+		}
+		std::vector<float> occlusion_distances(occlusion_rays.size(), std::numeric_limits<float>::max());
+		std::vector<uint8_t> occluded(occlusion_rays.size());
+
+		Walnut::Timer occlusion_timer;
+		renderer.IsOccluded(occlusion_rays.data(), occlusion_distances.data(), (uint32_t)occlusion_rays.size(), occluded.data());
+		double occlusion_ns = occlusion_timer.ElapsedMillis() * 1.0e6 / (double)occlusion_rays.size();
+
+		// one resolve of the accumulated image, on every thread
+		Walnut::Timer resolve_timer;
+		renderer.Resolve();
+		float resolve_time = resolve_timer.ElapsedMillis();
+
+		// timed passes without the stats overhead
+		std::vector<utility::ScalingResult> scaling;
+		for (uint32_t threads : thread_counts)
+		{
+			settings.ThreadCount = threads;
+
+			// starts the thread pool outside the timed frames
+			renderer.ResetFrameIndex();
+			renderer.Render(scene, camera);
+
+			renderer.ResetFrameIndex();
+			Walnut::Timer timer;
+			for (uint32_t i = 0; i < samples; i++)
+			{
+				renderer.Render(scene, camera);
+			}
+			scaling.push_back({ threads, timer.ElapsedMillis() });
+
+			fprintf(stderr, "  %u threads: %.2fms\n", threads, scaling.back().Milliseconds);
+		}
+
+		// the headline numbers use the most threads
+		double time = scaling.back().Milliseconds;
+		double rays_per_second = time > 0.0 ? (double)rays / (time * 0.001) : 0.0;
+		double ns_per_ray = rays > 0 ? time * 1.0e6 / (double)rays : 0.0;
+
+		fprintf(file, "    {\n");
+		fprintf(file, "      \"name\": \"%s\",\n", benchmark.Name);
+		fprintf(file, "      \"spheres\": %zu,\n", scene.Spheres.size());
+		fprintf(file, "      \"instances\": %zu,\n", scene.Instances.size());
+		fprintf(file, "      \"width\": %u,\n", width);
+		fprintf(file, "      \"height\": %u,\n", height);
+		fprintf(file, "      \"samples_per_pixel\": %u,\n", samples);
+		fprintf(file, "      \"scene_build_ms\": %.3f,\n", scene_time);
+		fprintf(file, "      \"first_frame_ms\": %.3f,\n", first_frame_time);
+		fprintf(file, "      \"threads\": %u,\n", scaling.back().Threads);
+		fprintf(file, "      \"time_ms\": %.3f,\n", time);
+		fprintf(file, "      \"rays\": %llu,\n", (unsigned long long)rays);
+		fprintf(file, "      \"rays_per_second\": %.1f,\n", rays_per_second);
+		fprintf(file, "      \"ns_per_ray\": %.3f,\n", ns_per_ray);
+
+		// bounce times come from the stats pass and include its clock overhead
+		fprintf(file, "      \"bounces\": [\n");
+		for (size_t i = 0; i < bounces.size(); i++)
+		{
+			const Renderer::BounceStats& bounce = bounces[i];
+			double bounce_ns = bounce.Rays > 0 ? bounce.Milliseconds * 1.0e6 / (double)bounce.Rays : 0.0;
+			fprintf(file, "        { \"depth\": %zu, \"rays\": %llu, \"terminated\": %llu, \"trace_ms\": %.3f, \"ns_per_ray\": %.3f }%s\n",
+				i, (unsigned long long)bounce.Rays, (unsigned long long)bounce.Terminated, bounce.Milliseconds, bounce_ns,
+				i + 1 < bounces.size() ? "," : "");
+		}
+		fprintf(file, "      ],\n");
+		fprintf(file, "      \"occlusion_ns_per_ray\": %.3f,\n", occlusion_ns);
+		fprintf(file, "      \"resolve_ms\": %.3f,\n", resolve_time);
+
+		fprintf(file, "      \"scaling\": [\n");
+		for (size_t i = 0; i < scaling.size(); i++)
+		{
+			const utility::ScalingResult& result = scaling[i];
+			double speedup = result.Milliseconds > 0.0f ? scaling.front().Milliseconds / result.Milliseconds : 0.0;
+			double result_rays_per_second = result.Milliseconds > 0.0f ? (double)rays / (result.Milliseconds * 0.001) : 0.0;
+			fprintf(file, "        { \"threads\": %u, \"time_ms\": %.3f, \"rays_per_second\": %.1f, \"speedup\": %.3f }%s\n",
+				result.Threads, result.Milliseconds, result_rays_per_second, speedup, i + 1 < scaling.size() ? "," : "");
+		}
+		fprintf(file, "      ]\n");
+
+		fprintf(file, "    }%s\n", case_index + 1 < cases.size() ? "," : "");
+	}
+
+	fprintf(file, "  ]\n");
+	fprintf(file, "}\n");
+
+	if (file != stdout)
+	{
+		fclose(file);
+		fprintf(stderr, "wrote %s\n", output.c_str());
+	}
+
+	return 0;
+}
@@ -13,13 +13,21 @@
 
 #include "Camera.h"
 
+#include <algorithm>
+
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtx/quaternion.hpp>
 
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#ifndef RT_HEADLESS
 #include "Walnut/Input/Input.h"
 
 using namespace Walnut;
+#endif
 
 Camera::Camera(float verticalFOV, float nearClip, float farClip)
 	: m_VerticalFOV(verticalFOV), m_NearClip(nearClip), m_FarClip(farClip) {
@@ -28,6 +36,10 @@ Camera::Camera(float verticalFOV, float nearClip, float farClip)
 }
 
 bool Camera::OnUpdate(float ts) {
+#ifdef RT_HEADLESS
+	// No input devices without a window
+	return false;
+#else
 	// Capture mouse input
 	glm::vec2 mousePos = Input::GetMousePosition();
 
@@ -101,6 +113,7 @@ bool Camera::OnUpdate(float ts) {
 	}
 
 	return moved;
+#endif
 }
 
 void Camera::OnResize(uint32_t width, uint32_t height) {
@@ -114,6 +127,67 @@ void Camera::OnResize(uint32_t width, uint32_t height) {
 	RecalculateRayDirections();
 }
 
+void Camera::LookAt(const glm::vec3& position, const glm::vec3& direction) {
+	m_Position = position;
+	m_ForwardDirection = glm::normalize(direction);
+
+	RecalculateView();
+	RecalculateRayDirections();
+}
+
+void Camera::SetCacheRayDirections(bool cache) {
+	if (cache == m_CacheRayDirections)
+		return;
+
+	m_CacheRayDirections = cache;
+
+	// Give the memory back when switching to on demand directions
+	if (!m_CacheRayDirections)
+		std::vector<glm::vec3>().swap(m_RayDirections);
+
+	RecalculateRayDirections();
+}
+
+void Camera::GetRayDirections(uint32_t y, uint32_t firstX, uint32_t count, glm::vec3* directions) const {
+	if (m_CacheRayDirections) {
+		std::copy_n(m_RayDirections.begin() + firstX + y * m_ViewportWidth, count, directions);
+		return;
+	}
+
+	uint32_t i = 0;
+
+#if defined(__x86_64__) || defined(_M_X64)
+	// Same operations in the same order as GetRayDirection, so both give identical directions
+	const __m128 lane = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 baseX = _mm_set1_ps(m_RayBase.x), baseY = _mm_set1_ps(m_RayBase.y), baseZ = _mm_set1_ps(m_RayBase.z);
+	const __m128 stepX = _mm_set1_ps(m_RayStepX.x), stepY = _mm_set1_ps(m_RayStepX.y), stepZ = _mm_set1_ps(m_RayStepX.z);
+	const __m128 rowX = _mm_set1_ps((float)y * m_RayStepY.x), rowY = _mm_set1_ps((float)y * m_RayStepY.y), rowZ = _mm_set1_ps((float)y * m_RayStepY.z);
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 x = _mm_add_ps(_mm_cvtepi32_ps(_mm_set1_epi32((int)(firstX + i))), lane);
+
+		__m128 dx = _mm_add_ps(_mm_add_ps(baseX, _mm_mul_ps(x, stepX)), rowX);
+		__m128 dy = _mm_add_ps(_mm_add_ps(baseY, _mm_mul_ps(x, stepY)), rowY);
+		__m128 dz = _mm_add_ps(_mm_add_ps(baseZ, _mm_mul_ps(x, stepZ)), rowZ);
+
+		__m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		__m128 inverseLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSquared));
+
+		alignas(16) float outX[4], outY[4], outZ[4];
+		_mm_store_ps(outX, _mm_mul_ps(dx, inverseLength));
+		_mm_store_ps(outY, _mm_mul_ps(dy, inverseLength));
+		_mm_store_ps(outZ, _mm_mul_ps(dz, inverseLength));
+
+		for (uint32_t j = 0; j < 4; j++)
+			directions[i + j] = glm::vec3(outX[j], outY[j], outZ[j]);
+	}
+#endif
+
+	for (; i < count; i++)
+		directions[i] = GetRayDirection(firstX + i, y);
+}
+
 float Camera::GetRotationSpeed() {
 	return 0.3f;
 }
@@ -130,6 +204,23 @@ void Camera::RecalculateView() {
 }
 
 void Camera::RecalculateRayDirections() {
+	if (m_ViewportWidth == 0 || m_ViewportHeight == 0)
+		return;
+
+	// Screen coordinates are affine in the pixel position, and the perspective divide is by the
+	// same w for every pixel, so the unnormalised world space direction is affine in x and y
+	glm::vec4 corner = m_InverseProjection * glm::vec4(-1.0f, -1.0f, 1.0f, 1.0f);
+	glm::vec4 stepX = m_InverseProjection[0] * (2.0f / (float)m_ViewportWidth);
+	glm::vec4 stepY = m_InverseProjection[1] * (2.0f / (float)m_ViewportHeight);
+
+	glm::mat3 rotation(m_InverseView);
+	m_RayBase = rotation * (glm::vec3(corner) / corner.w);
+	m_RayStepX = rotation * (glm::vec3(stepX) / corner.w);
+	m_RayStepY = rotation * (glm::vec3(stepY) / corner.w);
+
+	if (!m_CacheRayDirections)
+		return;
+
 	m_RayDirections.resize(m_ViewportWidth * m_ViewportHeight);
 
 	for (uint32_t y = 0; y < m_ViewportHeight; y++) {
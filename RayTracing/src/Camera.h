@@ -23,6 +23,9 @@ public:
 	bool OnUpdate(float ts);
 	void OnResize(uint32_t width, uint32_t height);
 
+	// Places the camera without user input, e.g. for the headless app
+	void LookAt(const glm::vec3& position, const glm::vec3& direction);
+
 	const glm::mat4& GetProjection() const { return m_Projection; }
 	const glm::mat4& GetInverseProjection() const { return m_InverseProjection; }
 	const glm::mat4& GetView() const { return m_View; }
@@ -31,8 +34,26 @@ public:
 	const glm::vec3& GetPosition() const { return m_Position; }
 	const glm::vec3& GetDirection() const { return m_ForwardDirection; }
 
+	// Empty unless ray directions are cached
 	const std::vector<glm::vec3>& GetRayDirections() const { return m_RayDirections; }
 
+	// Caching keeps a width * height array of directions that is rebuilt on every move
+	// Without it directions are generated on demand and moving the camera is nearly free
+	void SetCacheRayDirections(bool cache);
+	bool IsCachingRayDirections() const { return m_CacheRayDirections; }
+
+	// World space direction of the primary ray through pixel (x, y)
+	glm::vec3 GetRayDirection(uint32_t x, uint32_t y) const
+	{
+		if (m_CacheRayDirections)
+			return m_RayDirections[x + y * m_ViewportWidth];
+
+		return glm::normalize(m_RayBase + (float)x * m_RayStepX + (float)y * m_RayStepY);
+	}
+
+	// Directions for count pixels of row y starting at firstX, four at a time with SSE
+	void GetRayDirections(uint32_t y, uint32_t firstX, uint32_t count, glm::vec3* directions) const;
+
 	float GetRotationSpeed();
 private:
 	void RecalculateProjection();
@@ -53,6 +74,12 @@ private:
 
 	// Cached ray directions
 	std::vector<glm::vec3> m_RayDirections;
+	bool m_CacheRayDirections = false;
+
+	// Direction through pixel (x, y) before normalisation is base + x * stepX + y * stepY
+	glm::vec3 m_RayBase{ 0.0f, 0.0f, -1.0f };
+	glm::vec3 m_RayStepX{ 0.0f };
+	glm::vec3 m_RayStepY{ 0.0f };
 
 	glm::vec2 m_LastMousePosition{ 0.0f, 0.0f };
 
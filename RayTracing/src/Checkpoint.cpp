@@ -0,0 +1,437 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: Checkpoint.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/Checkpoint.cpp
+*/
+
+#include "Checkpoint.h"
+#include "Distributed.h"
+#include "MappedFile.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace utility
+{
+	static constexpr char kMagic[8] = { 'R', 'T', 'C', 'H', 'E', 'C', 'K', '\0' };
+	static constexpr uint64_t kSectionAlignment = 64;
+
+	struct CheckpointHeader
+	{
+		char Magic[8];
+		uint32_t Version;
+		uint32_t HeaderSize;
+
+		uint32_t Width, Height;
+		uint32_t FrameIndex;
+		uint32_t Seed;
+		uint32_t SampleOffset;
+
+		uint32_t Format;
+		uint32_t FirstSample;
+		uint32_t TileSize;
+		uint32_t NextEventEstimation;
+		uint32_t MaxDepth;
+		uint32_t RussianRoulette;
+		uint32_t RouletteDepth;
+		uint32_t AdaptiveSampling;
+		float NoiseThreshold;
+		uint32_t MinSamples;
+		uint32_t MaxSamplesPerFrame;
+
+		float VerticalFOV;
+		float Position[3];
+		float Direction[3];
+
+		// (pixels, samples) pairs, floats and flags in their sections
+		uint32_t RunCount;
+		uint32_t VarianceCount;
+		uint32_t TileCount;
+		uint64_t SceneHash;
+
+		// byte offsets from the start of the file
+		uint64_t AccumulationOffset;
+		uint64_t AccumulationSize;
+		uint64_t RunOffset;
+		uint64_t VarianceOffset;
+		uint64_t TileOffset;
+	};
+	static_assert(sizeof(CheckpointHeader) == 168, "CheckpointHeader layout changed, bump checkpoint::kVersion");
+
+	static uint64_t AlignSection(uint64_t offset)
+	{
+		return (offset + kSectionAlignment - 1) / kSectionAlignment * kSectionAlignment;
+	}
+
+	static bool Fail(std::string* error, const std::string& message)
+	{
+		if (error)
+			*error = message;
+		return false;
+	}
+
+	// true if count elements of element_size starting at offset lie inside the file
+	static bool SectionFits(uint64_t offset, uint64_t count, uint64_t element_size, uint64_t file_size)
+	{
+		return offset <= file_size && count <= (file_size - offset) / element_size;
+	}
+
+	// waits until the file's contents are on disk rather than in the OS cache
+	static bool SyncFile(const std::string& path)
+	{
+#if defined(_WIN32)
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		bool synced = FlushFileBuffers(file) != 0;
+		CloseHandle(file);
+		return synced;
+#else
+		int file = open(path.c_str(), O_WRONLY);
+		if (file < 0)
+			return false;
+
+		bool synced = fsync(file) == 0;
+		close(file);
+		return synced;
+#endif
+	}
+
+	// renames from over to and waits until the new name is on disk too
+	static bool RenameDurably(const std::string& from, const std::string& to, std::string& message)
+	{
+#if defined(_WIN32)
+		// windows cannot sync a directory, write through waits for the rename instead
+		if (!MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+		{
+			message = "error " + std::to_string(GetLastError());
+			return false;
+		}
+		return true;
+#else
+		if (rename(from.c_str(), to.c_str()) != 0)
+		{
+			message = strerror(errno);
+			return false;
+		}
+
+		// the name lives in the directory, which is synced separately from the file
+		std::string directory = std::filesystem::path(to).parent_path().string();
+		int handle = open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+		if (handle < 0)
+		{
+			message = "could not open its directory";
+			return false;
+		}
+
+		bool synced = fsync(handle) == 0;
+		close(handle);
+		if (!synced)
+			message = "could not sync its directory";
+		return synced;
+#endif
+	}
+
+	// runs of equal sample counts, without adaptive sampling every pixel has the same count
+	static void EncodeRuns(const std::vector<uint32_t>& counts, std::vector<uint32_t>& runs)
+	{
+		runs.clear();
+		for (size_t i = 0; i < counts.size();)
+		{
+			size_t end = i + 1;
+			while (end < counts.size() && counts[end] == counts[i] && end - i < UINT32_MAX)
+				end++;
+
+			runs.push_back((uint32_t)(end - i));
+			runs.push_back(counts[i]);
+			i = end;
+		}
+	}
+
+	static bool DecodeRuns(const uint32_t* runs, uint32_t run_count, std::vector<uint32_t>& counts)
+	{
+		size_t pixels = counts.size();
+		size_t pixel = 0;
+		for (uint32_t i = 0; i < run_count; i++)
+		{
+			uint32_t length = runs[i * 2];
+			if (length > pixels - pixel)
+				return false;
+
+			std::fill(counts.begin() + pixel, counts.begin() + pixel + length, runs[i * 2 + 1]);
+			pixel += length;
+		}
+		return pixel == pixels;
+	}
+
+	// 64 bit FNV-1a
+	static uint64_t Hash(const uint8_t* data, size_t size)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= data[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+}
+
+uint64_t checkpoint::HashScene(const Scene& scene)
+{
+	// the same bytes a coordinator sends its workers, which leave out edit versions
+	std::vector<uint8_t> data;
+	distributed::WriteScene(scene, data);
+	return utility::Hash(data.data(), data.size());
+}
+
+bool checkpoint::Write(const std::string& path, const Checkpoint& checkpoint, std::string* error)
+{
+	const Renderer::AccumulationState& state = checkpoint.State;
+
+	std::vector<uint32_t> runs;
+	utility::EncodeRuns(state.SampleCounts, runs);
+
+	utility::CheckpointHeader header = {};
+	memcpy(header.Magic, utility::kMagic, sizeof(header.Magic));
+	header.Version = kVersion;
+	header.HeaderSize = sizeof(header);
+
+	header.Width = state.Width;
+	header.Height = state.Height;
+	header.FrameIndex = state.FrameIndex;
+	header.Seed = state.Seed;
+	header.SampleOffset = state.SampleOffset;
+
+	header.Format = (uint32_t)state.Format;
+	header.FirstSample = state.FirstSample;
+	header.TileSize = state.TileSize;
+	header.NextEventEstimation = state.NextEventEstimation;
+	header.MaxDepth = state.MaxDepth;
+	header.RussianRoulette = state.RussianRoulette;
+	header.RouletteDepth = state.RouletteDepth;
+	header.AdaptiveSampling = state.AdaptiveSampling;
+	header.NoiseThreshold = state.NoiseThreshold;
+	header.MinSamples = state.MinSamples;
+	header.MaxSamplesPerFrame = state.MaxSamplesPerFrame;
+
+	header.VerticalFOV = checkpoint.VerticalFOV;
+	memcpy(header.Position, &checkpoint.Position, sizeof(header.Position));
+	memcpy(header.Direction, &checkpoint.Direction, sizeof(header.Direction));
+
+	header.RunCount = (uint32_t)(runs.size() / 2);
+	header.VarianceCount = (uint32_t)state.Variance.size();
+	header.TileCount = (uint32_t)state.TileConverged.size();
+	header.SceneHash = checkpoint.SceneHash;
+
+	header.AccumulationOffset = utility::AlignSection(sizeof(header));
+	header.AccumulationSize = state.Accumulation.size();
+	header.RunOffset = utility::AlignSection(header.AccumulationOffset + header.AccumulationSize);
+	header.VarianceOffset = utility::AlignSection(header.RunOffset + runs.size() * sizeof(uint32_t));
+	header.TileOffset = utility::AlignSection(header.VarianceOffset + (uint64_t)header.VarianceCount * sizeof(float));
+
+	std::string temporary = path + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::binary);
+		if (!file)
+			return utility::Fail(error, "could not open " + temporary);
+
+		// pads with zeros up to the next section
+		auto write_section = [&file](uint64_t offset, const void* data, uint64_t size)
+			{
+				static const char padding[utility::kSectionAlignment] = {};
+				uint64_t position = (uint64_t)file.tellp();
+				file.write(padding, (std::streamsize)(offset - position));
+				file.write((const char*)data, (std::streamsize)size);
+			};
+
+		file.write((const char*)&header, sizeof(header));
+		write_section(header.AccumulationOffset, state.Accumulation.data(), header.AccumulationSize);
+		write_section(header.RunOffset, runs.data(), runs.size() * sizeof(uint32_t));
+		write_section(header.VarianceOffset, state.Variance.data(), state.Variance.size() * sizeof(float));
+		write_section(header.TileOffset, state.TileConverged.data(), state.TileConverged.size());
+
+		file.flush();
+		if (!file)
+			return utility::Fail(error, "could not write " + temporary);
+	}
+
+	// the contents go to disk before the rename, otherwise a host lost in between could keep
+	// the new name with no data behind it in place of the previous checkpoint
+	if (!utility::SyncFile(temporary))
+		return utility::Fail(error, "could not sync " + temporary);
+
+	// replaces the previous checkpoint in one step
+	std::string message;
+	if (!utility::RenameDurably(temporary, path, message))
+		return utility::Fail(error, "could not replace " + path + ": " + message);
+	return true;
+}
+
+bool checkpoint::Read(const std::string& path, Checkpoint& checkpoint, std::string* error)
+{
+	MappedFile file;
+	if (!file.Open(path))
+		return utility::Fail(error, "could not open " + path);
+
+	const uint8_t* data = file.GetData();
+	uint64_t size = file.GetSize();
+
+	utility::CheckpointHeader header;
+	if (size < sizeof(header))
+		return utility::Fail(error, "file is too small to be a checkpoint");
+
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.Magic, utility::kMagic, sizeof(header.Magic)) != 0)
+		return utility::Fail(error, "not a checkpoint file");
+	if (header.Version != kVersion || header.HeaderSize != sizeof(header))
+		return utility::Fail(error, "checkpoint version " + std::to_string(header.Version) + ", expected " + std::to_string(kVersion));
+
+	if (!utility::SectionFits(header.AccumulationOffset, header.AccumulationSize, 1, size) ||
+		!utility::SectionFits(header.RunOffset, header.RunCount, 2 * sizeof(uint32_t), size) ||
+		!utility::SectionFits(header.VarianceOffset, header.VarianceCount, sizeof(float), size) ||
+		!utility::SectionFits(header.TileOffset, header.TileCount, 1, size))
+		return utility::Fail(error, "checkpoint is truncated");
+
+	if (header.Format > (uint32_t)AccumulationFormat::Fixed64)
+		return utility::Fail(error, "checkpoint has an unknown accumulation format");
+	if ((uint64_t)header.Width * header.Height * GetAccumulationBytesPerPixel((AccumulationFormat)header.Format) != header.AccumulationSize)
+		return utility::Fail(error, "checkpoint accumulation does not match its image size");
+
+	Checkpoint loaded;
+	Renderer::AccumulationState& state = loaded.State;
+	state.Width = header.Width;
+	state.Height = header.Height;
+	state.FrameIndex = header.FrameIndex;
+	state.Seed = header.Seed;
+	state.SampleOffset = header.SampleOffset;
+
+	state.Format = (AccumulationFormat)header.Format;
+	state.FirstSample = header.FirstSample;
+	state.TileSize = header.TileSize;
+	state.NextEventEstimation = header.NextEventEstimation != 0;
+	state.MaxDepth = header.MaxDepth;
+	state.RussianRoulette = header.RussianRoulette != 0;
+	state.RouletteDepth = header.RouletteDepth;
+	state.AdaptiveSampling = header.AdaptiveSampling != 0;
+	state.NoiseThreshold = header.NoiseThreshold;
+	state.MinSamples = header.MinSamples;
+	state.MaxSamplesPerFrame = header.MaxSamplesPerFrame;
+
+	loaded.VerticalFOV = header.VerticalFOV;
+	memcpy(&loaded.Position, header.Position, sizeof(header.Position));
+	memcpy(&loaded.Direction, header.Direction, sizeof(header.Direction));
+	loaded.SceneHash = header.SceneHash;
+
+	// one bulk copy per section, the renderer checks the sizes against the image
+	state.Accumulation.assign(data + header.AccumulationOffset, data + header.AccumulationOffset + header.AccumulationSize);
+
+	state.SampleCounts.resize((size_t)header.Width * header.Height);
+	std::vector<uint32_t> runs((size_t)header.RunCount * 2);
+	memcpy(runs.data(), data + header.RunOffset, runs.size() * sizeof(uint32_t));
+	if (!utility::DecodeRuns(runs.data(), header.RunCount, state.SampleCounts))
+		return utility::Fail(error, "checkpoint sample counts do not cover the image");
+
+	state.Variance.resize(header.VarianceCount);
+	memcpy(state.Variance.data(), data + header.VarianceOffset, state.Variance.size() * sizeof(float));
+	state.TileConverged.assign(data + header.TileOffset, data + header.TileOffset + header.TileCount);
+
+	checkpoint = std::move(loaded);
+	return true;
+}
+
+checkpoint::Writer::Writer(std::string path)
+	: path_(std::move(path))
+{
+	thread_ = std::thread(&Writer::Run, this);
+}
+
+checkpoint::Writer::~Writer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	condition_.notify_all();
+	thread_.join();
+}
+
+void checkpoint::Writer::Submit(Checkpoint& checkpoint)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::swap(pending_, checkpoint);
+		if (has_pending_)
+			skipped_++;
+		has_pending_ = true;
+	}
+	condition_.notify_all();
+}
+
+bool checkpoint::Writer::Flush(std::string* error)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	condition_.wait(lock, [this]() { return !has_pending_ && !writing_; });
+
+	if (!error_.empty())
+		return utility::Fail(error, error_);
+	return true;
+}
+
+uint32_t checkpoint::Writer::GetWrittenCount()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return written_;
+}
+
+uint32_t checkpoint::Writer::GetSkippedCount()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return skipped_;
+}
+
+void checkpoint::Writer::Run()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true)
+	{
+		// the last checkpoint is still written when stopping
+		condition_.wait(lock, [this]() { return has_pending_ || stop_; });
+		if (!has_pending_)
+			return;
+
+		// current_ keeps the allocations of the last write, they go back to the caller with the next Submit
+		std::swap(current_, pending_);
+		has_pending_ = false;
+		writing_ = true;
+
+		lock.unlock();
+		std::string error;
+		bool written = Write(path_, current_, &error);
+		lock.lock();
+
+		writing_ = false;
+		error_ = written ? std::string() : error;
+		if (written)
+			written_++;
+		condition_.notify_all();
+	}
+}
@@ -0,0 +1,102 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: Checkpoint.h
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/Checkpoint.h
+*/
+
+#pragma once
+
+#include "Renderer.h"
+#include "Scene.h"
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// snapshots of a render in progress, so a long render survives a crash or preemption
+//
+// a fixed header followed by 64 byte aligned sections, in the byte order of the host that wrote them:
+//   accumulation   the raw AccumulationBuffer, in the format of the header
+//   sample counts  runs of (pixels, samples), a single run unless adaptive sampling is on
+//   variance       Mean and M2 of each pixel, only with adaptive sampling
+//   tiles          one converged flag per tile, only with adaptive sampling
+// the file is written next to its final path, synced and renamed over it, so a write that is
+// interrupted, even by losing the host, leaves the previous checkpoint in place
+namespace checkpoint
+{
+	static constexpr uint32_t kVersion = 1;
+
+	struct Checkpoint
+	{
+		// the camera and scene the samples were taken of, a resumed render has to use the same
+		float VerticalFOV = 45.0f;
+		glm::vec3 Position{ 0.0f, 0.0f, 6.0f };
+		glm::vec3 Direction{ 0.0f, 0.0f, -1.0f };
+		uint64_t SceneHash = 0;
+
+		Renderer::AccumulationState State;
+	};
+
+	// hash of everything in the scene that changes the image
+	uint64_t HashScene(const Scene& scene);
+
+	// returns false with a reason in error if the file could not be written
+	bool Write(const std::string& path, const Checkpoint& checkpoint, std::string* error = nullptr);
+
+	// returns false with a reason in error if the file is missing, truncated or from another version
+	bool Read(const std::string& path, Checkpoint& checkpoint, std::string* error = nullptr);
+
+	// writes checkpoints to one path on a background thread, so rendering only pays for copying the state
+	class Writer
+	{
+	public:
+		explicit Writer(std::string path);
+
+		// finishes the write in progress and the one waiting, if any
+		~Writer();
+
+		Writer(const Writer&) = delete;
+		Writer& operator=(const Writer&) = delete;
+
+		// swaps checkpoint with the one waiting to be written, so the caller gets back an earlier
+		// checkpoint's allocations to fill next time. a checkpoint still waiting is replaced
+		void Submit(Checkpoint& checkpoint);
+
+		// waits until every submitted checkpoint is written or replaced
+		// returns false with a reason in error if the last write failed
+		bool Flush(std::string* error = nullptr);
+
+		// checkpoints written, and replaced before they could be
+		uint32_t GetWrittenCount();
+		uint32_t GetSkippedCount();
+	private:
+		void Run();
+	private:
+		std::string path_;
+
+		std::mutex mutex_;
+		std::condition_variable condition_;
+
+		// pending_ is handed over by Submit, current_ is the one being written
+		Checkpoint pending_;
+		Checkpoint current_;
+		bool has_pending_ = false;
+		bool writing_ = false;
+		bool stop_ = false;
+
+		std::string error_;
+		uint32_t written_ = 0;
+		uint32_t skipped_ = 0;
+
+		std::thread thread_;
+	};
+}
@@ -0,0 +1,211 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: Denoiser.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/Denoiser.cpp
+*/
+
+#include "Denoiser.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace utility
+{
+	// pixels per side of the tiles a pass is split into
+	static constexpr uint32_t kDenoiseTileSize = 32;
+
+	// B3 spline, the 5x5 kernel is the outer product of this with itself
+	static constexpr float kKernel[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+	// distance of each tap from the centre, in steps
+	static const float kTapDistance[5][5] = {
+		{ 2.828427f, 2.236068f, 2.0f, 2.236068f, 2.828427f },
+		{ 2.236068f, 1.414214f, 1.0f, 1.414214f, 2.236068f },
+		{ 2.0f, 1.0f, 0.0f, 1.0f, 2.0f },
+		{ 2.236068f, 1.414214f, 1.0f, 1.414214f, 2.236068f },
+		{ 2.828427f, 2.236068f, 2.0f, 2.236068f, 2.828427f },
+	};
+
+	// how sharply each guide stops the filter, from the SVGF paper where it has one
+	// the normal weight is dot(n, n')^128, computed with seven squarings
+	static constexpr float kLuminanceSigma = 4.0f;
+	static constexpr float kDepthSigma = 1.0f;
+	static constexpr float kAlbedoSigma = 0.1f;
+
+	static float Luminance(const glm::vec3& color)
+	{
+		return glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+	}
+
+	static float NormalWeight(const glm::vec3& a, const glm::vec3& b)
+	{
+		float weight = std::max(glm::dot(a, b), 0.0f);
+		for (int i = 0; i < 7; i++)
+			weight *= weight;
+		return weight;
+	}
+}
+
+void Denoiser::Resize(uint32_t width, uint32_t height)
+{
+	width_ = width;
+	height_ = height;
+	tiles_x_ = (width + utility::kDenoiseTileSize - 1) / utility::kDenoiseTileSize;
+	tiles_y_ = (height + utility::kDenoiseTileSize - 1) / utility::kDenoiseTileSize;
+
+	buffers_[0].Resize((size_t)width * height);
+	buffers_[1].Resize((size_t)width * height);
+	guides_.Resize((size_t)width * height);
+	output_ = 0;
+}
+
+void Denoiser::Denoise(ThreadPool& thread_pool, const Guides& guides, uint32_t passes)
+{
+	output_ = 0;
+	if (passes == 0 || width_ == 0 || height_ == 0)
+		return;
+
+	// depth changes quickly across surfaces seen at grazing angles, so depth differences are
+	// measured against the change to the next pixel instead of an absolute threshold
+	// the guides are gathered into one array on the way
+	thread_pool.ParallelFor(height_, [this, &guides](uint32_t y, uint32_t /*worker*/)
+		{
+			for (uint32_t x = 0; x < width_; x++)
+			{
+				uint32_t pixel = x + y * width_;
+				float depth = guides.Depth[pixel];
+
+				float gradient = 0.0f;
+				auto neighbour = [&](uint32_t other)
+					{
+						if (guides.Depth[other] >= 0.0f)
+							gradient = std::max(gradient, std::abs(guides.Depth[other] - depth));
+					};
+
+				if (depth >= 0.0f)
+				{
+					if (x > 0) neighbour(pixel - 1);
+					if (x + 1 < width_) neighbour(pixel + 1);
+					if (y > 0) neighbour(pixel - width_);
+					if (y + 1 < height_) neighbour(pixel + width_);
+				}
+
+				GuidePixel& guide = guides_[pixel];
+				guide.Normal = guides.Normal[pixel];
+				guide.Depth = depth;
+				guide.Albedo = guides.Albedo[pixel];
+				guide.DepthGradient = gradient;
+			}
+		});
+
+	for (uint32_t pass = 0; pass < passes; pass++)
+	{
+		thread_pool.ParallelFor(tiles_x_ * tiles_y_, [this, pass](uint32_t tile, uint32_t /*worker*/)
+			{
+				FilterTile(tile, pass);
+			});
+		output_ ^= 1;
+	}
+}
+
+void Denoiser::FilterTile(uint32_t tile, uint32_t pass)
+{
+	const glm::vec4* input = buffers_[output_].Data();
+	glm::vec4* output = buffers_[output_ ^ 1].Data();
+
+	int step = 1 << pass;
+	int width = (int)width_, height = (int)height_;
+
+	int min_x = (int)((tile % tiles_x_) * utility::kDenoiseTileSize);
+	int min_y = (int)((tile / tiles_x_) * utility::kDenoiseTileSize);
+	int max_x = std::min(min_x + (int)utility::kDenoiseTileSize, width);
+	int max_y = std::min(min_y + (int)utility::kDenoiseTileSize, height);
+
+	for (int y = min_y; y < max_y; y++)
+	{
+		for (int x = min_x; x < max_x; x++)
+		{
+			uint32_t pixel = (uint32_t)(x + y * width);
+			const glm::vec4& centre = input[pixel];
+
+			// the background has no surface to guide the filter, and is flat anyway
+			const GuidePixel& guide = guides_[pixel];
+			if (guide.Depth < 0.0f)
+			{
+				output[pixel] = centre;
+				continue;
+			}
+
+			// depth differences are compared against how much depth changes over the tap's distance
+			float depth_scale = utility::kDepthSigma * guide.DepthGradient * (float)step;
+			float luminance = utility::Luminance(glm::vec3(centre));
+
+			// a single pixel's variance estimate is noisy itself, so it is blurred over 3x3 first
+			float variance = 0.0f, variance_weight = 0.0f;
+			for (int dy = -1; dy <= 1; dy++)
+			{
+				for (int dx = -1; dx <= 1; dx++)
+				{
+					int sx = x + dx, sy = y + dy;
+					if (sx < 0 || sy < 0 || sx >= width || sy >= height)
+						continue;
+
+					float weight = utility::kKernel[dx + 2] * utility::kKernel[dy + 2];
+					variance += input[sx + sy * width].a * weight;
+					variance_weight += weight;
+				}
+			}
+			float luminance_scale = 1.0f / (utility::kLuminanceSigma * std::sqrt(std::max(variance / variance_weight, 0.0f)) + 1e-6f);
+
+			glm::vec3 color = glm::vec3(centre) * (utility::kKernel[2] * utility::kKernel[2]);
+			float color_variance = centre.a * (utility::kKernel[2] * utility::kKernel[2]) * (utility::kKernel[2] * utility::kKernel[2]);
+			float total_weight = utility::kKernel[2] * utility::kKernel[2];
+
+			for (int ky = -2; ky <= 2; ky++)
+			{
+				int sy = y + ky * step;
+				if (sy < 0 || sy >= height)
+					continue;
+
+				for (int kx = -2; kx <= 2; kx++)
+				{
+					int sx = x + kx * step;
+					if ((kx == 0 && ky == 0) || sx < 0 || sx >= width)
+						continue;
+
+					uint32_t sample = (uint32_t)(sx + sy * width);
+					const GuidePixel& sample_guide = guides_[sample];
+					if (sample_guide.Depth < 0.0f)
+						continue;
+
+					// facing away, nothing else can bring the weight back
+					float normal_weight = utility::NormalWeight(guide.Normal, sample_guide.Normal);
+					if (normal_weight == 0.0f)
+						continue;
+
+					const glm::vec4& value = input[sample];
+
+					float depth_term = std::abs(guide.Depth - sample_guide.Depth) / (depth_scale * utility::kTapDistance[ky + 2][kx + 2] + 1e-4f);
+					float luminance_term = std::abs(luminance - utility::Luminance(glm::vec3(value))) * luminance_scale;
+					glm::vec3 albedo_difference = guide.Albedo - sample_guide.Albedo;
+					float albedo_term = glm::dot(albedo_difference, albedo_difference) * (1.0f / (utility::kAlbedoSigma * utility::kAlbedoSigma));
+
+					float weight = utility::kKernel[kx + 2] * utility::kKernel[ky + 2] * normal_weight *
+						std::exp(-depth_term - luminance_term - albedo_term);
+
+					color += glm::vec3(value) * weight;
+					color_variance += value.a * weight * weight;
+					total_weight += weight;
+				}
+			}
+
+			// the variance of a weighted mean, so the next pass trusts this pixel more
+			output[pixel] = glm::vec4(color / total_weight, color_variance / (total_weight * total_weight));
+		}
+	}
+}
@@ -0,0 +1,73 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: Denoiser.h
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/Denoiser.h
+*/
+
+#pragma once
+
+#include "AccumulationBuffer.h"
+#include "ThreadPool.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+// edge-avoiding a-trous wavelet filter, from Dammertz et al. - Edge-Avoiding A-Trous Wavelet Transform
+// for fast Global Illumination Filtering (2010), with the variance guided luminance weight of
+// Schied et al. - Spatiotemporal Variance-Guided Filtering (2017)
+//
+// every pass blurs with a 5x5 B3 spline kernel whose taps are 2^pass pixels apart, so five passes
+// reach 62 pixels for the cost of 125 taps. a tap counts less the more its first hit's normal,
+// depth or albedo differs from the centre's, and the more its luminance differs relative to the
+// noise the centre pixel still has, so edges and converged areas stay sharp
+class Denoiser
+{
+public:
+	// first hit of each pixel's primary ray, depth is negative where the ray missed everything
+	struct Guides
+	{
+		const glm::vec3* Albedo = nullptr;
+		const glm::vec3* Normal = nullptr;
+		const float* Depth = nullptr;
+	};
+
+	// contents are undefined after a resize, fill GetInput again
+	void Resize(uint32_t width, uint32_t height);
+
+	// mean colour of each pixel in rgb and the variance of its mean luminance in a
+	glm::vec4* GetInput() { return buffers_[0].Data(); }
+
+	// filters the input in parallel tiles, passes of 0 leaves it as it is
+	void Denoise(ThreadPool& thread_pool, const Guides& guides, uint32_t passes);
+
+	// filtered colour in rgb after Denoise
+	const glm::vec4* GetOutput() const { return buffers_[output_].Data(); }
+private:
+	void FilterTile(uint32_t tile, uint32_t pass);
+private:
+	// the guides of one pixel together, so a tap 2^pass rows away touches one cache line for them
+	struct GuidePixel
+	{
+		glm::vec3 Normal;
+		float Depth;
+		glm::vec3 Albedo;
+
+		// largest depth difference to a neighbour, how fast depth changes around the pixel
+		float DepthGradient;
+	};
+
+	uint32_t width_ = 0, height_ = 0;
+	uint32_t tiles_x_ = 0, tiles_y_ = 0;
+
+	// ping pong buffers, each pass reads one and writes the other
+	AlignedBuffer<glm::vec4> buffers_[2];
+	uint32_t output_ = 0;
+
+	AlignedBuffer<GuidePixel> guides_;
+};
@@ -0,0 +1,525 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: Distributed.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/Distributed.cpp
+*/
+
+#include "Distributed.h"
+#include "Camera.h"
+#include "Network.h"
+#include "SceneFile.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+namespace utility
+{
+	enum class MessageType : uint32_t
+	{
+		// coordinator to worker: protocol version, RenderSetup and scene
+		Setup = 1,
+
+		// coordinator to worker: job index, first sample and sample count
+		Job,
+
+		// worker to coordinator: job index, padding, then the accumulation buffer
+		Result,
+
+		// coordinator to worker: nothing left to render
+		Done
+	};
+
+	struct MessageHeader
+	{
+		uint32_t Type;
+		uint32_t Reserved;
+		uint64_t Size;
+	};
+
+	// larger messages are treated as a broken connection rather than allocated
+	static constexpr uint64_t kMaxMessageSize = 1ull << 34;
+
+	// the accumulation buffer starts 8 bytes into a result, so 64 bit sums stay aligned
+	static constexpr size_t kResultHeaderSize = 8;
+
+	// appends values in memory layout
+	class MessageWriter
+	{
+	public:
+		explicit MessageWriter(std::vector<uint8_t>& data) : data_(data) {}
+
+		template<typename T>
+		void Write(const T& value)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "only plain values are written as bytes");
+			const uint8_t* bytes = (const uint8_t*)&value;
+			data_.insert(data_.end(), bytes, bytes + sizeof(T));
+		}
+
+		// element count followed by the elements
+		template<typename T>
+		void WriteArray(const std::vector<T>& values)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "only plain values are written as bytes");
+			Write((uint64_t)values.size());
+			const uint8_t* bytes = (const uint8_t*)values.data();
+			data_.insert(data_.end(), bytes, bytes + values.size() * sizeof(T));
+		}
+	private:
+		std::vector<uint8_t>& data_;
+	};
+
+	// reads what MessageWriter wrote, every read fails once the data runs out
+	class MessageReader
+	{
+	public:
+		MessageReader(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+		template<typename T>
+		bool Read(T& value)
+		{
+			if (size_ - offset_ < sizeof(T))
+				return false;
+
+			memcpy(&value, data_ + offset_, sizeof(T));
+			offset_ += sizeof(T);
+			return true;
+		}
+
+		template<typename T>
+		bool ReadArray(std::vector<T>& values)
+		{
+			uint64_t count;
+			if (!Read(count) || count > (size_ - offset_) / sizeof(T))
+				return false;
+
+			values.resize((size_t)count);
+			memcpy(values.data(), data_ + offset_, (size_t)count * sizeof(T));
+			offset_ += (size_t)count * sizeof(T);
+			return true;
+		}
+
+		size_t GetOffset() const { return offset_; }
+		size_t GetRemaining() const { return size_ - offset_; }
+	private:
+		const uint8_t* data_;
+		size_t size_;
+		size_t offset_ = 0;
+	};
+
+	static bool SendMessage(Socket& socket, MessageType type, const std::vector<uint8_t>& payload)
+	{
+		MessageHeader header{ (uint32_t)type, 0, payload.size() };
+		return socket.Send(&header, sizeof(header)) && socket.Send(payload.data(), payload.size());
+	}
+
+	static bool ReceiveMessage(Socket& socket, MessageType& type, std::vector<uint8_t>& payload)
+	{
+		MessageHeader header;
+		if (!socket.Receive(&header, sizeof(header)) || header.Size > kMaxMessageSize)
+			return false;
+
+		type = (MessageType)header.Type;
+		payload.resize((size_t)header.Size);
+		return socket.Receive(payload.data(), payload.size());
+	}
+
+	static void WriteSetup(const distributed::RenderSetup& setup, const Scene& scene, std::vector<uint8_t>& data)
+	{
+		MessageWriter writer(data);
+		writer.Write(distributed::kProtocolVersion);
+		writer.Write(setup.Width);
+		writer.Write(setup.Height);
+		writer.Write(setup.VerticalFOV);
+		writer.Write(setup.Position);
+		writer.Write(setup.Direction);
+		writer.Write((uint8_t)setup.NextEventEstimation);
+		writer.Write(setup.MaxDepth);
+		writer.Write((uint8_t)setup.RussianRoulette);
+		writer.Write(setup.RouletteDepth);
+		writer.Write((uint32_t)setup.Accumulation);
+		writer.Write(setup.Seed);
+		distributed::WriteScene(scene, data);
+	}
+
+	static bool ReadSetup(const std::vector<uint8_t>& data, distributed::RenderSetup& setup, Scene& scene, std::string* error)
+	{
+		MessageReader reader(data.data(), data.size());
+
+		uint32_t version = 0;
+		if (!reader.Read(version) || version != distributed::kProtocolVersion)
+		{
+			if (error)
+				*error = "the coordinator speaks protocol version " + std::to_string(version) +
+					", this worker " + std::to_string(distributed::kProtocolVersion);
+			return false;
+		}
+
+		uint8_t next_event_estimation = 0, russian_roulette = 0;
+		uint32_t accumulation = 0;
+		bool ok = reader.Read(setup.Width) && reader.Read(setup.Height) && reader.Read(setup.VerticalFOV) &&
+			reader.Read(setup.Position) && reader.Read(setup.Direction) && reader.Read(next_event_estimation) &&
+			reader.Read(setup.MaxDepth) && reader.Read(russian_roulette) && reader.Read(setup.RouletteDepth) &&
+			reader.Read(accumulation) && reader.Read(setup.Seed) && accumulation <= (uint32_t)AccumulationFormat::Fixed64;
+
+		// the scene takes the rest of the message
+		ok = ok && setup.Width > 0 && setup.Height > 0;
+		if (!ok || !distributed::ReadScene(data.data() + reader.GetOffset(), reader.GetRemaining(), scene))
+		{
+			if (error)
+				*error = "invalid setup from the coordinator";
+			return false;
+		}
+
+		setup.NextEventEstimation = next_event_estimation != 0;
+		setup.RussianRoulette = russian_roulette != 0;
+		setup.Accumulation = (AccumulationFormat)accumulation;
+		return true;
+	}
+
+	// one sample range of the image
+	struct Job
+	{
+		enum class State
+		{
+			Pending, Running, Done
+		};
+
+		uint32_t First = 0;
+		uint32_t Count = 0;
+		State Status = State::Pending;
+	};
+
+	// jobs and merged result shared by the connection threads, everything is guarded by Mutex
+	struct JobBoard
+	{
+		std::mutex Mutex;
+		std::condition_variable Changed;
+
+		std::vector<Job> Jobs;
+		uint32_t DoneCount = 0;
+
+		// samples per pixel merged into Accumulation so far
+		AccumulationBuffer* Accumulation = nullptr;
+		uint32_t MergedSamples = 0;
+
+		distributed::CoordinatorStats Stats;
+
+		bool IsDone() const { return DoneCount == (uint32_t)Jobs.size(); }
+
+		// waits for a pending job and marks it running, returns -1 once every job is done
+		int Take()
+		{
+			std::unique_lock<std::mutex> lock(Mutex);
+			for (;;)
+			{
+				if (IsDone())
+					return -1;
+
+				for (size_t i = 0; i < Jobs.size(); i++)
+				{
+					if (Jobs[i].Status == Job::State::Pending)
+					{
+						Jobs[i].Status = Job::State::Running;
+						return (int)i;
+					}
+				}
+
+				// every remaining job is running on another worker, which may still be lost
+				Changed.wait(lock);
+			}
+		}
+
+		void Complete(int job, const uint8_t* accumulation)
+		{
+			std::lock_guard<std::mutex> lock(Mutex);
+			Accumulation->Merge(accumulation, MergedSamples, Jobs[job].Count);
+			MergedSamples += Jobs[job].Count;
+			Jobs[job].Status = Job::State::Done;
+			DoneCount++;
+			Changed.notify_all();
+		}
+
+		// puts a lost worker's job back up for the others, job may be -1 if it had none
+		void Release(int job)
+		{
+			std::lock_guard<std::mutex> lock(Mutex);
+			Stats.LostWorkers++;
+			if (job >= 0)
+			{
+				Jobs[job].Status = Job::State::Pending;
+				Stats.ReassignedJobs++;
+			}
+			Changed.notify_all();
+		}
+	};
+
+	// runs on its own thread for as long as one worker stays connected
+	static void ServeWorker(Socket socket, JobBoard& board, const std::vector<uint8_t>& setup, uint32_t timeout)
+	{
+		socket.SetReceiveTimeout(timeout);
+		if (!SendMessage(socket, MessageType::Setup, setup))
+		{
+			board.Release(-1);
+			return;
+		}
+
+		std::vector<uint8_t> message;
+		for (;;)
+		{
+			int job = board.Take();
+			if (job < 0)
+			{
+				SendMessage(socket, MessageType::Done, {});
+				return;
+			}
+
+			// Jobs is not resized once the coordinator starts, so the entry can be read without the lock
+			message.clear();
+			MessageWriter writer(message);
+			writer.Write((uint32_t)job);
+			writer.Write(board.Jobs[job].First);
+			writer.Write(board.Jobs[job].Count);
+
+			MessageType type;
+			bool ok = SendMessage(socket, MessageType::Job, message) && ReceiveMessage(socket, type, message);
+
+			// a result for the wrong job or of the wrong size means the worker cannot be trusted either
+			uint32_t result_job = 0;
+			ok = ok && type == MessageType::Result && message.size() == kResultHeaderSize + board.Accumulation->GetSize() &&
+				MessageReader(message.data(), message.size()).Read(result_job) && result_job == (uint32_t)job;
+
+			if (!ok)
+			{
+				board.Release(job);
+				return;
+			}
+
+			board.Complete(job, message.data() + kResultHeaderSize);
+		}
+	}
+}
+
+namespace distributed
+{
+	bool RunCoordinator(const RenderSetup& setup, const Scene& scene, const CoordinatorOptions& options,
+		AccumulationBuffer& accumulation, CoordinatorStats* stats, std::string* error)
+	{
+		Socket listener;
+		if (!listener.Listen(options.Port, error))
+			return false;
+
+		utility::JobBoard board;
+		board.Accumulation = &accumulation;
+		accumulation.Resize(setup.Width * setup.Height, setup.Accumulation);
+
+		uint32_t job_samples = std::max(options.JobSamples, 1u);
+		for (uint32_t first = 0; first < options.Samples; first += job_samples)
+		{
+			utility::Job job;
+			job.First = first;
+			job.Count = std::min(job_samples, options.Samples - first);
+			board.Jobs.push_back(job);
+		}
+
+		// the same for every worker, so it is only serialised once
+		std::vector<uint8_t> setup_message;
+		utility::WriteSetup(setup, scene, setup_message);
+
+		// one thread per connection, new workers are let in until the last job is merged
+		std::vector<std::thread> connections;
+		for (;;)
+		{
+			{
+				std::lock_guard<std::mutex> lock(board.Mutex);
+				if (board.IsDone())
+					break;
+			}
+
+			Socket connection;
+			if (listener.Accept(connection, 100))
+			{
+				std::lock_guard<std::mutex> lock(board.Mutex);
+				board.Stats.Workers++;
+				connections.emplace_back(utility::ServeWorker, std::move(connection), std::ref(board), std::cref(setup_message), options.JobTimeout);
+			}
+		}
+		listener.Close();
+
+		for (std::thread& connection : connections)
+		{
+			connection.join();
+		}
+
+		if (stats)
+			*stats = board.Stats;
+		return true;
+	}
+
+	bool RunWorker(const std::string& address, const Renderer::Settings& settings, std::string* error)
+	{
+		Socket socket;
+		if (!socket.Connect(address, error))
+			return false;
+
+		utility::MessageType type;
+		std::vector<uint8_t> message;
+		if (!utility::ReceiveMessage(socket, type, message) || type != utility::MessageType::Setup)
+		{
+			if (error)
+				*error = "no setup from the coordinator";
+			return false;
+		}
+
+		RenderSetup setup;
+		Scene scene;
+		if (!utility::ReadSetup(message, setup, scene, error))
+			return false;
+
+		Camera camera(setup.VerticalFOV, 0.1f, 100.0f);
+		camera.OnResize(setup.Width, setup.Height);
+		camera.LookAt(setup.Position, setup.Direction);
+
+		Renderer renderer;
+		Renderer::Settings& render_settings = renderer.GetSettings();
+		render_settings = settings;
+		render_settings.NextEventEstimation = setup.NextEventEstimation;
+		render_settings.MaxDepth = setup.MaxDepth;
+		render_settings.RussianRoulette = setup.RussianRoulette;
+		render_settings.RouletteDepth = setup.RouletteDepth;
+		render_settings.Accumulation = setup.Accumulation;
+
+		// every pixel takes exactly the samples of its range, with the streams every other worker uses
+		render_settings.Accumulate = true;
+		render_settings.AdaptiveSampling = false;
+		render_settings.DeterministicSeed = true;
+		render_settings.Seed = setup.Seed;
+		render_settings.ResolveEveryFrame = false;
+		renderer.OnResize(setup.Width, setup.Height);
+
+		for (;;)
+		{
+			if (!utility::ReceiveMessage(socket, type, message))
+			{
+				if (error)
+					*error = "lost the connection to the coordinator";
+				return false;
+			}
+
+			if (type == utility::MessageType::Done)
+				return true;
+
+			uint32_t job = 0, first = 0, count = 0;
+			utility::MessageReader reader(message.data(), message.size());
+			if (type != utility::MessageType::Job || !reader.Read(job) || !reader.Read(first) || !reader.Read(count))
+			{
+				if (error)
+					*error = "invalid job from the coordinator";
+				return false;
+			}
+
+			render_settings.FirstSample = first;
+			renderer.ResetFrameIndex();
+			for (uint32_t i = 0; i < count; i++)
+			{
+				renderer.Render(scene, camera);
+			}
+
+			const AccumulationBuffer& accumulation = renderer.GetAccumulation();
+			message.resize(utility::kResultHeaderSize + accumulation.GetSize());
+			memset(message.data(), 0, utility::kResultHeaderSize);
+			memcpy(message.data(), &job, sizeof(job));
+			memcpy(message.data() + utility::kResultHeaderSize, accumulation.GetData(), accumulation.GetSize());
+
+			if (!utility::SendMessage(socket, utility::MessageType::Result, message))
+			{
+				if (error)
+					*error = "lost the connection to the coordinator";
+				return false;
+			}
+		}
+	}
+
+	void WriteScene(const Scene& scene, std::vector<uint8_t>& data)
+	{
+		utility::MessageWriter writer(data);
+		writer.WriteArray(scene.Spheres);
+		writer.WriteArray(scene.Materials);
+
+		writer.Write((uint64_t)scene.Meshes.size());
+		for (const Mesh& mesh : scene.Meshes)
+		{
+			writer.WriteArray(mesh.Vertices);
+			writer.WriteArray(mesh.Indices);
+			writer.Write(mesh.MaterialIndex);
+		}
+
+		writer.Write((uint64_t)scene.Prototypes.size());
+		for (const Prototype& prototype : scene.Prototypes)
+		{
+			writer.WriteArray(prototype.Spheres);
+
+			writer.Write((uint64_t)prototype.Meshes.size());
+			for (const Mesh& mesh : prototype.Meshes)
+			{
+				writer.WriteArray(mesh.Vertices);
+				writer.WriteArray(mesh.Indices);
+				writer.Write(mesh.MaterialIndex);
+			}
+		}
+
+		writer.WriteArray(scene.Instances);
+	}
+
+	bool ReadScene(const uint8_t* data, size_t size, Scene& scene)
+	{
+		utility::MessageReader reader(data, size);
+		scene = Scene();
+
+		auto read_meshes = [&reader](std::vector<Mesh>& meshes)
+		{
+			// every mesh takes at least its two counts and material, which bounds a corrupt count
+			uint64_t count = 0;
+			if (!reader.Read(count) || count > reader.GetRemaining() / (2 * sizeof(uint64_t) + sizeof(int)))
+				return false;
+
+			meshes.resize((size_t)count);
+			for (Mesh& mesh : meshes)
+			{
+				if (!reader.ReadArray(mesh.Vertices) || !reader.ReadArray(mesh.Indices) || !reader.Read(mesh.MaterialIndex))
+					return false;
+			}
+			return true;
+		};
+
+		if (!reader.ReadArray(scene.Spheres) || !reader.ReadArray(scene.Materials) || !read_meshes(scene.Meshes))
+			return false;
+
+		// likewise every prototype takes at least its two counts
+		uint64_t prototype_count = 0;
+		if (!reader.Read(prototype_count) || prototype_count > reader.GetRemaining() / (2 * sizeof(uint64_t)))
+			return false;
+
+		scene.Prototypes.resize((size_t)prototype_count);
+		for (Prototype& prototype : scene.Prototypes)
+		{
+			if (!reader.ReadArray(prototype.Spheres) || !read_meshes(prototype.Meshes))
+				return false;
+		}
+
+		if (!reader.ReadArray(scene.Instances))
+			return false;
+
+		// the renderer indexes with these without checking
+		return scene_file::Validate(scene);
+	}
+}
@@ -0,0 +1,92 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: Distributed.h
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/Distributed.h
+*/
+
+#pragma once
+
+#include "AccumulationBuffer.h"
+#include "Renderer.h"
+#include "Scene.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// one image rendered by several worker processes, possibly on other machines
+//
+// a coordinator splits the image's samples per pixel into ranges, each a job, and sends every worker
+// the scene and camera once, then one job at a time. a worker renders its range of samples over the
+// whole image and sends back the raw accumulation buffer, which the coordinator merges
+//
+// every worker uses the same seed and numbers its samples from the start of its range, so the merged
+// image has exactly the samples a single renderer would have taken. with fixed64 accumulation the
+// sums are integers and the result is byte for byte the single process image
+namespace distributed
+{
+	static constexpr uint32_t kProtocolVersion = 1;
+
+	// everything a worker needs besides the scene
+	struct RenderSetup
+	{
+		uint32_t Width = 0, Height = 0;
+
+		float VerticalFOV = 45.0f;
+		glm::vec3 Position{ 0.0f, 0.0f, 6.0f };
+		glm::vec3 Direction{ 0.0f, 0.0f, -1.0f };
+
+		// the settings that change the image, the rest are up to each worker
+		bool NextEventEstimation = false;
+		uint32_t MaxDepth = 5;
+		bool RussianRoulette = false;
+		uint32_t RouletteDepth = 3;
+		AccumulationFormat Accumulation = AccumulationFormat::RGB32F;
+		uint32_t Seed = 0;
+	};
+
+	struct CoordinatorOptions
+	{
+		uint16_t Port = 7878;
+
+		// samples per pixel of the whole image, and of one job
+		uint32_t Samples = 64;
+		uint32_t JobSamples = 4;
+
+		// seconds a worker has to return a job before it counts as lost and the job goes to another worker,
+		// the first job also covers loading the scene, 0 waits forever
+		uint32_t JobTimeout = 120;
+	};
+
+	struct CoordinatorStats
+	{
+		uint32_t Workers = 0;
+
+		// workers that disconnected, timed out or sent something invalid, and the jobs they did not finish
+		uint32_t LostWorkers = 0;
+		uint32_t ReassignedJobs = 0;
+	};
+
+	// listens for workers and hands out jobs until every sample of the image is rendered, workers can join at any time
+	// accumulation receives the merged samples, every pixel holds options.Samples of them
+	// returns false with a reason in error if the port cannot be opened
+	bool RunCoordinator(const RenderSetup& setup, const Scene& scene, const CoordinatorOptions& options,
+		AccumulationBuffer& accumulation, CoordinatorStats* stats = nullptr, std::string* error = nullptr);
+
+	// connects to a coordinator at host:port and renders its jobs until it has none left
+	// settings picks the threads, tile size and kernels, the image settings come from the coordinator
+	// returns false with a reason in error if the connection fails or breaks
+	bool RunWorker(const std::string& address, const Renderer::Settings& settings, std::string* error = nullptr);
+
+	// the whole scene including meshes, prototypes and instances, in memory layout, without edit versions
+	// ReadScene returns false if the data is truncated or an index in it names something that does not exist
+	void WriteScene(const Scene& scene, std::vector<uint8_t>& data);
+	bool ReadScene(const uint8_t* data, size_t size, Scene& scene);
+}
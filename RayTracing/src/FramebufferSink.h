@@ -0,0 +1,29 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: FramebufferSink.h
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/FramebufferSink.h
+*/
+
+#pragma once
+
+#include <cstdint>
+
+// receives the final RGBA8 image from the renderer
+// e.g., a Vulkan texture in the Walnut app or an image file in the headless app
+class FramebufferSink
+{
+public:
+	virtual ~FramebufferSink() = default;
+
+	// called when the renderer's output resolution changes
+	virtual void OnResize(uint32_t /*width*/, uint32_t /*height*/) {}
+
+	// called with the image data of a completed frame
+	// data is width * height pixels packed as 0xAABBGGRR
+	virtual void SetData(const uint32_t* data, uint32_t width, uint32_t height) = 0;
+};
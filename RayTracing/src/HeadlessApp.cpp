@@ -0,0 +1,632 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: HeadlessApp.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/HeadlessApp.cpp
+
+	Notes: Offline renderer without Walnut/Vulkan, renders N accumulated frames and writes the image to disk.
+*/
+
+#include "Walnut/Timer.h"
+
+#include "Camera.h"
+#include "Checkpoint.h"
+#include "Distributed.h"
+#include "ImageFileSink.h"
+#include "Profiler.h"
+#include "Renderer.h"
+#include "SceneFile.h"
+#include "Scenes.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+
+namespace utility
+{
+	static void PrintUsage(const char* program)
+	{
+		printf("usage: %s [options]\n", program);
+		printf("  --width <n>              image width (default 1280)\n");
+		printf("  --height <n>             image height (default 720)\n");
+		printf("  --frames <n>             number of accumulated frames (default 64)\n");
+		printf("                           with --noise-target, the most frames to render\n");
+		printf("  --noise-target <e>       adaptive sampling, stop once every pixel's relative error is below e\n");
+		printf("  --output <file>          .ppm or .png output (default render.png)\n");
+		printf("  --scene <file>           .rtscene or text scene to render instead of the default scene\n");
+		printf("  --save-scene <file>      write the scene with a prebuilt BVH to a .rtscene file and exit\n");
+		printf("  --fov <degrees>          vertical field of view (default 45)\n");
+		printf("  --position <x,y,z>       camera position (default 0,0,6)\n");
+		printf("  --direction <x,y,z>      camera forward direction (default 0,0,-1)\n");
+		printf("  --no-simd                use the scalar intersection kernel\n");
+		printf("  --wavefront              trace one bounce of every path in a tile at a time\n");
+		printf("  --sort-rays              with --wavefront, group each bounce's rays by direction\n");
+		printf("  --nee                    sample emissive spheres directly at every bounce\n");
+		printf("  --max-depth <n>          most rays per path, including the primary ray (default 5)\n");
+		printf("  --roulette               with --nee, end dark paths early with Russian roulette\n");
+		printf("  --accumulation <format>  rgb32f, rgb16f or fixed64 accumulation storage (default rgb32f)\n");
+		printf("  --tonemap <curve>        clamp, reinhard or aces (default clamp)\n");
+		printf("  --exposure <stops>       brightness scale of 2^stops before the tone curve (default 0)\n");
+		printf("  --srgb                   encode the output with the sRGB transfer function\n");
+		printf("  --denoise                filter the output with the a-trous denoiser, guided by the first hits\n");
+		printf("  --denoise-passes <n>     passes of the denoiser, each reaching twice as far (default 5)\n");
+		printf("  --aovs                   also write the first hit albedo, normal and depth next to the output,\n");
+		printf("                           as <output>_albedo, <output>_normal and <output>_depth\n");
+		printf("  --cache-rays             precompute every primary ray direction up front\n");
+		printf("  --threads <n>            render threads, 0 uses every hardware thread (default 0)\n");
+		printf("  --tile-size <n>          tile width and height in pixels (default 16)\n");
+		printf("  --seed <n>               fixed random seed, identical images across runs\n");
+		printf("  --checkpoint <file>      save the render in progress to this file while rendering and once it is done\n");
+		printf("  --checkpoint-interval <seconds>  time between checkpoints (default 60)\n");
+		printf("  --resume <file>          continue the render saved in a checkpoint, --frames counts the frames already in it\n");
+		printf("                           the size, camera and image options come from the checkpoint\n");
+		printf("  --trace <file>           write a chrome://tracing timeline and print time per stage, needs RT_PROFILE\n");
+		printf("  --coordinator <port>     render with the worker processes that connect to this port\n");
+		printf("  --job-frames <n>         with --coordinator, frames per job handed to a worker (default 4)\n");
+		printf("  --job-timeout <seconds>  with --coordinator, time a worker has for a job before it is given to another (default 120)\n");
+		printf("  --worker <host:port>     render jobs for a coordinator, the scene, camera and image options come from it\n");
+	}
+
+	static bool ParseVec3(const char* text, glm::vec3& result)
+	{
+		return sscanf(text, "%f,%f,%f", &result.x, &result.y, &result.z) == 3;
+	}
+
+	// render.png becomes render_albedo.png
+	static std::string GetAOVPath(const std::string& output, const char* name)
+	{
+		size_t dot = output.rfind('.');
+		size_t slash = output.find_last_of("/\\");
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+			return output + "_" + name;
+		return output.substr(0, dot) + "_" + name + output.substr(dot);
+	}
+
+	// albedo as it is, normals mapped from [-1, 1] and depth from near white to black at the farthest hit
+	static bool WriteAOVs(const Renderer& renderer, const std::string& output)
+	{
+		uint32_t width = renderer.GetWidth(), height = renderer.GetHeight();
+		size_t pixels = (size_t)width * height;
+		const glm::vec3* albedo = renderer.GetAlbedo();
+		const glm::vec3* normals = renderer.GetNormals();
+		const float* depth = renderer.GetDepth();
+		if (!albedo)
+			return false;
+
+		float max_depth = 0.0f;
+		for (size_t i = 0; i < pixels; i++)
+			max_depth = std::max(max_depth, depth[i]);
+
+		ToneMapping linear;
+		std::vector<uint32_t> image(pixels);
+		auto write = [&](const char* name, auto&& color)
+			{
+				for (size_t i = 0; i < pixels; i++)
+					image[i] = AccumulationBuffer::ToRGBA(color(i), linear);
+
+				std::string path = GetAOVPath(output, name);
+				ImageFileSink sink(path);
+				sink.SetData(image.data(), width, height);
+				if (!sink.Good())
+					return false;
+
+				printf("wrote %s\n", path.c_str());
+				return true;
+			};
+
+		return write("albedo", [&](size_t i) { return albedo[i]; }) &&
+			write("normal", [&](size_t i) { return depth[i] < 0.0f ? glm::vec3(0.0f) : normals[i] * 0.5f + 0.5f; }) &&
+			write("depth", [&](size_t i) { return glm::vec3(depth[i] < 0.0f ? 0.0f : 1.0f - 0.9f * depth[i] / std::max(max_depth, 1e-6f)); });
+	}
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t width = 1280, height = 720, frames = 64;
+	float fov = 45.0f;
+	std::string output = "render.png";
+	std::string scene_path, save_scene_path;
+	glm::vec3 position{ 0.0f, 0.0f, 6.0f };
+	glm::vec3 direction{ 0.0f, 0.0f, -1.0f };
+	bool simd = true, cache_rays = false, wavefront = false, sort_rays = false, next_event_estimation = false;
+	bool russian_roulette = false, denoise = false, aovs = false;
+	uint32_t denoise_passes = 5;
+	uint32_t threads = 0, tile_size = 16, max_depth = 5;
+	bool deterministic = false;
+	uint32_t seed = 0;
+	float noise_target = 0.0f;
+	AccumulationFormat accumulation = AccumulationFormat::RGB32F;
+	ToneMapping tone_mapping;
+	std::string worker_address, trace_path;
+	std::string checkpoint_path, resume_path;
+	float checkpoint_interval = 60.0f;
+	uint32_t coordinator_port = 0, job_frames = 4, job_timeout = 120;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+		{
+			utility::PrintUsage(argv[0]);
+			return 0;
+		}
+
+		if (strcmp(arg, "--no-simd") == 0)
+		{
+			simd = false;
+			continue;
+		}
+
+		if (strcmp(arg, "--cache-rays") == 0)
+		{
+			cache_rays = true;
+			continue;
+		}
+
+		if (strcmp(arg, "--wavefront") == 0)
+		{
+			wavefront = true;
+			continue;
+		}
+
+		if (strcmp(arg, "--sort-rays") == 0)
+		{
+			sort_rays = true;
+			continue;
+		}
+
+		if (strcmp(arg, "--nee") == 0)
+		{
+			next_event_estimation = true;
+			continue;
+		}
+
+		if (strcmp(arg, "--srgb") == 0)
+		{
+			tone_mapping.SRGB = true;
+			continue;
+		}
+
+		if (strcmp(arg, "--roulette") == 0)
+		{
+			russian_roulette = true;
+			continue;
+		}
+
+		if (strcmp(arg, "--denoise") == 0)
+		{
+			denoise = true;
+			continue;
+		}
+
+		if (strcmp(arg, "--aovs") == 0)
+		{
+			aovs = true;
+			continue;
+		}
+
+		// every other option takes a value
+		if (!value)
+		{
+			fprintf(stderr, "missing value for %s\n", arg);
+			return 1;
+		}
+
+		bool ok = true;
+		if (strcmp(arg, "--width") == 0)
+			width = (uint32_t)atoi(value);
+		else if (strcmp(arg, "--height") == 0)
+			height = (uint32_t)atoi(value);
+		else if (strcmp(arg, "--frames") == 0)
+			frames = (uint32_t)atoi(value);
+		else if (strcmp(arg, "--output") == 0)
+			output = value;
+		else if (strcmp(arg, "--scene") == 0)
+			scene_path = value;
+		else if (strcmp(arg, "--save-scene") == 0)
+			save_scene_path = value;
+		else if (strcmp(arg, "--threads") == 0)
+			threads = (uint32_t)atoi(value);
+		else if (strcmp(arg, "--max-depth") == 0)
+			max_depth = (uint32_t)atoi(value);
+		else if (strcmp(arg, "--accumulation") == 0)
+			ok = ParseAccumulationFormat(value, accumulation);
+		else if (strcmp(arg, "--tonemap") == 0)
+			ok = ParseTonemapper(value, tone_mapping.Operator);
+		else if (strcmp(arg, "--exposure") == 0)
+			tone_mapping.Exposure = (float)atof(value);
+		else if (strcmp(arg, "--denoise-passes") == 0)
+			denoise_passes = (uint32_t)atoi(value);
+		else if (strcmp(arg, "--tile-size") == 0)
+			tile_size = (uint32_t)atoi(value);
+		else if (strcmp(arg, "--noise-target") == 0)
+			ok = (noise_target = (float)atof(value)) > 0.0f;
+		else if (strcmp(arg, "--seed") == 0)
+		{
+			deterministic = true;
+			seed = (uint32_t)strtoul(value, nullptr, 10);
+		}
+		else if (strcmp(arg, "--coordinator") == 0)
+			ok = (coordinator_port = (uint32_t)atoi(value)) > 0 && coordinator_port < 65536;
+		else if (strcmp(arg, "--job-frames") == 0)
+			ok = (job_frames = (uint32_t)atoi(value)) > 0;
+		else if (strcmp(arg, "--job-timeout") == 0)
+			job_timeout = (uint32_t)atoi(value);
+		else if (strcmp(arg, "--worker") == 0)
+			worker_address = value;
+		else if (strcmp(arg, "--trace") == 0)
+			trace_path = value;
+		else if (strcmp(arg, "--checkpoint") == 0)
+			checkpoint_path = value;
+		else if (strcmp(arg, "--checkpoint-interval") == 0)
+			ok = (checkpoint_interval = (float)atof(value)) > 0.0f;
+		else if (strcmp(arg, "--resume") == 0)
+			resume_path = value;
+		else if (strcmp(arg, "--fov") == 0)
+			fov = (float)atof(value);
+		else if (strcmp(arg, "--position") == 0)
+			ok = utility::ParseVec3(value, position);
+		else if (strcmp(arg, "--direction") == 0)
+			ok = utility::ParseVec3(value, direction);
+		else
+			ok = false;
+
+		if (!ok)
+		{
+			fprintf(stderr, "invalid option %s %s\n", arg, value);
+			utility::PrintUsage(argv[0]);
+			return 1;
+		}
+		i++;
+	}
+
+	if (width == 0 || height == 0 || frames == 0 || tile_size == 0 || max_depth == 0)
+	{
+		fprintf(stderr, "width, height, frames, tile size and max depth must be greater than 0\n");
+		return 1;
+	}
+
+	// a worker only chooses how it renders, everything that changes the image comes from the coordinator
+	if (!worker_address.empty())
+	{
+		Renderer::Settings settings;
+		settings.SIMD = simd;
+		settings.Wavefront = wavefront;
+		settings.SortRays = sort_rays;
+		settings.ThreadCount = threads;
+		settings.TileSize = tile_size;
+
+		std::string error;
+		if (!distributed::RunWorker(worker_address, settings, &error))
+		{
+			fprintf(stderr, "worker: %s\n", error.c_str());
+			return 1;
+		}
+		return 0;
+	}
+
+#ifndef RT_PROFILE
+	if (!trace_path.empty())
+	{
+		fprintf(stderr, "--trace needs a build with RT_PROFILE defined, e.g. premake5 --profile gmake2\n");
+		return 1;
+	}
+#endif
+
+	if (coordinator_port > 0 && noise_target > 0.0f)
+	{
+		fprintf(stderr, "--noise-target cannot be used with --coordinator, every job renders a fixed number of frames\n");
+		return 1;
+	}
+
+	if (coordinator_port > 0 && (!checkpoint_path.empty() || !resume_path.empty()))
+	{
+		fprintf(stderr, "--checkpoint and --resume cannot be used with --coordinator\n");
+		return 1;
+	}
+
+	if (coordinator_port > 0 && (denoise || aovs))
+	{
+		fprintf(stderr, "--denoise and --aovs cannot be used with --coordinator, workers only send back samples\n");
+		return 1;
+	}
+
+	// everything that changes the image comes from the checkpoint
+	checkpoint::Checkpoint resumed;
+	if (!resume_path.empty())
+	{
+		std::string error;
+		if (!checkpoint::Read(resume_path, resumed, &error))
+		{
+			fprintf(stderr, "could not resume from %s: %s\n", resume_path.c_str(), error.c_str());
+			return 1;
+		}
+
+		width = resumed.State.Width;
+		height = resumed.State.Height;
+		fov = resumed.VerticalFOV;
+		position = resumed.Position;
+		direction = resumed.Direction;
+		noise_target = resumed.State.AdaptiveSampling ? resumed.State.NoiseThreshold : 0.0f;
+	}
+
+	Scene scene;
+	BVH bvh;
+	if (scene_path.empty())
+	{
+		scene = scenes::Default();
+	}
+	else
+	{
+		Walnut::Timer load_timer;
+		std::string error;
+		if (!scene_file::Load(scene_path, scene, &bvh, &error))
+		{
+			fprintf(stderr, "could not load %s: %s\n", scene_path.c_str(), error.c_str());
+			return 1;
+		}
+		printf("loaded %s: %zu spheres%s in %.2fms\n", scene_path.c_str(), scene.Spheres.size(),
+			bvh.Empty() ? "" : " with BVH", load_timer.ElapsedMillis());
+	}
+
+	// converts the scene, storing the BVH so loading it skips the build
+	if (!save_scene_path.empty())
+	{
+		if (bvh.Empty())
+		{
+			scene_file::BuildBVH(scene, bvh);
+		}
+
+		if (!scene_file::Write(save_scene_path, scene, &bvh))
+		{
+			fprintf(stderr, "could not write %s%s\n", save_scene_path.c_str(),
+				scene.Meshes.empty() && scene.Instances.empty() ? "" : ", .rtscene files do not store meshes or instances");
+			return 1;
+		}
+		printf("wrote %s\n", save_scene_path.c_str());
+		return 0;
+	}
+
+	if (coordinator_port > 0)
+	{
+		// workers only share random streams if they share the seed
+		distributed::RenderSetup setup;
+		setup.Width = width;
+		setup.Height = height;
+		setup.VerticalFOV = fov;
+		setup.Position = position;
+		setup.Direction = direction;
+		setup.NextEventEstimation = next_event_estimation;
+		setup.MaxDepth = max_depth;
+		setup.RussianRoulette = russian_roulette;
+		setup.Accumulation = accumulation;
+		setup.Seed = deterministic ? seed : std::random_device{}();
+
+		distributed::CoordinatorOptions options;
+		options.Port = (uint16_t)coordinator_port;
+		options.Samples = frames;
+		options.JobSamples = job_frames;
+		options.JobTimeout = job_timeout;
+
+		printf("waiting for workers on port %u\n", coordinator_port);
+
+		Walnut::Timer timer;
+		AccumulationBuffer merged;
+		distributed::CoordinatorStats stats;
+		std::string error;
+		if (!distributed::RunCoordinator(setup, scene, options, merged, &stats, &error))
+		{
+			fprintf(stderr, "coordinator: %s\n", error.c_str());
+			return 1;
+		}
+		float elapsed = timer.ElapsedMillis();
+
+		printf("rendered %ux%u, %u frames in %.2fms with %u workers, %u lost and %u jobs handed on\n",
+			width, height, frames, elapsed, stats.Workers, stats.LostWorkers, stats.ReassignedJobs);
+
+		std::vector<uint32_t> sample_counts((size_t)width * height, frames);
+		std::vector<uint32_t> image((size_t)width * height);
+		merged.Resolve(0, width * height, sample_counts.data(), image.data(), tone_mapping);
+
+		ImageFileSink sink(output);
+		sink.SetData(image.data(), width, height);
+		if (!sink.Good())
+		{
+			fprintf(stderr, "failed to write %s\n", output.c_str());
+			return 1;
+		}
+
+		printf("wrote %s\n", output.c_str());
+		return 0;
+	}
+
+	Camera camera(fov, 0.1f, 100.0f);
+	camera.SetCacheRayDirections(cache_rays);
+	camera.OnResize(width, height);
+	camera.LookAt(position, direction);
+
+	Renderer renderer;
+	renderer.GetSettings().SIMD = simd;
+	renderer.GetSettings().Wavefront = wavefront;
+	renderer.GetSettings().SortRays = sort_rays;
+	renderer.GetSettings().NextEventEstimation = next_event_estimation;
+	renderer.GetSettings().MaxDepth = max_depth;
+	renderer.GetSettings().RussianRoulette = russian_roulette;
+	renderer.GetSettings().Accumulation = accumulation;
+	renderer.GetSettings().Display = tone_mapping;
+	renderer.GetSettings().AOVs = aovs;
+	renderer.GetSettings().Denoise = denoise;
+	renderer.GetSettings().DenoisePasses = denoise_passes;
+
+	// only the last frame is written out
+	renderer.GetSettings().ResolveEveryFrame = false;
+	renderer.GetSettings().ThreadCount = threads;
+	renderer.GetSettings().TileSize = tile_size;
+	renderer.GetSettings().DeterministicSeed = deterministic;
+	renderer.GetSettings().Seed = seed;
+	renderer.GetSettings().AdaptiveSampling = noise_target > 0.0f;
+	renderer.GetSettings().NoiseThreshold = noise_target;
+	renderer.SetAccelerationStructure(scene, std::move(bvh));
+	renderer.OnResize(width, height);
+
+	// the scene is hashed once, every checkpoint of this render is of the same scene
+	uint64_t scene_hash = checkpoint_path.empty() && resume_path.empty() ? 0 : checkpoint::HashScene(scene);
+
+	uint32_t frame = 0;
+	if (!resume_path.empty())
+	{
+		if (resumed.SceneHash != scene_hash)
+		{
+			fprintf(stderr, "%s is a render of another scene\n", resume_path.c_str());
+			return 1;
+		}
+
+		std::string error;
+		if (!renderer.SetAccumulationState(resumed.State, &error))
+		{
+			fprintf(stderr, "could not resume from %s: %s\n", resume_path.c_str(), error.c_str());
+			return 1;
+		}
+
+		frame = resumed.State.FrameIndex - 1;
+		printf("resumed %s at frame %u\n", resume_path.c_str(), frame);
+
+		// the accumulation is the renderer's now
+		resumed = checkpoint::Checkpoint();
+	}
+
+	// snapshots are copied out between frames and written while the next frames render
+	std::unique_ptr<checkpoint::Writer> checkpoint_writer;
+	checkpoint::Checkpoint snapshot;
+	if (!checkpoint_path.empty())
+	{
+		checkpoint_writer = std::make_unique<checkpoint::Writer>(checkpoint_path);
+	}
+
+	auto save_checkpoint = [&]()
+		{
+			// the writer hands back an older snapshot, only its allocations are reused
+			snapshot.VerticalFOV = fov;
+			snapshot.Position = position;
+			snapshot.Direction = direction;
+			snapshot.SceneHash = scene_hash;
+			if (renderer.GetAccumulationState(snapshot.State))
+				checkpoint_writer->Submit(snapshot);
+		};
+
+	RT_PROFILE_THREAD("main");
+	if (!trace_path.empty())
+	{
+		profiler::BeginCapture();
+	}
+
+	Walnut::Timer timer, checkpoint_timer;
+	uint32_t first_frame = frame;
+	while (frame < frames && !(noise_target > 0.0f && renderer.IsConverged()))
+	{
+		renderer.Render(scene, camera);
+		frame++;
+
+		if (checkpoint_writer && checkpoint_timer.Elapsed() >= checkpoint_interval)
+		{
+			checkpoint_timer.Reset();
+			save_checkpoint();
+		}
+	}
+
+	// frames rendered by this run, for the timings
+	frames = frame - first_frame;
+	renderer.Resolve();
+	float elapsed = timer.ElapsedMillis();
+
+	// the final state, so the render can be continued with more frames
+	if (checkpoint_writer)
+	{
+		save_checkpoint();
+
+		std::string error;
+		if (!checkpoint_writer->Flush(&error))
+		{
+			fprintf(stderr, "failed to write %s: %s\n", checkpoint_path.c_str(), error.c_str());
+			return 1;
+		}
+		printf("wrote %u checkpoints to %s\n", checkpoint_writer->GetWrittenCount(), checkpoint_path.c_str());
+	}
+
+	if (noise_target > 0.0f)
+	{
+		printf("converged pixels: %.1f%%\n", renderer.GetConvergedRatio() * 100.0f);
+	}
+
+	printf("intersection kernel: %s\n", kernels::GetISAName(simd ? kernels::GetBestISA() : kernels::ISA::Scalar));
+	printf("rendered %ux%u, %u frames in %.2fms (%.2fms/frame)\n", width, height, frames, elapsed, elapsed / std::max(frames, 1u));
+
+	// adaptive sampling spends a different number of samples on each frame
+	if (noise_target <= 0.0f)
+	{
+		double samples = (double)width * height * frames;
+		printf("%.2f Msamples/s\n", samples / (elapsed * 1000.0));
+	}
+
+	// per-tile timings of the last frame show how evenly the work was spread
+	const std::vector<float>& tile_times = renderer.GetTileTimes();
+	float total = 0.0f, slowest = 0.0f;
+	for (float time : tile_times)
+	{
+		total += time;
+		slowest = std::max(slowest, time);
+	}
+	printf("%u threads, %zu tiles, avg %.3fms, max %.3fms per tile\n",
+		renderer.GetThreadCount(), tile_times.size(), total / tile_times.size(), slowest);
+
+	if (!trace_path.empty())
+	{
+		if (!profiler::EndCapture(trace_path))
+		{
+			fprintf(stderr, "failed to write %s\n", trace_path.c_str());
+			return 1;
+		}
+
+		// CPU time summed over the render threads, a stage includes the stages it calls
+		profiler::ThreadStats stats = profiler::Sum(profiler::GetStats());
+		for (uint32_t stage = 0; stage < (uint32_t)profiler::Stage::Count; stage++)
+		{
+			if (stats.StageCalls[stage] > 0)
+				printf("  %-10s %10.2fms %12llu calls\n", profiler::GetStageName((profiler::Stage)stage),
+					stats.StageNanoseconds[stage] / 1e6, (unsigned long long)stats.StageCalls[stage]);
+		}
+		for (uint32_t depth = 0; depth < profiler::kMaxDepth; depth++)
+		{
+			if (stats.RaysAtDepth[depth] > 0)
+				printf("  rays at depth %u: %llu\n", depth, (unsigned long long)stats.RaysAtDepth[depth]);
+		}
+		printf("wrote %s\n", trace_path.c_str());
+	}
+
+	ImageFileSink sink(output);
+	sink.SetData(renderer.GetImageData(), width, height);
+	if (!sink.Good())
+	{
+		fprintf(stderr, "failed to write %s\n", output.c_str());
+		return 1;
+	}
+
+	printf("wrote %s\n", output.c_str());
+
+	if (aovs && !utility::WriteAOVs(renderer, output))
+	{
+		fprintf(stderr, "failed to write the AOVs of %s\n", output.c_str());
+		return 1;
+	}
+	return 0;
+}
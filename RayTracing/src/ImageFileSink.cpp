@@ -0,0 +1,174 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: ImageFileSink.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/ImageFileSink.cpp
+*/
+
+#include "ImageFileSink.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <vector>
+
+namespace utility
+{
+	static bool HasExtension(const std::string& path, const std::string& extension)
+	{
+		if (path.size() < extension.size())
+			return false;
+
+		std::string tail = path.substr(path.size() - extension.size());
+		std::transform(tail.begin(), tail.end(), tail.begin(), [](char c) { return (char)std::tolower(c); });
+		return tail == extension;
+	}
+
+	// pixels are packed as 0xAABBGGRR, see Renderer.cpp
+	static void UnpackRGB(uint32_t pixel, uint8_t* rgb)
+	{
+		rgb[0] = (uint8_t)(pixel & 0xff);
+		rgb[1] = (uint8_t)((pixel >> 8) & 0xff);
+		rgb[2] = (uint8_t)((pixel >> 16) & 0xff);
+	}
+
+	static uint32_t CRC32(const uint8_t* data, size_t size, uint32_t crc = 0)
+	{
+		static uint32_t table[256] = {};
+		if (table[1] == 0)
+		{
+			for (uint32_t n = 0; n < 256; n++)
+			{
+				uint32_t c = n;
+				for (int k = 0; k < 8; k++)
+					c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				table[n] = c;
+			}
+		}
+
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++)
+			crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	static void PushBigEndian(std::vector<uint8_t>& out, uint32_t value)
+	{
+		out.push_back((uint8_t)(value >> 24));
+		out.push_back((uint8_t)(value >> 16));
+		out.push_back((uint8_t)(value >> 8));
+		out.push_back((uint8_t)value);
+	}
+
+	static void WriteChunk(std::ofstream& file, const char* type, const std::vector<uint8_t>& payload)
+	{
+		std::vector<uint8_t> chunk;
+		chunk.reserve(payload.size() + 12);
+		PushBigEndian(chunk, (uint32_t)payload.size());
+		chunk.insert(chunk.end(), type, type + 4);
+		chunk.insert(chunk.end(), payload.begin(), payload.end());
+
+		// crc covers the type and the payload, not the length
+		PushBigEndian(chunk, CRC32(chunk.data() + 4, chunk.size() - 4));
+		file.write((const char*)chunk.data(), chunk.size());
+	}
+}
+
+void ImageFileSink::SetData(const uint32_t* data, uint32_t width, uint32_t height)
+{
+	if (utility::HasExtension(path_, ".png"))
+		good_ = image_file::WritePNG(path_, data, width, height);
+	else if (utility::HasExtension(path_, ".ppm"))
+		good_ = image_file::WritePPM(path_, data, width, height);
+	else
+		good_ = false;
+}
+
+bool image_file::WritePPM(const std::string& path, const uint32_t* data, uint32_t width, uint32_t height)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	file << "P6\n" << width << " " << height << "\n255\n";
+
+	// the renderer stores rows bottom to top, image files go top to bottom
+	std::vector<uint8_t> row(width * 3);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		const uint32_t* src = data + (height - 1 - y) * width;
+		for (uint32_t x = 0; x < width; x++)
+			utility::UnpackRGB(src[x], &row[x * 3]);
+
+		file.write((const char*)row.data(), row.size());
+	}
+
+	return (bool)file;
+}
+
+bool image_file::WritePNG(const std::string& path, const uint32_t* data, uint32_t width, uint32_t height)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	file.write((const char*)signature, sizeof(signature));
+
+	// 8 bit RGB, no interlacing
+	std::vector<uint8_t> header;
+	utility::PushBigEndian(header, width);
+	utility::PushBigEndian(header, height);
+	header.insert(header.end(), { 8, 2, 0, 0, 0 });
+	utility::WriteChunk(file, "IHDR", header);
+
+	// scanlines with filter type 0, top to bottom
+	std::vector<uint8_t> raw((size_t)(width * 3 + 1) * height);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		uint8_t* dst = &raw[(size_t)(width * 3 + 1) * y];
+		const uint32_t* src = data + (height - 1 - y) * width;
+		*dst++ = 0;
+		for (uint32_t x = 0; x < width; x++)
+			utility::UnpackRGB(src[x], dst + x * 3);
+	}
+
+	// zlib stream made of uncompressed deflate blocks, so no compression library is needed
+	std::vector<uint8_t> zlib;
+	zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+	zlib.push_back(0x78);
+	zlib.push_back(0x01);
+
+	size_t offset = 0;
+	do
+	{
+		size_t block = std::min<size_t>(raw.size() - offset, 65535);
+		bool last = offset + block == raw.size();
+
+		zlib.push_back(last ? 1 : 0);
+		zlib.push_back((uint8_t)(block & 0xff));
+		zlib.push_back((uint8_t)(block >> 8));
+		zlib.push_back((uint8_t)(~block & 0xff));
+		zlib.push_back((uint8_t)((~block >> 8) & 0xff));
+		zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + block);
+
+		offset += block;
+	} while (offset < raw.size());
+
+	uint32_t a = 1, b = 0;
+	for (uint8_t byte : raw)
+	{
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+	utility::PushBigEndian(zlib, (b << 16) | a);
+
+	utility::WriteChunk(file, "IDAT", zlib);
+	utility::WriteChunk(file, "IEND", {});
+
+	return (bool)file;
+}
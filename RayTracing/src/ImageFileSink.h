@@ -0,0 +1,42 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: ImageFileSink.h
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/ImageFileSink.h
+*/
+
+#pragma once
+
+#include "FramebufferSink.h"
+
+#include <string>
+
+// writes every frame it receives to an image file
+// the format is picked from the file extension: .ppm (binary P6) or .png
+class ImageFileSink : public FramebufferSink
+{
+public:
+	ImageFileSink(const std::string& path)
+		: path_(path) {}
+
+	void SetData(const uint32_t* data, uint32_t width, uint32_t height) override;
+
+	// true if the last write succeeded
+	bool Good() const { return good_; }
+
+	const std::string& GetPath() const { return path_; }
+private:
+	std::string path_;
+	bool good_ = false;
+};
+
+namespace image_file
+{
+	// returns false if the file could not be written or the extension is unknown
+	bool WritePPM(const std::string& path, const uint32_t* data, uint32_t width, uint32_t height);
+	bool WritePNG(const std::string& path, const uint32_t* data, uint32_t width, uint32_t height);
+}
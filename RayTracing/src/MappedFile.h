@@ -0,0 +1,43 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: MappedFile.h
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/MappedFile.h
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// read-only memory map of a whole file, unmapped on destruction
+// pages are only read from disk when they are first touched
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile() { Close(); }
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// returns false if the file could not be opened or mapped
+	bool Open(const std::string& path);
+	void Close();
+
+	const uint8_t* GetData() const { return data_; }
+	size_t GetSize() const { return size_; }
+private:
+	const uint8_t* data_ = nullptr;
+	size_t size_ = 0;
+
+#if defined(_WIN32)
+	void* file_ = nullptr;
+	void* mapping_ = nullptr;
+#endif
+};
@@ -0,0 +1,397 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: MeshFile.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/MeshFile.cpp
+*/
+
+#include "MeshFile.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+namespace utility
+{
+	static bool Fail(std::string* error, const std::string& message)
+	{
+		if (error)
+			*error = message;
+		return false;
+	}
+
+	static bool HasExtension(const std::string& path, const char* extension)
+	{
+		size_t length = strlen(extension);
+		if (path.size() < length)
+			return false;
+
+		for (size_t i = 0; i < length; i++)
+		{
+			char c = path[path.size() - length + i];
+			if (c >= 'A' && c <= 'Z')
+				c = (char)(c - 'A' + 'a');
+			if (c != extension[i])
+				return false;
+		}
+		return true;
+	}
+
+	enum class PlyType
+	{
+		Invalid, Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64
+	};
+
+	struct PlyProperty
+	{
+		std::string Name;
+		PlyType Type = PlyType::Invalid;
+
+		// list properties store a count of CountType followed by that many values of Type
+		bool IsList = false;
+		PlyType CountType = PlyType::Invalid;
+	};
+
+	struct PlyElement
+	{
+		std::string Name;
+		uint64_t Count = 0;
+		std::vector<PlyProperty> Properties;
+	};
+
+	static PlyType ParsePlyType(const std::string& name)
+	{
+		if (name == "char" || name == "int8") return PlyType::Int8;
+		if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+		if (name == "short" || name == "int16") return PlyType::Int16;
+		if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+		if (name == "int" || name == "int32") return PlyType::Int32;
+		if (name == "uint" || name == "uint32") return PlyType::UInt32;
+		if (name == "float" || name == "float32") return PlyType::Float32;
+		if (name == "double" || name == "float64") return PlyType::Float64;
+		return PlyType::Invalid;
+	}
+
+	static size_t PlyTypeSize(PlyType type)
+	{
+		switch (type)
+		{
+		case PlyType::Int8: case PlyType::UInt8: return 1;
+		case PlyType::Int16: case PlyType::UInt16: return 2;
+		case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+		case PlyType::Float64: return 8;
+		default: return 0;
+		}
+	}
+
+	// reads one value of the body, in whichever encoding the header declared
+	class PlyReader
+	{
+	public:
+		PlyReader(std::ifstream& file, bool ascii, bool swap_bytes)
+			: file_(file), ascii_(ascii), swap_bytes_(swap_bytes) {}
+
+		bool Read(PlyType type, double& value)
+		{
+			if (ascii_)
+				return (bool)(file_ >> value);
+
+			uint8_t bytes[8];
+			size_t size = PlyTypeSize(type);
+			if (!file_.read((char*)bytes, (std::streamsize)size))
+				return false;
+
+			if (swap_bytes_)
+			{
+				for (size_t i = 0; i < size / 2; i++)
+					std::swap(bytes[i], bytes[size - 1 - i]);
+			}
+
+			switch (type)
+			{
+			case PlyType::Int8: { int8_t v; memcpy(&v, bytes, 1); value = v; break; }
+			case PlyType::UInt8: { uint8_t v; memcpy(&v, bytes, 1); value = v; break; }
+			case PlyType::Int16: { int16_t v; memcpy(&v, bytes, 2); value = v; break; }
+			case PlyType::UInt16: { uint16_t v; memcpy(&v, bytes, 2); value = v; break; }
+			case PlyType::Int32: { int32_t v; memcpy(&v, bytes, 4); value = v; break; }
+			case PlyType::UInt32: { uint32_t v; memcpy(&v, bytes, 4); value = v; break; }
+			case PlyType::Float32: { float v; memcpy(&v, bytes, 4); value = v; break; }
+			case PlyType::Float64: { double v; memcpy(&v, bytes, 8); value = v; break; }
+			default: return false;
+			}
+			return true;
+		}
+	private:
+		std::ifstream& file_;
+		bool ascii_;
+		bool swap_bytes_;
+	};
+
+	static bool IsLittleEndian()
+	{
+		uint16_t value = 1;
+		uint8_t first;
+		memcpy(&first, &value, 1);
+		return first == 1;
+	}
+}
+
+bool mesh_file::CheckIndices(const Mesh& mesh)
+{
+	for (uint32_t index : mesh.Indices)
+	{
+		if (index >= mesh.Vertices.size())
+			return false;
+	}
+	return true;
+}
+
+bool mesh_file::LoadOBJ(const std::string& path, Mesh& mesh, std::string* error)
+{
+	std::ifstream file(path);
+	if (!file)
+		return utility::Fail(error, "could not open " + path);
+
+	Mesh loaded;
+	loaded.MaterialIndex = mesh.MaterialIndex;
+
+	std::string line;
+	std::vector<uint32_t> polygon;
+	uint32_t line_number = 0;
+	while (std::getline(file, line))
+	{
+		line_number++;
+		const char* cursor = line.c_str();
+		while (*cursor == ' ' || *cursor == '\t')
+			cursor++;
+
+		if (cursor[0] == 'v' && (cursor[1] == ' ' || cursor[1] == '\t'))
+		{
+			char* end;
+			glm::vec3 position;
+			cursor += 1;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				position[axis] = strtof(cursor, &end);
+				if (end == cursor)
+					return utility::Fail(error, path + ":" + std::to_string(line_number) + ": expected 3 coordinates");
+				cursor = end;
+			}
+			loaded.Vertices.push_back(position);
+		}
+		else if (cursor[0] == 'f' && (cursor[1] == ' ' || cursor[1] == '\t'))
+		{
+			// each corner is v, v/vt, v//vn or v/vt/vn, only v is used
+			polygon.clear();
+			cursor += 1;
+			while (true)
+			{
+				char* end;
+				long index = strtol(cursor, &end, 10);
+				if (end == cursor)
+					break;
+				cursor = end;
+
+				// skip the texture and normal indices
+				while (*cursor != '\0' && *cursor != ' ' && *cursor != '\t' && *cursor != '\r')
+					cursor++;
+
+				// negative indices count back from the last vertex
+				long resolved = index < 0 ? (long)loaded.Vertices.size() + index : index - 1;
+				if (resolved < 0)
+					return utility::Fail(error, path + ":" + std::to_string(line_number) + ": invalid vertex index");
+				polygon.push_back((uint32_t)resolved);
+			}
+
+			if (polygon.size() < 3)
+				return utility::Fail(error, path + ":" + std::to_string(line_number) + ": face with fewer than 3 vertices");
+
+			for (size_t i = 1; i + 1 < polygon.size(); i++)
+			{
+				loaded.Indices.push_back(polygon[0]);
+				loaded.Indices.push_back(polygon[i]);
+				loaded.Indices.push_back(polygon[i + 1]);
+			}
+		}
+	}
+
+	if (!CheckIndices(loaded))
+		return utility::Fail(error, path + ": face uses a vertex that does not exist");
+
+	mesh = std::move(loaded);
+	return true;
+}
+
+bool mesh_file::LoadPLY(const std::string& path, Mesh& mesh, std::string* error)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return utility::Fail(error, "could not open " + path);
+
+	// header
+	std::string line;
+	if (!std::getline(file, line) || line.compare(0, 3, "ply") != 0)
+		return utility::Fail(error, path + ": not a .ply file");
+
+	bool ascii = false, big_endian = false, has_format = false;
+	std::vector<utility::PlyElement> elements;
+	while (true)
+	{
+		if (!std::getline(file, line))
+			return utility::Fail(error, path + ": header has no end_header");
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+
+		std::istringstream words(line);
+		std::string keyword;
+		words >> keyword;
+
+		if (keyword == "end_header")
+			break;
+
+		if (keyword == "format")
+		{
+			std::string format;
+			words >> format;
+			ascii = format == "ascii";
+			big_endian = format == "binary_big_endian";
+			if (!ascii && !big_endian && format != "binary_little_endian")
+				return utility::Fail(error, path + ": unknown format " + format);
+			has_format = true;
+		}
+		else if (keyword == "element")
+		{
+			utility::PlyElement& element = elements.emplace_back();
+			words >> element.Name >> element.Count;
+		}
+		else if (keyword == "property")
+		{
+			if (elements.empty())
+				return utility::Fail(error, path + ": property before any element");
+
+			utility::PlyProperty property;
+			std::string type;
+			words >> type;
+			if (type == "list")
+			{
+				std::string count_type;
+				words >> count_type >> type;
+				property.IsList = true;
+				property.CountType = utility::ParsePlyType(count_type);
+				if (property.CountType == utility::PlyType::Invalid)
+					return utility::Fail(error, path + ": unknown property type " + count_type);
+			}
+			words >> property.Name;
+			property.Type = utility::ParsePlyType(type);
+			if (property.Type == utility::PlyType::Invalid)
+				return utility::Fail(error, path + ": unknown property type " + type);
+
+			elements.back().Properties.push_back(property);
+		}
+	}
+
+	if (!has_format)
+		return utility::Fail(error, path + ": header has no format");
+
+	// body, element by element in header order
+	Mesh loaded;
+	loaded.MaterialIndex = mesh.MaterialIndex;
+
+	utility::PlyReader reader(file, ascii, big_endian == utility::IsLittleEndian());
+	std::vector<uint32_t> polygon;
+	for (const utility::PlyElement& element : elements)
+	{
+		bool is_vertex = element.Name == "vertex";
+		bool is_face = element.Name == "face";
+
+		int axis_property[3] = { -1, -1, -1 };
+		for (size_t i = 0; i < element.Properties.size(); i++)
+		{
+			const std::string& name = element.Properties[i].Name;
+			if (name == "x") axis_property[0] = (int)i;
+			if (name == "y") axis_property[1] = (int)i;
+			if (name == "z") axis_property[2] = (int)i;
+		}
+
+		if (is_vertex && (axis_property[0] < 0 || axis_property[1] < 0 || axis_property[2] < 0))
+			return utility::Fail(error, path + ": vertices have no x, y and z");
+
+		if (is_vertex)
+			loaded.Vertices.reserve((size_t)element.Count);
+
+		for (uint64_t item = 0; item < element.Count; item++)
+		{
+			glm::vec3 position{ 0.0f };
+			for (size_t i = 0; i < element.Properties.size(); i++)
+			{
+				const utility::PlyProperty& property = element.Properties[i];
+				double value;
+
+				if (!property.IsList)
+				{
+					if (!reader.Read(property.Type, value))
+						return utility::Fail(error, path + ": file ends inside element " + element.Name);
+
+					for (int axis = 0; axis < 3; axis++)
+					{
+						if (axis_property[axis] == (int)i)
+							position[axis] = (float)value;
+					}
+					continue;
+				}
+
+				double count;
+				if (!reader.Read(property.CountType, count) || count < 0.0)
+					return utility::Fail(error, path + ": file ends inside element " + element.Name);
+
+				// the first list of a face holds its vertex indices
+				bool indices = is_face && (property.Name == "vertex_indices" || property.Name == "vertex_index");
+				polygon.clear();
+				for (uint32_t j = 0; j < (uint32_t)count; j++)
+				{
+					if (!reader.Read(property.Type, value))
+						return utility::Fail(error, path + ": file ends inside element " + element.Name);
+					if (indices)
+					{
+						if (value < 0.0)
+							return utility::Fail(error, path + ": invalid vertex index");
+						polygon.push_back((uint32_t)value);
+					}
+				}
+
+				for (size_t j = 1; indices && j + 1 < polygon.size(); j++)
+				{
+					loaded.Indices.push_back(polygon[0]);
+					loaded.Indices.push_back(polygon[j]);
+					loaded.Indices.push_back(polygon[j + 1]);
+				}
+			}
+
+			if (is_vertex)
+				loaded.Vertices.push_back(position);
+		}
+	}
+
+	if (!CheckIndices(loaded))
+		return utility::Fail(error, path + ": face uses a vertex that does not exist");
+
+	mesh = std::move(loaded);
+	return true;
+}
+
+bool mesh_file::Load(const std::string& path, Mesh& mesh, std::string* error)
+{
+	if (utility::HasExtension(path, ".obj"))
+		return LoadOBJ(path, mesh, error);
+	if (utility::HasExtension(path, ".ply"))
+		return LoadPLY(path, mesh, error);
+
+	return utility::Fail(error, path + ": unknown mesh format, expected .obj or .ply");
+}
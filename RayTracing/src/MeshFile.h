@@ -0,0 +1,34 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: MeshFile.h
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/MeshFile.h
+*/
+
+#pragma once
+
+#include "Scene.h"
+
+#include <string>
+
+// triangle mesh loaders
+// files are read front to back in small pieces, only the vertices and indices are kept in memory
+namespace mesh_file
+{
+	// positions and faces of a Wavefront .obj, polygons are split into triangle fans
+	// texture coordinates, normals, groups and materials are skipped
+	bool LoadOBJ(const std::string& path, Mesh& mesh, std::string* error = nullptr);
+
+	// vertex positions and faces of an ascii or binary .ply, polygons are split into triangle fans
+	bool LoadPLY(const std::string& path, Mesh& mesh, std::string* error = nullptr);
+
+	// picks the loader from the extension
+	bool Load(const std::string& path, Mesh& mesh, std::string* error = nullptr);
+
+	// true if every index names an existing vertex
+	bool CheckIndices(const Mesh& mesh);
+}
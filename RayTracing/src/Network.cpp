@@ -0,0 +1,246 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: Network.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/Network.cpp
+*/
+
+#include "Network.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+namespace utility
+{
+#ifdef _WIN32
+	using NativeSocket = SOCKET;
+
+	// winsock has to be started once per process before any other call
+	static void StartNetwork()
+	{
+		static bool started = []()
+		{
+			WSADATA data;
+			return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+		}();
+		(void)started;
+	}
+
+	static void CloseNative(NativeSocket handle) { closesocket(handle); }
+#else
+	using NativeSocket = int;
+
+	static void StartNetwork() {}
+	static void CloseNative(NativeSocket handle) { close(handle); }
+#endif
+
+	static NativeSocket ToNative(intptr_t handle) { return (NativeSocket)handle; }
+
+	static void SetError(std::string* error, const std::string& message)
+	{
+		if (error)
+			*error = message;
+	}
+
+	// jobs are short messages answered straight away, so they are not held back to fill a packet
+	static void DisableNagle(NativeSocket handle)
+	{
+		int one = 1;
+		setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+	}
+}
+
+Socket& Socket::operator=(Socket&& other) noexcept
+{
+	if (this != &other)
+	{
+		Close();
+		handle_ = other.handle_;
+		other.handle_ = kInvalid;
+	}
+	return *this;
+}
+
+bool Socket::Connect(const std::string& address, std::string* error)
+{
+	Close();
+	utility::StartNetwork();
+
+	size_t colon = address.rfind(':');
+	if (colon == std::string::npos)
+	{
+		utility::SetError(error, "address must be host:port");
+		return false;
+	}
+	std::string host = address.substr(0, colon);
+	std::string port = address.substr(colon + 1);
+
+	addrinfo hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	addrinfo* results = nullptr;
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &results) != 0)
+	{
+		utility::SetError(error, "could not resolve " + host);
+		return false;
+	}
+
+	for (addrinfo* result = results; result; result = result->ai_next)
+	{
+		utility::NativeSocket handle = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+		if ((intptr_t)handle == kInvalid)
+			continue;
+
+		if (connect(handle, result->ai_addr, (int)result->ai_addrlen) == 0)
+		{
+			utility::DisableNagle(handle);
+			handle_ = (intptr_t)handle;
+			break;
+		}
+		utility::CloseNative(handle);
+	}
+	freeaddrinfo(results);
+
+	if (!IsOpen())
+	{
+		utility::SetError(error, "could not connect to " + address);
+		return false;
+	}
+	return true;
+}
+
+bool Socket::Listen(uint16_t port, std::string* error)
+{
+	Close();
+	utility::StartNetwork();
+
+	utility::NativeSocket handle = socket(AF_INET, SOCK_STREAM, 0);
+	if ((intptr_t)handle == kInvalid)
+	{
+		utility::SetError(error, "could not create a socket");
+		return false;
+	}
+
+	// a restarted coordinator can take the port straight back
+	int one = 1;
+	setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+
+	sockaddr_in address{};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+
+	if (bind(handle, (const sockaddr*)&address, sizeof(address)) != 0 || listen(handle, 16) != 0)
+	{
+		utility::CloseNative(handle);
+		utility::SetError(error, "could not listen on port " + std::to_string(port));
+		return false;
+	}
+
+	handle_ = (intptr_t)handle;
+	return true;
+}
+
+bool Socket::Accept(Socket& connection, uint32_t timeout_ms)
+{
+	utility::NativeSocket handle = utility::ToNative(handle_);
+
+#ifdef _WIN32
+	WSAPOLLFD request{ handle, POLLRDNORM, 0 };
+	if (WSAPoll(&request, 1, (int)timeout_ms) <= 0)
+		return false;
+#else
+	pollfd request{ handle, POLLIN, 0 };
+	if (poll(&request, 1, (int)timeout_ms) <= 0)
+		return false;
+#endif
+
+	utility::NativeSocket accepted = accept(handle, nullptr, nullptr);
+	if ((intptr_t)accepted == kInvalid)
+		return false;
+
+	utility::DisableNagle(accepted);
+	connection.Close();
+	connection.handle_ = (intptr_t)accepted;
+	return true;
+}
+
+bool Socket::Send(const void* data, size_t size)
+{
+	const char* bytes = (const char*)data;
+	while (size > 0)
+	{
+		// writing to a closed connection must fail, not raise SIGPIPE
+#ifdef _WIN32
+		int sent = send(utility::ToNative(handle_), bytes, (int)std::min<size_t>(size, 1 << 30), 0);
+#else
+		ssize_t sent = send(utility::ToNative(handle_), bytes, size, MSG_NOSIGNAL);
+#endif
+		if (sent <= 0)
+			return false;
+
+		bytes += sent;
+		size -= (size_t)sent;
+	}
+	return true;
+}
+
+bool Socket::Receive(void* data, size_t size)
+{
+	char* bytes = (char*)data;
+	while (size > 0)
+	{
+#ifdef _WIN32
+		int received = recv(utility::ToNative(handle_), bytes, (int)std::min<size_t>(size, 1 << 30), 0);
+#else
+		ssize_t received = recv(utility::ToNative(handle_), bytes, size, 0);
+#endif
+		if (received <= 0)
+			return false;
+
+		bytes += received;
+		size -= (size_t)received;
+	}
+	return true;
+}
+
+void Socket::SetReceiveTimeout(uint32_t seconds)
+{
+#ifdef _WIN32
+	DWORD timeout = seconds * 1000;
+#else
+	timeval timeout{};
+	timeout.tv_sec = seconds;
+#endif
+	setsockopt(utility::ToNative(handle_), SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+}
+
+void Socket::Close()
+{
+	if (IsOpen())
+	{
+		utility::CloseNative(utility::ToNative(handle_));
+		handle_ = kInvalid;
+	}
+}
@@ -0,0 +1,53 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: Network.h
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/Network.h
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// blocking TCP connection or listening socket, closed when destroyed
+class Socket
+{
+public:
+	Socket() = default;
+	~Socket() { Close(); }
+
+	Socket(const Socket&) = delete;
+	Socket& operator=(const Socket&) = delete;
+
+	Socket(Socket&& other) noexcept : handle_(other.handle_) { other.handle_ = kInvalid; }
+	Socket& operator=(Socket&& other) noexcept;
+
+	// address is host:port, returns false with a reason in error if the connection fails
+	bool Connect(const std::string& address, std::string* error = nullptr);
+
+	// listens on every interface
+	bool Listen(uint16_t port, std::string* error = nullptr);
+
+	// waits up to timeout_ms for a connection on a listening socket, returns false if none arrived
+	bool Accept(Socket& connection, uint32_t timeout_ms);
+
+	// return false once the connection is closed or broken, or a receive runs past the timeout
+	bool Send(const void* data, size_t size);
+	bool Receive(void* data, size_t size);
+
+	// longest a Receive waits for data, 0 waits forever
+	void SetReceiveTimeout(uint32_t seconds);
+
+	bool IsOpen() const { return handle_ != kInvalid; }
+	void Close();
+private:
+	// a SOCKET on Windows, a file descriptor elsewhere
+	static constexpr intptr_t kInvalid = -1;
+	intptr_t handle_ = kInvalid;
+};
@@ -0,0 +1,347 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: Profiler.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/Profiler.cpp
+*/
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+namespace utility
+{
+	// a capture stops growing once a thread has this many events, about 24MB each
+	static constexpr size_t kMaxEventsPerThread = 1 << 20;
+
+	struct TimelineEvent
+	{
+		profiler::Stage Stage;
+		uint64_t Start;
+		uint64_t Duration;
+	};
+
+	struct ThreadProfile
+	{
+		uint32_t Id = 0;
+
+		// written by the owning thread only, read by anyone through GetStats
+		std::atomic<uint64_t> StageTicks[(size_t)profiler::Stage::Count] = {};
+		std::atomic<uint64_t> StageCalls[(size_t)profiler::Stage::Count] = {};
+		std::atomic<uint64_t> Counters[(size_t)profiler::Counter::Count] = {};
+		std::atomic<uint64_t> RaysAtDepth[profiler::kMaxDepth] = {};
+
+		// Name and Events are also read by other threads, so they are guarded
+		std::mutex Mutex;
+		std::string Name;
+		std::vector<TimelineEvent> Events;
+	};
+
+	static std::mutex s_RegistryMutex;
+	static std::vector<std::unique_ptr<ThreadProfile>> s_Profiles;
+	static std::atomic<bool> s_Capturing{ false };
+
+	static thread_local ThreadProfile* t_Profile = nullptr;
+
+	// the time stamp counter on x86-64, which costs a fraction of a steady_clock read
+	// scopes around every ray read it twice, so this is most of the profiling overhead
+	static uint64_t Ticks()
+	{
+#if defined(__x86_64__) || defined(_M_X64)
+		return __rdtsc();
+#else
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	// ticks and steady_clock at startup, the tick rate is measured between then and when totals are read
+	static const uint64_t s_StartTicks = Ticks();
+	static const std::chrono::steady_clock::time_point s_StartTime = std::chrono::steady_clock::now();
+
+	static double GetTicksPerNanosecond()
+	{
+		// too short an interval gives a poor estimate
+		constexpr double kMinInterval = 1e7;
+		double elapsed = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_StartTime).count();
+		if (elapsed < kMinInterval)
+		{
+			std::this_thread::sleep_for(std::chrono::nanoseconds((int64_t)(kMinInterval - elapsed)));
+		}
+
+		uint64_t ticks = Ticks();
+		elapsed = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_StartTime).count();
+		return (double)(ticks - s_StartTicks) / elapsed;
+	}
+
+	// the calling thread's profile, registered on its first use
+	static ThreadProfile& GetProfile()
+	{
+		if (!t_Profile)
+		{
+			std::lock_guard<std::mutex> lock(s_RegistryMutex);
+			s_Profiles.push_back(std::make_unique<ThreadProfile>());
+			t_Profile = s_Profiles.back().get();
+			t_Profile->Id = (uint32_t)s_Profiles.size();
+			t_Profile->Name = "thread " + std::to_string(t_Profile->Id);
+		}
+		return *t_Profile;
+	}
+
+	// only the owning thread writes, so a load and store is enough and cheaper than an atomic add
+	static void Add(std::atomic<uint64_t>& total, uint64_t amount)
+	{
+		total.store(total.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+	}
+
+	static void WriteEscaped(FILE* file, const std::string& text)
+	{
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+				fputc('\\', file);
+			fputc(c, file);
+		}
+	}
+}
+
+namespace profiler
+{
+	const char* GetStageName(Stage stage)
+	{
+		switch (stage)
+		{
+		case Stage::Frame: return "Frame";
+		case Stage::Preview: return "Preview";
+		case Stage::Tile: return "Tile";
+		case Stage::RayGen: return "RayGen";
+		case Stage::TraceRay: return "TraceRay";
+		case Stage::ClosestHit: return "ClosestHit";
+		case Stage::Miss: return "Miss";
+		case Stage::Occlusion: return "Occlusion";
+		case Stage::Accumulate: return "Accumulate";
+		case Stage::Extend: return "Extend";
+		case Stage::Shade: return "Shade";
+		case Stage::Reproject: return "Reproject";
+		case Stage::Resolve: return "Resolve";
+		case Stage::Denoise: return "Denoise";
+		case Stage::Upload: return "Upload";
+		case Stage::Count: break;
+		}
+		return "unknown";
+	}
+
+	bool IsTimelineStage(Stage stage)
+	{
+		switch (stage)
+		{
+		case Stage::Frame:
+		case Stage::Preview:
+		case Stage::Tile:
+		case Stage::Extend:
+		case Stage::Shade:
+		case Stage::Reproject:
+		case Stage::Resolve:
+		case Stage::Denoise:
+		case Stage::Upload:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	const char* GetCounterName(Counter counter)
+	{
+		switch (counter)
+		{
+		case Counter::Samples: return "Samples";
+		case Counter::ShadowRays: return "Shadow rays";
+		case Counter::Count: break;
+		}
+		return "unknown";
+	}
+
+	std::vector<ThreadStats> GetStats()
+	{
+		double ticks_per_nanosecond = utility::GetTicksPerNanosecond();
+		std::lock_guard<std::mutex> registry_lock(utility::s_RegistryMutex);
+
+		std::vector<ThreadStats> stats(utility::s_Profiles.size());
+		for (size_t i = 0; i < utility::s_Profiles.size(); i++)
+		{
+			utility::ThreadProfile& profile = *utility::s_Profiles[i];
+			ThreadStats& thread = stats[i];
+			{
+				std::lock_guard<std::mutex> lock(profile.Mutex);
+				thread.Name = profile.Name;
+			}
+
+			for (size_t stage = 0; stage < (size_t)Stage::Count; stage++)
+			{
+				thread.StageNanoseconds[stage] = (uint64_t)(profile.StageTicks[stage].load(std::memory_order_relaxed) / ticks_per_nanosecond);
+				thread.StageCalls[stage] = profile.StageCalls[stage].load(std::memory_order_relaxed);
+			}
+			for (size_t counter = 0; counter < (size_t)Counter::Count; counter++)
+			{
+				thread.Counters[counter] = profile.Counters[counter].load(std::memory_order_relaxed);
+			}
+			for (uint32_t depth = 0; depth < kMaxDepth; depth++)
+			{
+				thread.RaysAtDepth[depth] = profile.RaysAtDepth[depth].load(std::memory_order_relaxed);
+			}
+		}
+		return stats;
+	}
+
+	ThreadStats Sum(const std::vector<ThreadStats>& stats)
+	{
+		ThreadStats total;
+		total.Name = "total";
+		for (const ThreadStats& thread : stats)
+		{
+			for (size_t stage = 0; stage < (size_t)Stage::Count; stage++)
+			{
+				total.StageNanoseconds[stage] += thread.StageNanoseconds[stage];
+				total.StageCalls[stage] += thread.StageCalls[stage];
+			}
+			for (size_t counter = 0; counter < (size_t)Counter::Count; counter++)
+			{
+				total.Counters[counter] += thread.Counters[counter];
+			}
+			for (uint32_t depth = 0; depth < kMaxDepth; depth++)
+			{
+				total.RaysAtDepth[depth] += thread.RaysAtDepth[depth];
+			}
+		}
+		return total;
+	}
+
+	ThreadStats Difference(const ThreadStats& now, const ThreadStats& before)
+	{
+		ThreadStats difference = now;
+		for (size_t stage = 0; stage < (size_t)Stage::Count; stage++)
+		{
+			difference.StageNanoseconds[stage] -= before.StageNanoseconds[stage];
+			difference.StageCalls[stage] -= before.StageCalls[stage];
+		}
+		for (size_t counter = 0; counter < (size_t)Counter::Count; counter++)
+		{
+			difference.Counters[counter] -= before.Counters[counter];
+		}
+		for (uint32_t depth = 0; depth < kMaxDepth; depth++)
+		{
+			difference.RaysAtDepth[depth] -= before.RaysAtDepth[depth];
+		}
+		return difference;
+	}
+
+	void SetThreadName(const char* name)
+	{
+		utility::ThreadProfile& profile = utility::GetProfile();
+		std::lock_guard<std::mutex> lock(profile.Mutex);
+		profile.Name = name;
+	}
+
+	void BeginCapture()
+	{
+		std::lock_guard<std::mutex> registry_lock(utility::s_RegistryMutex);
+		for (const std::unique_ptr<utility::ThreadProfile>& profile : utility::s_Profiles)
+		{
+			std::lock_guard<std::mutex> lock(profile->Mutex);
+			profile->Events.clear();
+		}
+		utility::s_Capturing.store(true, std::memory_order_relaxed);
+	}
+
+	bool IsCapturing()
+	{
+		return utility::s_Capturing.load(std::memory_order_relaxed);
+	}
+
+	bool EndCapture(const std::string& path)
+	{
+		utility::s_Capturing.store(false, std::memory_order_relaxed);
+
+		FILE* file = fopen(path.c_str(), "w");
+		if (!file)
+			return false;
+
+		double ticks_per_microsecond = utility::GetTicksPerNanosecond() * 1000.0;
+
+		fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+		// timestamps and durations are in microseconds
+		bool first = true;
+		std::lock_guard<std::mutex> registry_lock(utility::s_RegistryMutex);
+		for (const std::unique_ptr<utility::ThreadProfile>& profile : utility::s_Profiles)
+		{
+			std::lock_guard<std::mutex> lock(profile->Mutex);
+			if (profile->Events.empty())
+				continue;
+
+			fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"", first ? "" : ",\n", profile->Id);
+			utility::WriteEscaped(file, profile->Name);
+			fprintf(file, "\"}}");
+			first = false;
+
+			for (const utility::TimelineEvent& event : profile->Events)
+			{
+				fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+					GetStageName(event.Stage), profile->Id, (event.Start - utility::s_StartTicks) / ticks_per_microsecond,
+					event.Duration / ticks_per_microsecond);
+			}
+			profile->Events.clear();
+		}
+
+		fprintf(file, "\n]}\n");
+		return fclose(file) == 0;
+	}
+
+	void Count(Counter counter, uint64_t amount)
+	{
+		utility::Add(utility::GetProfile().Counters[(size_t)counter], amount);
+	}
+
+	void CountRays(uint32_t depth, uint64_t count)
+	{
+		utility::Add(utility::GetProfile().RaysAtDepth[std::min(depth, kMaxDepth - 1)], count);
+	}
+
+	ScopedTimer::ScopedTimer(Stage stage)
+		: stage_(stage), start_(utility::Ticks())
+	{
+	}
+
+	ScopedTimer::~ScopedTimer()
+	{
+		uint64_t duration = utility::Ticks() - start_;
+
+		utility::ThreadProfile& profile = utility::GetProfile();
+		utility::Add(profile.StageTicks[(size_t)stage_], duration);
+		utility::Add(profile.StageCalls[(size_t)stage_], 1);
+
+		if (IsTimelineStage(stage_) && IsCapturing())
+		{
+			std::lock_guard<std::mutex> lock(profile.Mutex);
+			if (profile.Events.size() < utility::kMaxEventsPerThread)
+				profile.Events.push_back({ stage_, start_, duration });
+		}
+	}
+}
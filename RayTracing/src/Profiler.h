@@ -0,0 +1,117 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: Profiler.h
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/Profiler.h
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// per thread time spent in each stage of the renderer, ray counters and a timeline of the coarse stages
+//
+// the RT_PROFILE_ macros at the bottom compile to nothing unless RT_PROFILE is defined,
+// so the hot paths pay nothing in normal builds. each thread only writes its own totals,
+// the totals are atomics so another thread can read them while rendering goes on
+namespace profiler
+{
+	// stage times include the stages called from them, e.g. TraceRay includes ClosestHit and Miss
+	enum class Stage : uint32_t
+	{
+		Frame, Preview, Tile, RayGen, TraceRay, ClosestHit, Miss, Occlusion, Accumulate,
+
+		// the two halves of a wavefront bounce
+		Extend, Shade,
+
+		Reproject, Resolve, Denoise, Upload,
+
+		Count
+	};
+
+	const char* GetStageName(Stage stage);
+
+	// only the coarse stages are put on the timeline, a per ray event would cost more than the ray
+	bool IsTimelineStage(Stage stage);
+
+	enum class Counter : uint32_t
+	{
+		Samples, ShadowRays,
+
+		Count
+	};
+
+	const char* GetCounterName(Counter counter);
+
+	// rays at deeper bounces are counted with the last depth
+	static constexpr uint32_t kMaxDepth = 16;
+
+	// totals of one thread since it started recording
+	struct ThreadStats
+	{
+		std::string Name;
+
+		uint64_t StageNanoseconds[(size_t)Stage::Count] = {};
+		uint64_t StageCalls[(size_t)Stage::Count] = {};
+		uint64_t Counters[(size_t)Counter::Count] = {};
+		uint64_t RaysAtDepth[kMaxDepth] = {};
+	};
+
+	// one entry per thread that recorded anything, in the order they started
+	// threads that have exited keep their entry, so totals never go backwards
+	std::vector<ThreadStats> GetStats();
+
+	// totals of every thread
+	ThreadStats Sum(const std::vector<ThreadStats>& stats);
+
+	// what a thread recorded between two GetStats calls
+	ThreadStats Difference(const ThreadStats& now, const ThreadStats& before);
+
+	// shown in GetStats and as the thread's name on the timeline
+	void SetThreadName(const char* name);
+
+	// records the timeline stages of every thread until EndCapture
+	void BeginCapture();
+	bool IsCapturing();
+
+	// writes the events recorded since BeginCapture as chrome://tracing / Perfetto JSON
+	// returns false if the file could not be written
+	bool EndCapture(const std::string& path);
+
+	void Count(Counter counter, uint64_t amount);
+	void CountRays(uint32_t depth, uint64_t count);
+
+	// adds the time between construction and destruction to a stage of the calling thread
+	class ScopedTimer
+	{
+	public:
+		explicit ScopedTimer(Stage stage);
+		~ScopedTimer();
+
+		ScopedTimer(const ScopedTimer&) = delete;
+		ScopedTimer& operator=(const ScopedTimer&) = delete;
+	private:
+		Stage stage_;
+		uint64_t start_;
+	};
+}
+
+#ifdef RT_PROFILE
+#define RT_PROFILE_CONCAT_(a, b) a##b
+#define RT_PROFILE_CONCAT(a, b) RT_PROFILE_CONCAT_(a, b)
+#define RT_PROFILE_SCOPE(stage) profiler::ScopedTimer RT_PROFILE_CONCAT(profile_scope_, __LINE__)(profiler::Stage::stage)
+#define RT_PROFILE_COUNT(counter, amount) profiler::Count(profiler::Counter::counter, amount)
+#define RT_PROFILE_RAYS(depth, count) profiler::CountRays(depth, count)
+#define RT_PROFILE_THREAD(name) profiler::SetThreadName(name)
+#else
+#define RT_PROFILE_SCOPE(stage) ((void)0)
+#define RT_PROFILE_COUNT(counter, amount) ((void)0)
+#define RT_PROFILE_RAYS(depth, count) ((void)0)
+#define RT_PROFILE_THREAD(name) ((void)0)
+#endif
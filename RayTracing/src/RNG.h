@@ -0,0 +1,68 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: RNG.h
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/RNG.h
+*/
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// PCG hash, from Jarzynski & Olano - Hash Functions for GPU Rendering (2020)
+inline uint32_t PCGHash(uint32_t input)
+{
+	uint32_t state = input * 747796405u + 2891336453u;
+	uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+// small PCG random number generator without shared state
+// every (seed, pixel, frame, bounce) gets its own stream, so a sample is the same
+// no matter which thread renders it or in which order
+class RNG
+{
+public:
+	RNG(uint32_t seed, uint32_t pixel, uint32_t frame, uint32_t bounce)
+		: state_(PCGHash(seed ^ PCGHash(pixel ^ PCGHash(frame ^ PCGHash(bounce))))) {}
+
+	uint32_t UInt()
+	{
+		// PCG-RXS-M-XS 32 bit
+		state_ = state_ * 747796405u + 2891336453u;
+		uint32_t word = ((state_ >> ((state_ >> 28u) + 4u)) ^ state_) * 277803737u;
+		return (word >> 22u) ^ word;
+	}
+
+	// uniform in [0, 1)
+	float Float() { return (float)(UInt() >> 8) * (1.0f / 16777216.0f); }
+
+	glm::vec3 Vec3(float min, float max)
+	{
+		float x = Float(), y = Float(), z = Float();
+		return glm::vec3(x, y, z) * (max - min) + min;
+	}
+
+	// same distribution as Walnut::Random::InUnitSphere, a unit vector but not a uniform one,
+	// it is the normalised point of a cube so directions towards its corners are more likely
+	glm::vec3 InUnitSphere() { return glm::normalize(Vec3(-1.0f, 1.0f)); }
+
+	// uniform direction on the unit sphere, a unit normal plus this is cosine distributed around the normal
+	glm::vec3 OnUnitSphere()
+	{
+		float z = 1.0f - 2.0f * Float();
+		float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+		float phi = 6.28318531f * Float();
+		return glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+	}
+private:
+	uint32_t state_;
+};
@@ -0,0 +1,220 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: RenderThread.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/RenderThread.cpp
+*/
+
+#include "Walnut/Timer.h"
+#include "Profiler.h"
+#include "RenderThread.h"
+
+#include <chrono>
+
+RenderThread::RenderThread(const Scene& scene, BVH bvh, float vertical_fov, float near_clip, float far_clip)
+	: camera_(vertical_fov, near_clip, far_clip), scene_(scene)
+{
+	renderer_.SetAccelerationStructure(scene_, std::move(bvh));
+	renderer_.SetCancelFlag(&cancel_);
+	thread_ = std::thread(&RenderThread::Run, this);
+}
+
+RenderThread::~RenderThread()
+{
+	stop_.store(true, std::memory_order_release);
+	cancel_.store(true, std::memory_order_relaxed);
+	Wake();
+	thread_.join();
+}
+
+void RenderThread::Submit(const Request& request)
+{
+	requests_.GetWriteSlot() = request;
+	requests_.Publish();
+	Wake();
+}
+
+void RenderThread::MarkSphereEdited(uint32_t index)
+{
+	edited_spheres_[index] = kUnsent;
+	edits_marked_ = true;
+}
+
+void RenderThread::MarkInstanceEdited(uint32_t index)
+{
+	edited_instances_[index] = kUnsent;
+	edits_marked_ = true;
+}
+
+void RenderThread::MarkMaterialEdited(uint32_t index)
+{
+	edited_materials_[index] = kUnsent;
+	edits_marked_ = true;
+}
+
+void RenderThread::SubmitEdits(const Scene& scene)
+{
+	if (!edits_marked_)
+		return;
+	edits_marked_ = false;
+
+	// an edit published before the render thread took the last one replaces it, so everything
+	// the render thread has not applied yet goes out again
+	uint64_t applied = applied_version_.load(std::memory_order_acquire);
+	auto collect = [&](auto& edited, const auto& values, auto& out)
+		{
+			out.clear();
+			for (auto it = edited.begin(); it != edited.end();)
+			{
+				if (it->second != kUnsent && it->second <= applied)
+				{
+					it = edited.erase(it);
+					continue;
+				}
+
+				it->second = scene.Version;
+				out.emplace_back(it->first, values[it->first]);
+				++it;
+			}
+		};
+
+	SceneEdit& edit = edits_.GetWriteSlot();
+	edit.Version = scene.Version;
+	collect(edited_spheres_, scene.Spheres, edit.Spheres);
+	collect(edited_instances_, scene.Instances, edit.Instances);
+	collect(edited_materials_, scene.Materials, edit.Materials);
+	edits_.Publish();
+	Wake();
+}
+
+void RenderThread::ResetAccumulation()
+{
+	pending_.fetch_or(kResetAccumulation, std::memory_order_release);
+	Wake();
+}
+
+void RenderThread::OnCameraMoved()
+{
+	pending_.fetch_or(kCameraMoved, std::memory_order_release);
+	cancel_.store(true, std::memory_order_relaxed);
+	Wake();
+}
+
+void RenderThread::Wake()
+{
+	{
+		std::lock_guard<std::mutex> lock(wake_mutex_);
+		woken_ = true;
+	}
+	wake_condition_.notify_one();
+}
+
+void RenderThread::Run()
+{
+	RT_PROFILE_THREAD("render");
+
+	while (!stop_.load(std::memory_order_acquire))
+	{
+		// anything the UI sends from here on is seen by this pass or ends the wait below
+		{
+			std::lock_guard<std::mutex> lock(wake_mutex_);
+			woken_ = false;
+		}
+
+		// a cancel raised before the requests are read below was meant for the previous frame
+		cancel_.store(false, std::memory_order_relaxed);
+
+		// flags are raised after the request they belong to is published, so reading them first
+		// never applies them to an older request
+		uint32_t flags = pending_.exchange(0, std::memory_order_acquire);
+
+		if (requests_.Acquire())
+		{
+			ApplyRequest(requests_.GetReadSlot());
+		}
+
+		if (edits_.Acquire())
+		{
+			ApplyEdit(edits_.GetReadSlot());
+		}
+
+		// nothing to render into until the UI has a viewport
+		if (request_.Width == 0 || request_.Height == 0)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+
+		if (flags & kCameraMoved)
+			renderer_.OnCameraMoved();
+		else if (flags & kResetAccumulation)
+			renderer_.ResetFrameIndex();
+
+		Walnut::Timer timer;
+		if (!renderer_.Render(scene_, camera_))
+			continue;
+
+		Frame& frame = frames_.GetWriteSlot();
+		frame.Width = renderer_.GetWidth();
+		frame.Height = renderer_.GetHeight();
+		frame.Pixels.assign(renderer_.GetImageData(), renderer_.GetImageData() + (size_t)frame.Width * frame.Height);
+		frame.RenderTime = timer.ElapsedMillis();
+		frame.PreviewScale = renderer_.GetPreviewScale();
+		frame.ConvergedRatio = renderer_.GetConvergedRatio();
+		frame.TileTimes = renderer_.GetTileTimes();
+		frames_.Publish();
+
+		// a converged frame takes no samples, rendering it again would only resolve the same image
+		if (renderer_.IsConverged())
+		{
+			std::unique_lock<std::mutex> lock(wake_mutex_);
+			wake_condition_.wait(lock, [this]() { return woken_ || stop_.load(std::memory_order_acquire); });
+		}
+	}
+}
+
+void RenderThread::ApplyRequest(const Request& request)
+{
+	renderer_.GetSettings() = request.Settings;
+
+	renderer_.OnResize(request.Width, request.Height);
+	camera_.OnResize(request.Width, request.Height);
+	camera_.SetCacheRayDirections(request.CacheRayDirections);
+
+	// the camera only has its own default view before the first request
+	bool first = request_.Width == 0 && request_.Height == 0;
+	if (first || request.Position != request_.Position || request.Direction != request_.Direction)
+	{
+		camera_.LookAt(request.Position, request.Direction);
+	}
+
+	request_ = request;
+}
+
+void RenderThread::ApplyEdit(const SceneEdit& edit)
+{
+	// the versions come along, so the renderer refits only what the UI edited
+	scene_.SphereVersions.resize(scene_.Spheres.size(), 0);
+	for (const auto& [index, sphere] : edit.Spheres)
+	{
+		scene_.Spheres[index] = sphere;
+		scene_.SphereVersions[index] = edit.Version;
+	}
+
+	scene_.InstanceVersions.resize(scene_.Instances.size(), 0);
+	for (const auto& [index, instance] : edit.Instances)
+	{
+		scene_.Instances[index] = instance;
+		scene_.InstanceVersions[index] = edit.Version;
+	}
+
+	for (const auto& [index, material] : edit.Materials)
+		scene_.Materials[index] = material;
+
+	scene_.Version = edit.Version;
+	applied_version_.store(edit.Version, std::memory_order_release);
+}
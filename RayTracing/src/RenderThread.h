@@ -0,0 +1,144 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: RenderThread.h
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/RenderThread.h
+*/
+
+#pragma once
+
+#include "BVH.h"
+#include "Camera.h"
+#include "Renderer.h"
+#include "Scene.h"
+#include "TripleBuffer.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// runs a renderer on its own thread, so a slow frame never holds up the UI
+// requests, scene edits and finished frames cross between the threads through triple buffers,
+// the UI side calls never wait for the render thread
+class RenderThread
+{
+public:
+	// everything about the next frame except the scene, published every UI frame
+	struct Request
+	{
+		Renderer::Settings Settings;
+		uint32_t Width = 0, Height = 0;
+
+		glm::vec3 Position{ 0.0f, 0.0f, 0.0f };
+		glm::vec3 Direction{ 0.0f, 0.0f, -1.0f };
+		bool CacheRayDirections = false;
+	};
+
+	// a finished frame and the renderer state that goes with it
+	struct Frame
+	{
+		std::vector<uint32_t> Pixels;
+		uint32_t Width = 0, Height = 0;
+
+		// milliseconds spent in Render
+		float RenderTime = 0.0f;
+
+		uint32_t PreviewScale = 1;
+		float ConvergedRatio = 0.0f;
+		std::vector<float> TileTimes;
+	};
+
+	// values of the objects edited since the last edit the render thread applied, Version is the UI scene's
+	struct SceneEdit
+	{
+		uint64_t Version = 0;
+		std::vector<std::pair<uint32_t, Sphere>> Spheres;
+		std::vector<std::pair<uint32_t, Instance>> Instances;
+		std::vector<std::pair<uint32_t, Material>> Materials;
+	};
+
+	// the render thread works on its own copy of scene, bvh is used for it if it is not empty
+	RenderThread(const Scene& scene, BVH bvh, float vertical_fov, float near_clip, float far_clip);
+	~RenderThread();
+
+	RenderThread(const RenderThread&) = delete;
+	RenderThread& operator=(const RenderThread&) = delete;
+
+	// takes effect from the next frame, a newer request replaces one the render thread has not picked up yet
+	void Submit(const Request& request);
+
+	// call after editing an object of the UI's scene, which must keep the objects the constructor was given,
+	// marking an object again before the render thread has applied it costs nothing more
+	void MarkSphereEdited(uint32_t index);
+	void MarkInstanceEdited(uint32_t index);
+	void MarkMaterialEdited(uint32_t index);
+
+	// sends the marked objects' values from scene, only the ones the render thread has not applied yet,
+	// so the cost follows the number of edited objects rather than the size of the scene
+	void SubmitEdits(const Scene& scene);
+
+	// call after the Submit these belong to, so they are never paired with an older request
+	void ResetAccumulation();
+
+	// also abandons the frame in progress, its samples were taken from the old view
+	void OnCameraMoved();
+
+	// true if a frame finished since the last call, GetFrame then returns it until the next call
+	bool AcquireFrame() { return frames_.Acquire(); }
+	const Frame& GetFrame() const { return frames_.GetReadSlot(); }
+private:
+	enum PendingFlags : uint32_t
+	{
+		kResetAccumulation = 1,
+		kCameraMoved = 2
+	};
+
+	void Run();
+
+	// ends a wait for new work on the render thread, or skips the next one
+	void Wake();
+	void ApplyRequest(const Request& request);
+	void ApplyEdit(const SceneEdit& edit);
+private:
+	// render thread state
+	Renderer renderer_;
+	Camera camera_;
+	Scene scene_;
+	Request request_;
+
+	TripleBuffer<Request> requests_;
+	TripleBuffer<SceneEdit> edits_;
+
+	// UI side, object index to the scene version it was last sent with, or kUnsent
+	static constexpr uint64_t kUnsent = ~0ull;
+	std::unordered_map<uint32_t, uint64_t> edited_spheres_;
+	std::unordered_map<uint32_t, uint64_t> edited_instances_;
+	std::unordered_map<uint32_t, uint64_t> edited_materials_;
+	bool edits_marked_ = false;
+
+	// Version of the last edit the render thread applied, sent edits up to it are dropped from the maps
+	std::atomic<uint64_t> applied_version_{ 0 };
+	TripleBuffer<Frame> frames_;
+
+	// PendingFlags raised by the UI since the render thread last looked
+	std::atomic<uint32_t> pending_{ 0 };
+
+	// checked by the renderer before every tile
+	std::atomic<bool> cancel_{ false };
+	std::atomic<bool> stop_{ false };
+
+	// once every tile has converged the render thread sleeps until the UI sends something new
+	std::mutex wake_mutex_;
+	std::condition_variable wake_condition_;
+	bool woken_ = false;
+
+	std::thread thread_;
+};
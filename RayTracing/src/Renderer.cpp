@@ -10,125 +10,1192 @@
 	Adapted from: https://github.com/TheCherno/RayTracing/ (MIT License - Copyright (c) 2022 Studio Cherno)
 */
 
-#include "Walnut/Random.h"
+#include "Walnut/Timer.h"
+#include "Profiler.h"
 #include "Renderer.h"
+#include "RNG.h"
 
-#include <execution>
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstring>
 
 namespace utility
 {
-	static uint32_t ConvertToRGBA(const glm::vec4& color)
+	static float Luminance(const glm::vec3& color)
 	{
-		uint8_t r = (uint8_t)(color.r * 255.0f);
-		uint8_t g = (uint8_t)(color.g * 255.0f);
-		uint8_t b = (uint8_t)(color.b * 255.0f);
-		uint8_t a = (uint8_t)(color.a * 255.0f);
+		return glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+	}
+
+	// coarsest preview, one ray per 8x8 block
+	static constexpr uint32_t kMaxPreviewScale = 8;
+
+	// primary ray directions are generated for this many pixels of a tile row at a time
+	static constexpr uint32_t kRayBatch = 16;
+
+	static const glm::vec3 kBackgroundColor(0.529f, 0.808f, 0.922f);
+
+	// keeps the relative error of very dark pixels from blowing up
+	static constexpr float kMinLuminance = 0.05f;
+
+	// stands in for the variance of pixels with too few samples to estimate it
+	static constexpr float kUnknownVariance = 1e6f;
 
-		uint32_t result = (a << 24) | (b << 16) | (g << 8) | r;
-		return result;
+	// a history pixel belongs to the same surface if its depth is within this fraction of the expected
+	// depth and its normal within about 25 degrees, anything else was hidden in the previous view
+	static constexpr float kReprojectionDepthTolerance = 0.05f;
+	static constexpr float kReprojectionNormalTolerance = 0.9f;
+
+	// refitted trees are rebuilt once their SAH cost grows by this factor
+	static constexpr float kRebuildCostRatio = 1.5f;
+
+	static constexpr float kPi = 3.14159265f;
+
+	// offset along the normal that keeps a new ray from hitting the surface it starts on
+	static constexpr float kRayOffset = 0.0001f;
+
+	// lowest survival probability, so paths with a dark throughput can still reach a light
+	static constexpr float kMinSurvival = 0.05f;
+
+	// Russian roulette, keeps a path with a probability that follows its throughput and
+	// scales a survivor up by the inverse, the expected contribution is unchanged
+	static bool SurviveRoulette(RNG& rng, glm::vec3& throughput)
+	{
+		float survival = glm::clamp(glm::max(throughput.r, glm::max(throughput.g, throughput.b)), kMinSurvival, 1.0f);
+		if (rng.Float() >= survival)
+			return false;
+
+		throughput /= survival;
+		return true;
+	}
+
+	// multiple importance sampling weight of a sample drawn with pdf, against another strategy with other_pdf
+	static float PowerHeuristic(float pdf, float other_pdf)
+	{
+		float pdf2 = pdf * pdf;
+		float sum = pdf2 + other_pdf * other_pdf;
+		return sum > 0.0f ? pdf2 / sum : 0.0f;
+	}
+
+	// 1 - cos of the half angle of the cone a sphere covers as seen from position, 0 if position is inside it
+	static float ConeAngle(const glm::vec3& position, const Sphere& sphere)
+	{
+		glm::vec3 to_center = sphere.Position - position;
+		float distance2 = glm::dot(to_center, to_center);
+		float radius2 = sphere.Radius * sphere.Radius;
+		if (distance2 <= radius2)
+			return 0.0f;
+
+		// written so that tiny distant lights do not cancel to 0
+		float sin2_max = radius2 / distance2;
+		return sin2_max / (1.0f + glm::sqrt(1.0f - sin2_max));
+	}
+
+	// spreads the lower 16 bits of x out to the even bits
+	static uint32_t Part1By1(uint32_t x)
+	{
+		x &= 0x0000ffff;
+		x = (x | (x << 8)) & 0x00ff00ff;
+		x = (x | (x << 4)) & 0x0f0f0f0f;
+		x = (x | (x << 2)) & 0x33333333;
+		x = (x | (x << 1)) & 0x55555555;
+		return x;
+	}
+
+	static uint32_t MortonCode(uint32_t x, uint32_t y)
+	{
+		return Part1By1(x) | (Part1By1(y) << 1);
+	}
+
+	static AABB SphereBounds(const Sphere& sphere)
+	{
+		glm::vec3 extent{ glm::abs(sphere.Radius) };
+		return { sphere.Position - extent, sphere.Position + extent };
+	}
+
+	// elements whose last edit came after version, versions may be shorter than count if some were never edited
+	static void CollectEdited(const std::vector<uint64_t>& versions, uint64_t version, size_t count, std::vector<uint32_t>& edited)
+	{
+		edited.clear();
+		size_t end = std::min(versions.size(), count);
+		for (size_t i = 0; i < end; i++)
+		{
+			if (versions[i] > version)
+				edited.push_back((uint32_t)i);
+		}
 	}
 }
 
 void Renderer::OnResize(uint32_t width, uint32_t height)
 {
-	if (final_image_)
+	// no resize necessary
+	if (image_data_.Data() && width_ == width && height_ == height)
+		return;
+
+	width_ = width;
+	height_ = height;
+
+	if (sink_)
+	{
+		sink_->OnResize(width, height);
+	}
+
+	// allocate image size
+	image_data_.Resize(width * height);
+
+	// allocate accumulation data size
+	accumulation_.Resize(width * height, settings_.Accumulation);
+
+	// allocate per-pixel sample counts and variance
+	sample_counts_.Resize(width * height);
+	variance_data_.Resize(width * height);
+	has_samples_ = false;
+	aovs_valid_ = false;
+
+	// everything has to be accumulated again
+	frame_index_ = 1;
+
+	BuildTiles();
+}
+
+void Renderer::OnCameraMoved()
+{
+	if (settings_.TemporalReprojection && settings_.Accumulate)
+	{
+		reproject_ = true;
+		reprojections_++;
+		return;
+	}
+
+	ResetFrameIndex();
+	camera_moving_ = true;
+}
+
+bool Renderer::Render(const Scene& scene, const Camera& camera)
+{
+	RT_PROFILE_SCOPE(Frame);
+
+	active_scene_ = &scene;
+	active_camera_ = &camera;
+
+	// anything accumulated before an edit is stale
+	if (UpdateAccelerationStructure(scene))
+	{
+		if (!restored_)
+			frame_index_ = 1;
+		lights_valid_ = false;
+	}
+	restored_ = false;
+
+	if (accumulation_.GetFormat() != settings_.Accumulation)
+	{
+		accumulation_.Resize(width_ * height_, settings_.Accumulation);
+		frame_index_ = 1;
+		has_samples_ = false;
+	}
+
+	if (settings_.NextEventEstimation && !lights_valid_)
+	{
+		BuildLightList(scene);
+	}
+
+	// a fixed seed makes every frame reproducible between runs
+	seed_ = (settings_.DeterministicSeed ? settings_.Seed : random_seed_) + reprojections_ * 0x9e3779b9u;
+
+	kernels::ISA isa = settings_.SIMD ? kernels::GetBestISA() : kernels::ISA::Scalar;
+	intersect_spheres_ = kernels::GetIntersectSpheres(isa);
+	intersect_triangles_ = kernels::GetIntersectTriangles(isa);
+
+	if (tile_size_ != settings_.TileSize)
+	{
+		BuildTiles();
+	}
+
+	uint32_t thread_count = settings_.ThreadCount > 0 ? settings_.ThreadCount : ThreadPool::GetHardwareThreadCount();
+	if (!thread_pool_ || thread_pool_->GetThreadCount() != thread_count)
+	{
+		thread_pool_ = std::make_unique<ThreadPool>(thread_count);
+	}
+
+	if (settings_.CollectStats && worker_stats_.size() < thread_count)
+	{
+		worker_stats_.resize(thread_count);
+	}
+
+	if (settings_.Wavefront && worker_wavefront_.size() < thread_count)
+	{
+		worker_wavefront_.resize(thread_count);
+	}
+
+	// cheap low resolution frames while the camera moves, full accumulation once it stops
+	if (settings_.ProgressivePreview && camera_moving_)
+	{
+		camera_moving_ = false;
+		RenderPreview();
+
+		if (sink_)
+		{
+			RT_PROFILE_SCOPE(Upload);
+			sink_->SetData(image_data_.Data(), width_, height_);
+		}
+		return true;
+	}
+	camera_moving_ = false;
+
+	// a move reprojects what has been accumulated, unless there is nothing to carry over
+	if (reproject_)
+	{
+		reproject_ = false;
+		if (frame_index_ > 1 && aovs_valid_ && settings_.TemporalReprojection && settings_.Accumulate)
+			Reproject();
+		else
+			frame_index_ = 1;
+	}
+
+	// reset accumulation data on first frame
+	if (frame_index_ == 1)
+	{
+		accumulation_.Clear();
+		memset(sample_counts_.Data(), 0, width_ * height_ * sizeof(uint32_t));
+		memset(variance_data_.Data(), 0, width_ * height_ * sizeof(PixelVariance));
+		std::fill(tile_converged_.begin(), tile_converged_.end(), (uint8_t)0);
+	}
+
+	// the first hits only change when accumulation restarts or is reprojected
+	bool aovs = settings_.AOVs || settings_.Denoise || settings_.TemporalReprojection;
+	if (aovs && (frame_index_ == 1 || !aovs_valid_))
+	{
+		RenderAOVs();
+	}
+
+	bool adaptive = settings_.AdaptiveSampling && settings_.Accumulate;
+
+	// converged tiles are skipped
+	active_tiles_.clear();
+	uint32_t active_pixels = 0;
+	for (uint32_t i = 0; i < (uint32_t)tiles_.size(); i++)
+	{
+		if (adaptive && tile_converged_[i])
+		{
+			tile_times_[i] = 0.0f;
+			continue;
+		}
+
+		const Tile& tile = tiles_[i];
+		active_tiles_.push_back(i);
+		active_pixels += (tile.MaxX - tile.MinX) * (tile.MaxY - tile.MinY);
+	}
+
+	// a frame costs about one sample per pixel, the budget of converged pixels goes to the rest
+	uint32_t samples = 1;
+	if (adaptive && active_pixels > 0)
+	{
+		samples = std::clamp((width_ * height_) / active_pixels, 1u, std::max(settings_.MaxSamplesPerFrame, 1u));
+	}
+
+	// multithreaded rendering
+	// tiles are handed out in Morton order, idle threads steal tiles from busy ones
+	std::atomic<bool> cancelled{ false };
+	thread_pool_->ParallelFor((uint32_t)active_tiles_.size(), [this, samples, adaptive, &cancelled](uint32_t index, uint32_t worker)
+		{
+			if (cancel_ && cancel_->load(std::memory_order_relaxed))
+			{
+				cancelled.store(true, std::memory_order_relaxed);
+				return;
+			}
+
+			RT_PROFILE_SCOPE(Tile);
+			uint32_t tile_index = active_tiles_[index];
+
+			Walnut::Timer timer;
+			std::vector<BounceStats>* stats = settings_.CollectStats ? &worker_stats_[worker] : nullptr;
+			bool converged = settings_.Wavefront
+				? RenderTileWavefront(tiles_[tile_index], samples, stats, worker_wavefront_[worker])
+				: RenderTile(tiles_[tile_index], samples, stats);
+			tile_times_[tile_index] = timer.ElapsedMillis();
+
+			tile_converged_[tile_index] = adaptive && converged;
+		});
+
+	// some tiles have fewer samples than the rest, so nothing of this frame is kept
+	// unless it is reprojected, which keeps a count per pixel and skips pixels without samples
+	if (cancelled.load(std::memory_order_relaxed))
+	{
+		if (settings_.TemporalReprojection && settings_.Accumulate)
+		{
+			frame_index_++;
+			return false;
+		}
+
+		frame_index_ = 1;
+		has_samples_ = false;
+		return false;
+	}
+
+	UpdateConvergedRatio();
+
+	has_samples_ = true;
+	if (settings_.ResolveEveryFrame)
+	{
+		Resolve();
+	}
+
+	// increments frame index if accumulation is turned on
+	if (settings_.Accumulate == true)
+	{
+		frame_index_++;
+	}
+	else
+	{
+		//ResetFrameIndex();
+		frame_index_ = 1;
+		sample_offset_++;
+	}
+
+	return true;
+}
+
+void Renderer::UpdateConvergedRatio()
+{
+	uint32_t converged_pixels = 0;
+	for (uint32_t i = 0; i < (uint32_t)tiles_.size(); i++)
 	{
-		// no resize necessary
-		if (final_image_->GetWidth() == width && final_image_->GetHeight() == height)
-			return;
+		if (tile_converged_[i])
+		{
+			const Tile& tile = tiles_[i];
+			converged_pixels += (tile.MaxX - tile.MinX) * (tile.MaxY - tile.MinY);
+		}
+	}
+	converged_ratio_ = width_ * height_ > 0 ? (float)converged_pixels / (float)(width_ * height_) : 0.0f;
+}
 
-		final_image_->Resize(width, height);
+bool Renderer::GetAccumulationState(AccumulationState& state) const
+{
+	if (!has_samples_ || frame_index_ == 1)
+		return false;
+
+	size_t pixels = (size_t)width_ * height_;
+
+	state.Width = width_;
+	state.Height = height_;
+	state.FrameIndex = frame_index_;
+	state.Seed = seed_;
+	state.SampleOffset = sample_offset_;
+
+	state.Format = accumulation_.GetFormat();
+	state.FirstSample = settings_.FirstSample;
+	state.TileSize = tile_size_;
+	state.NextEventEstimation = settings_.NextEventEstimation;
+	state.MaxDepth = settings_.MaxDepth;
+	state.RussianRoulette = settings_.RussianRoulette;
+	state.RouletteDepth = settings_.RouletteDepth;
+	state.AdaptiveSampling = settings_.AdaptiveSampling;
+	state.NoiseThreshold = settings_.NoiseThreshold;
+	state.MinSamples = settings_.MinSamples;
+	state.MaxSamplesPerFrame = settings_.MaxSamplesPerFrame;
+
+	state.Accumulation.assign(accumulation_.GetData(), accumulation_.GetData() + accumulation_.GetSize());
+	state.SampleCounts.assign(sample_counts_.Data(), sample_counts_.Data() + pixels);
+
+	// the variance only steers adaptive sampling, without it the state is a third smaller
+	if (settings_.AdaptiveSampling)
+	{
+		const float* variance = (const float*)variance_data_.Data();
+		state.Variance.assign(variance, variance + pixels * 2);
+		state.TileConverged = tile_converged_;
 	}
 	else
 	{
-		final_image_ = std::make_shared<Walnut::Image>(width, height, Walnut::ImageFormat::RGBA);
+		state.Variance.clear();
+		state.TileConverged.clear();
 	}
+	return true;
+}
 
-	// allocate image size
-	delete[] image_data_;
-	image_data_ = new uint32_t[width * height];
+bool Renderer::SetAccumulationState(const AccumulationState& state, std::string* error)
+{
+	auto fail = [error](const std::string& message)
+		{
+			if (error)
+				*error = message;
+			return false;
+		};
 
-	// allocate accumulation data size
-	delete[] accumulation_data_;
-	accumulation_data_ = new glm::vec4[width * height];
+	if (state.Width != width_ || state.Height != height_)
+		return fail("state is " + std::to_string(state.Width) + "x" + std::to_string(state.Height) +
+			", the renderer " + std::to_string(width_) + "x" + std::to_string(height_));
+
+	size_t pixels = (size_t)width_ * height_;
+	uint32_t tiles_x = (width_ + state.TileSize - 1) / std::max(state.TileSize, 1u);
+	uint32_t tiles_y = (height_ + state.TileSize - 1) / std::max(state.TileSize, 1u);
+
+	if (state.FrameIndex < 2 || state.TileSize == 0 || state.Accumulation.size() != pixels * GetAccumulationBytesPerPixel(state.Format) ||
+		state.SampleCounts.size() != pixels)
+		return fail("state holds no samples or is inconsistent");
+
+	if (state.AdaptiveSampling && (state.Variance.size() != pixels * 2 || state.TileConverged.size() != (size_t)tiles_x * tiles_y))
+		return fail("state has no adaptive sampling data");
+
+	settings_.Accumulation = state.Format;
+	settings_.FirstSample = state.FirstSample;
+	settings_.TileSize = state.TileSize;
+	settings_.NextEventEstimation = state.NextEventEstimation;
+	settings_.MaxDepth = state.MaxDepth;
+	settings_.RussianRoulette = state.RussianRoulette;
+	settings_.RouletteDepth = state.RouletteDepth;
+	settings_.AdaptiveSampling = state.AdaptiveSampling;
+	settings_.NoiseThreshold = state.NoiseThreshold;
+	settings_.MinSamples = state.MinSamples;
+	settings_.MaxSamplesPerFrame = state.MaxSamplesPerFrame;
+	settings_.Accumulate = true;
+
+	// the random streams continue from the same seed, even one this renderer did not pick
+	settings_.DeterministicSeed = true;
+	settings_.Seed = state.Seed;
+	seed_ = state.Seed;
+	sample_offset_ = state.SampleOffset;
+
+	accumulation_.Resize((uint32_t)pixels, state.Format);
+	accumulation_.Assign(state.Accumulation.data());
+	memcpy(sample_counts_.Data(), state.SampleCounts.data(), pixels * sizeof(uint32_t));
+
+	if (tile_size_ != settings_.TileSize)
+	{
+		BuildTiles();
+	}
+
+	if (state.AdaptiveSampling)
+	{
+		memcpy(variance_data_.Data(), state.Variance.data(), pixels * sizeof(PixelVariance));
+		tile_converged_ = state.TileConverged;
+	}
+	else
+	{
+		memset(variance_data_.Data(), 0, pixels * sizeof(PixelVariance));
+		std::fill(tile_converged_.begin(), tile_converged_.end(), (uint8_t)0);
+	}
+	UpdateConvergedRatio();
+
+	frame_index_ = state.FrameIndex;
+	has_samples_ = true;
+	aovs_valid_ = false;
+	camera_moving_ = false;
+	reproject_ = false;
+	restored_ = true;
+	return true;
+}
+
+bool Renderer::RenderTile(const Tile& tile, uint32_t samples, std::vector<BounceStats>* stats)
+{
+	bool converged = true;
+
+	glm::vec3 directions[utility::kRayBatch];
+
+	for (uint32_t y = tile.MinY; y < tile.MaxY; y++)
+	{
+		for (uint32_t x = tile.MinX; x < tile.MaxX; x++)
+		{
+			// primary ray directions for the next run of pixels in this row
+			uint32_t batch_index = (x - tile.MinX) % utility::kRayBatch;
+			if (batch_index == 0)
+			{
+				active_camera_->GetRayDirections(y, x, std::min(utility::kRayBatch, tile.MaxX - x), directions);
+			}
+
+			uint32_t pixel = x + y * width_;
+
+			for (uint32_t i = 0; i < samples; i++)
+			{
+				// set color to each pixel
+				glm::vec4 color = RayGen(x, y, directions[batch_index], sample_counts_[pixel] + 1 + sample_offset_ + settings_.FirstSample, stats);
+				AccumulateSample(pixel, glm::vec3(color));
+			}
+
+			converged = IsPixelConverged(pixel) && converged;
+		}
+	}
+
+	return converged;
+}
+
+bool Renderer::RenderTileWavefront(const Tile& tile, uint32_t samples, std::vector<BounceStats>* stats, WavefrontBuffers& buffers)
+{
+	uint32_t tile_width = tile.MaxX - tile.MinX;
+	uint32_t paths = tile_width * (tile.MaxY - tile.MinY) * samples;
+	buffers.Resize(paths);
+
+	int bounces = (int)std::max(settings_.MaxDepth, 1u);
+	if (stats && stats->size() < (size_t)bounces)
+	{
+		stats->resize(bounces);
+	}
+
+	// generate, one primary ray per path, the samples of a pixel are neighbours
+	glm::vec3 origin = active_camera_->GetPosition();
+	glm::vec3 directions[utility::kRayBatch];
+
+	uint32_t path = 0;
+	for (uint32_t y = tile.MinY; y < tile.MaxY; y++)
+	{
+		for (uint32_t x = tile.MinX; x < tile.MaxX; x++)
+		{
+			uint32_t batch_index = (x - tile.MinX) % utility::kRayBatch;
+			if (batch_index == 0)
+			{
+				active_camera_->GetRayDirections(y, x, std::min(utility::kRayBatch, tile.MaxX - x), directions);
+			}
+
+			const glm::vec3& direction = directions[batch_index];
+			for (uint32_t i = 0; i < samples; i++, path++)
+			{
+				buffers.Light[path] = glm::vec3(0.0f);
+				buffers.Throughput[path] = glm::vec3(1.0f);
+				buffers.BouncePdf[path] = 0.0f;
+
+				buffers.OriginX[path] = origin.x;
+				buffers.OriginY[path] = origin.y;
+				buffers.OriginZ[path] = origin.z;
+				buffers.DirectionX[path] = direction.x;
+				buffers.DirectionY[path] = direction.y;
+				buffers.DirectionZ[path] = direction.z;
+				buffers.Path[path] = path;
+			}
+		}
+	}
+
+	uint32_t ray_count = paths;
+	for (int bounce = 0; bounce < bounces && ray_count > 0; bounce++)
+	{
+		// extend, closest hit of every ray
+		auto start = std::chrono::steady_clock::now();
+
+		RT_PROFILE_RAYS((uint32_t)bounce, ray_count);
+		{
+			RT_PROFILE_SCOPE(Extend);
+			for (uint32_t i = 0; i < ray_count; i++)
+			{
+				Ray ray;
+				ray.Origin = { buffers.OriginX[i], buffers.OriginY[i], buffers.OriginZ[i] };
+				ray.Direction = { buffers.DirectionX[i], buffers.DirectionY[i], buffers.DirectionZ[i] };
+
+				HitInfo hit;
+				Intersect(ray, hit);
+				buffers.HitObject[i] = hit.ObjectIndex;
+				buffers.HitDistance[i] = hit.HitDistance;
+				buffers.HitType[i] = hit.Type;
+				buffers.HitPrimitive[i] = hit.PrimitiveIndex;
+				buffers.HitInstance[i] = hit.InstanceIndex;
+			}
+		}
+
+		if (stats)
+		{
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			(*stats)[bounce].Rays += ray_count;
+			(*stats)[bounce].Milliseconds += elapsed.count();
+		}
+
+		// shade, same arithmetic as RayGen, and queue the surviving paths for the next bounce
+		RT_PROFILE_SCOPE(Shade);
+		bool last_bounce = bounce + 1 == bounces;
+		bool roulette = settings_.RussianRoulette && settings_.NextEventEstimation && (uint32_t)bounce + 1 >= settings_.RouletteDepth;
+		uint32_t next_count = 0;
+		uint32_t shadow_count = 0;
+		for (uint32_t i = 0; i < ray_count; i++)
+		{
+			uint32_t path_index = buffers.Path[i];
+			glm::vec3& light = buffers.Light[path_index];
+			glm::vec3& throughput = buffers.Throughput[path_index];
+
+			int object_index = buffers.HitObject[i];
+			if (object_index < 0)
+			{
+				light += utility::kBackgroundColor * throughput;
+				continue;
+			}
+
+			Ray ray;
+			ray.Origin = { buffers.OriginX[i], buffers.OriginY[i], buffers.OriginZ[i] };
+			ray.Direction = { buffers.DirectionX[i], buffers.DirectionY[i], buffers.DirectionZ[i] };
+			HitInfo hit;
+			hit.HitDistance = buffers.HitDistance[i];
+			hit.Type = buffers.HitType[i];
+			hit.ObjectIndex = object_index;
+			hit.PrimitiveIndex = buffers.HitPrimitive[i];
+			hit.InstanceIndex = buffers.HitInstance[i];
+			HitInfo payload = ClosestHit(ray, hit);
+
+			const Material& material = active_scene_->Materials[payload.MaterialIndex];
+
+			// the path's pixel and sample number give the same random stream as RayGen
+			uint32_t local_pixel = path_index / samples;
+			uint32_t pixel = tile.MinX + local_pixel % tile_width + (tile.MinY + local_pixel / tile_width) * width_;
+			uint32_t sample = sample_counts_[pixel] + 1 + path_index % samples + sample_offset_ + settings_.FirstSample;
+			RNG rng(seed_, pixel, sample, (uint32_t)bounce);
+
+			if (settings_.NextEventEstimation)
+			{
+				float weight = bounce == 0 ? 1.0f : GetEmissionWeight(payload, ray.Origin, buffers.BouncePdf[path_index]);
+				light += throughput * material.GetEmission() * weight;
+
+				// the light sample is added once its shadow ray has been traced with the others
+				Ray shadow_ray;
+				float max_distance;
+				glm::vec3 contribution;
+				if (SampleLight(payload, material, rng, shadow_ray, max_distance, contribution))
+				{
+					buffers.ShadowRays[shadow_count] = shadow_ray;
+					buffers.ShadowDistance[shadow_count] = max_distance;
+					buffers.ShadowLight[shadow_count] = throughput * contribution;
+					buffers.ShadowPath[shadow_count] = path_index;
+					shadow_count++;
+				}
+
+				throughput *= material.Albedo;
+			}
+			else
+			{
+				throughput *= material.Albedo;
+				light += material.GetEmission();
+			}
+
+			if (last_bounce)
+				continue;
+
+			glm::vec3 next_origin = payload.WorldPosition + payload.WorldNormal * utility::kRayOffset;
+			glm::vec3 next_direction = glm::normalize(payload.WorldNormal) + rng.OnUnitSphere();
+
+			if (settings_.NextEventEstimation)
+			{
+				float cosine = glm::dot(glm::normalize(payload.WorldNormal), glm::normalize(next_direction));
+				buffers.BouncePdf[path_index] = glm::max(cosine, 0.0f) / utility::kPi;
+			}
+
+			if (roulette && !utility::SurviveRoulette(rng, throughput))
+			{
+				if (stats)
+					(*stats)[bounce].Terminated++;
+				continue;
+			}
+
+			buffers.NextOriginX[next_count] = next_origin.x;
+			buffers.NextOriginY[next_count] = next_origin.y;
+			buffers.NextOriginZ[next_count] = next_origin.z;
+			buffers.NextDirectionX[next_count] = next_direction.x;
+			buffers.NextDirectionY[next_count] = next_direction.y;
+			buffers.NextDirectionZ[next_count] = next_direction.z;
+			buffers.NextPath[next_count] = path_index;
+			next_count++;
+		}
+
+		// shadow rays, a path has at most one per bounce so its light still adds up in the same order as in RayGen
+		if (shadow_count > 0)
+		{
+			IsOccluded(buffers.ShadowRays.data(), buffers.ShadowDistance.data(), shadow_count, buffers.ShadowOccluded.data());
+			for (uint32_t i = 0; i < shadow_count; i++)
+			{
+				if (!buffers.ShadowOccluded[i])
+					buffers.Light[buffers.ShadowPath[i]] += buffers.ShadowLight[i];
+			}
+		}
+
+		// the next bounce's rays become the current ones
+		if (settings_.SortRays)
+		{
+			SortWavefrontRays(buffers, next_count);
+		}
+		else
+		{
+			std::swap(buffers.OriginX, buffers.NextOriginX);
+			std::swap(buffers.OriginY, buffers.NextOriginY);
+			std::swap(buffers.OriginZ, buffers.NextOriginZ);
+			std::swap(buffers.DirectionX, buffers.NextDirectionX);
+			std::swap(buffers.DirectionY, buffers.NextDirectionY);
+			std::swap(buffers.DirectionZ, buffers.NextDirectionZ);
+			std::swap(buffers.Path, buffers.NextPath);
+		}
+		ray_count = next_count;
+	}
+
+	// accumulate in path order, which is the order RenderTile adds samples in
+	bool converged = true;
+	path = 0;
+	for (uint32_t y = tile.MinY; y < tile.MaxY; y++)
+	{
+		for (uint32_t x = tile.MinX; x < tile.MaxX; x++)
+		{
+			uint32_t pixel = x + y * width_;
+			for (uint32_t i = 0; i < samples; i++, path++)
+			{
+				AccumulateSample(pixel, buffers.Light[path]);
+			}
+
+			converged = IsPixelConverged(pixel) && converged;
+		}
+	}
+
+	return converged;
+}
+
+void Renderer::SortWavefrontRays(WavefrontBuffers& buffers, uint32_t count)
+{
+	// 8 octants times 3 major axes
+	constexpr uint32_t kBuckets = 24;
+	uint32_t offsets[kBuckets] = {};
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		float x = buffers.NextDirectionX[i], y = buffers.NextDirectionY[i], z = buffers.NextDirectionZ[i];
+		uint32_t octant = (x < 0.0f ? 1u : 0u) | (y < 0.0f ? 2u : 0u) | (z < 0.0f ? 4u : 0u);
+
+		float ax = glm::abs(x), ay = glm::abs(y), az = glm::abs(z);
+		uint32_t axis = ax >= ay && ax >= az ? 0u : (ay >= az ? 1u : 2u);
+
+		uint8_t key = (uint8_t)(octant * 3 + axis);
+		buffers.SortKey[i] = key;
+		offsets[key]++;
+	}
+
+	// exclusive prefix sum gives each bucket's first slot
+	uint32_t sum = 0;
+	for (uint32_t& offset : offsets)
+	{
+		uint32_t bucket_count = offset;
+		offset = sum;
+		sum += bucket_count;
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t slot = offsets[buffers.SortKey[i]]++;
+		buffers.OriginX[slot] = buffers.NextOriginX[i];
+		buffers.OriginY[slot] = buffers.NextOriginY[i];
+		buffers.OriginZ[slot] = buffers.NextOriginZ[i];
+		buffers.DirectionX[slot] = buffers.NextDirectionX[i];
+		buffers.DirectionY[slot] = buffers.NextDirectionY[i];
+		buffers.DirectionZ[slot] = buffers.NextDirectionZ[i];
+		buffers.Path[slot] = buffers.NextPath[i];
+	}
+}
+
+void Renderer::WavefrontBuffers::Resize(size_t paths)
+{
+	if (Light.size() >= paths)
+		return;
+
+	for (std::vector<glm::vec3>* buffer : { &Light, &Throughput, &ShadowLight })
+		buffer->resize(paths);
+
+	BouncePdf.resize(paths);
+
+	for (std::vector<float>* buffer : { &OriginX, &OriginY, &OriginZ, &DirectionX, &DirectionY, &DirectionZ,
+		&NextOriginX, &NextOriginY, &NextOriginZ, &NextDirectionX, &NextDirectionY, &NextDirectionZ, &HitDistance })
+		buffer->resize(paths);
+
+	for (std::vector<uint32_t>* buffer : { &Path, &NextPath, &ShadowPath })
+		buffer->resize(paths);
+
+	ShadowRays.resize(paths);
+	ShadowDistance.resize(paths);
+	ShadowOccluded.resize(paths);
+
+	HitObject.resize(paths);
+	HitType.resize(paths);
+	HitPrimitive.resize(paths);
+	HitInstance.resize(paths);
+	SortKey.resize(paths);
+}
+
+void Renderer::AccumulateSample(uint32_t pixel, const glm::vec3& color)
+{
+	RT_PROFILE_SCOPE(Accumulate);
+	RT_PROFILE_COUNT(Samples, 1);
+
+	uint32_t& sample_count = sample_counts_[pixel];
+	PixelVariance& variance = variance_data_[pixel];
+
+	// accumulate colour to be returned
+	sample_count++;
+	accumulation_.Add(pixel, color, sample_count);
 
-	// set values for x and y iterators
-	image_x_iterator_.resize(width);
-	image_y_iterator_.resize(height);
+	// running luminance variance
+	float luminance = utility::Luminance(color);
+	float delta = luminance - variance.Mean;
+	variance.Mean += delta / (float)sample_count;
+	variance.M2 += delta * (luminance - variance.Mean);
+}
+
+void Renderer::Resolve()
+{
+	if (!has_samples_ || !thread_pool_)
+		return;
+
+	if (settings_.Denoise && aovs_valid_)
+	{
+		ResolveDenoised();
+	}
+	else
+	{
+		RT_PROFILE_SCOPE(Resolve);
+
+		// a row is long enough to amortise handing it to a thread
+		thread_pool_->ParallelFor(height_, [this](uint32_t y, uint32_t /*worker*/)
+			{
+				uint32_t first = y * width_;
+				accumulation_.Resolve(first, width_, sample_counts_.Data() + first, image_data_.Data() + first, settings_.Display);
+			});
+	}
+
+	if (sink_)
+	{
+		RT_PROFILE_SCOPE(Upload);
+		sink_->SetData(image_data_.Data(), width_, height_);
+	}
+}
+
+void Renderer::ResolveDenoised()
+{
+	denoiser_.Resize(width_, height_);
+
+	{
+		RT_PROFILE_SCOPE(Resolve);
+
+		glm::vec4* input = denoiser_.GetInput();
+		thread_pool_->ParallelFor(height_, [this, input](uint32_t y, uint32_t /*worker*/)
+			{
+				for (uint32_t x = 0; x < width_; x++)
+				{
+					uint32_t pixel = x + y * width_;
+					uint32_t sample_count = sample_counts_[pixel];
+					glm::vec3 mean = sample_count > 0 ? accumulation_.GetMean(pixel, sample_count) : glm::vec3(0.0f);
+
+					// variance of the mean, unknown below two samples, where it must not stop the filter
+					const PixelVariance& variance = variance_data_[pixel];
+					float mean_variance = sample_count > 1
+						? variance.M2 / ((float)(sample_count - 1) * (float)sample_count)
+						: utility::kUnknownVariance;
+
+					input[pixel] = glm::vec4(mean, mean_variance);
+				}
+			});
+	}
+
+	{
+		RT_PROFILE_SCOPE(Denoise);
+
+		Denoiser::Guides guides;
+		guides.Albedo = aov_albedo_.Data();
+		guides.Normal = aov_normal_.Data();
+		guides.Depth = aov_depth_.Data();
+		denoiser_.Denoise(*thread_pool_, guides, settings_.DenoisePasses);
+	}
+
+	{
+		RT_PROFILE_SCOPE(Resolve);
+
+		const glm::vec4* output = denoiser_.GetOutput();
+		thread_pool_->ParallelFor(height_, [this, output](uint32_t y, uint32_t /*worker*/)
+			{
+				for (uint32_t x = 0; x < width_; x++)
+				{
+					uint32_t pixel = x + y * width_;
+					image_data_[pixel] = AccumulationBuffer::ToRGBA(glm::vec3(output[pixel]), settings_.Display);
+				}
+			});
+	}
+}
+
+void Renderer::RenderAOVs()
+{
+	uint32_t pixels = width_ * height_;
+	aov_albedo_.Resize(pixels);
+	aov_normal_.Resize(pixels);
+	aov_depth_.Resize(pixels);
+	aov_surface_.Resize(pixels);
+
+	thread_pool_->ParallelFor((uint32_t)tiles_.size(), [this](uint32_t tile_index, uint32_t /*worker*/)
+		{
+			RenderAOVTile(tiles_[tile_index]);
+		});
+
+	aov_view_projection_ = active_camera_->GetProjection() * active_camera_->GetView();
+	aov_position_ = active_camera_->GetPosition();
+	aovs_valid_ = true;
+}
+
+void Renderer::RenderAOVTile(const Tile& tile)
+{
+	glm::vec3 directions[utility::kRayBatch];
+
+	for (uint32_t y = tile.MinY; y < tile.MaxY; y++)
+	{
+		for (uint32_t x = tile.MinX; x < tile.MaxX; x++)
+		{
+			uint32_t batch_index = (x - tile.MinX) % utility::kRayBatch;
+			if (batch_index == 0)
+			{
+				active_camera_->GetRayDirections(y, x, std::min(utility::kRayBatch, tile.MaxX - x), directions);
+			}
 
-	for (uint32_t i = 0; i < width; i++)
+			Ray ray;
+			ray.Origin = active_camera_->GetPosition();
+			ray.Direction = directions[batch_index];
+
+			uint32_t pixel = x + y * width_;
+			HitInfo payload = TraceRay(ray);
+			if (payload.HitDistance < 0.0f)
+			{
+				aov_albedo_[pixel] = utility::kBackgroundColor;
+				aov_normal_[pixel] = glm::vec3(0.0f);
+				aov_depth_[pixel] = -1.0f;
+				aov_surface_[pixel] = ~0u;
+				continue;
+			}
+
+			aov_albedo_[pixel] = active_scene_->Materials[payload.MaterialIndex].Albedo;
+			aov_normal_[pixel] = glm::normalize(payload.WorldNormal);
+			aov_depth_[pixel] = payload.HitDistance;
+			aov_surface_[pixel] = ((uint32_t)(payload.InstanceIndex + 1) * 0x9e3779b9u) ^
+				((uint32_t)payload.ObjectIndex << 1) ^ (uint32_t)payload.Type;
+		}
+	}
+}
+
+void Renderer::Reproject()
+{
+	RT_PROFILE_SCOPE(Reproject);
+
+	uint32_t pixels = width_ * height_;
+
+	// the old view's first hits become the history, the new view's are traced in their place
+	aov_normal_.Swap(history_normal_);
+	aov_depth_.Swap(history_depth_);
+	aov_surface_.Swap(history_surface_);
+	glm::mat4 history_view_projection = aov_view_projection_;
+	glm::vec3 history_position = aov_position_;
+	RenderAOVs();
+
+	// the samples too, every pixel of the new buffers is written below
+	history_accumulation_.Resize(pixels, accumulation_.GetFormat());
+	history_counts_.Resize(pixels);
+	history_variance_.Resize(pixels);
+	accumulation_.Swap(history_accumulation_);
+	sample_counts_.Swap(history_counts_);
+	variance_data_.Swap(history_variance_);
+
+	uint32_t max_samples = std::max(settings_.MaxReprojectedSamples, 1u);
+	glm::vec3 origin = active_camera_->GetPosition();
+
+	thread_pool_->ParallelFor(height_, [&](uint32_t y, uint32_t /*worker*/)
+		{
+			glm::vec3 directions[utility::kRayBatch];
+
+			for (uint32_t x = 0; x < width_; x++)
+			{
+				uint32_t batch_index = x % utility::kRayBatch;
+				if (batch_index == 0)
+				{
+					active_camera_->GetRayDirections(y, x, std::min(utility::kRayBatch, width_ - x), directions);
+				}
+
+				uint32_t pixel = x + y * width_;
+				sample_counts_[pixel] = 0;
+				variance_data_[pixel] = { 0.0f, 0.0f };
+
+				float depth = aov_depth_[pixel];
+				if (depth < 0.0f)
+					continue;
+
+				// where the first hit was in the previous view
+				glm::vec3 position = origin + directions[batch_index] * depth;
+				glm::vec4 clip = history_view_projection * glm::vec4(position, 1.0f);
+				if (clip.w <= 0.0f)
+					continue;
+
+				// pixel x's ray goes through x / width * 2 - 1, so pixel centres are at whole coordinates
+				float u = (clip.x / clip.w + 1.0f) * 0.5f * (float)width_;
+				float v = (clip.y / clip.w + 1.0f) * 0.5f * (float)height_;
+				float expected_depth = glm::length(position - history_position);
+				const glm::vec3& normal = aov_normal_[pixel];
+				uint32_t surface = aov_surface_[pixel];
+
+				// bilinear over the four history pixels around it, leaving out those of another surface
+				int x0 = (int)std::floor(u), y0 = (int)std::floor(v);
+				float fx = u - (float)x0, fy = v - (float)y0;
+
+				glm::vec3 mean(0.0f);
+				float count = 0.0f, luminance = 0.0f, sample_variance = 0.0f, total_weight = 0.0f;
+				for (int i = 0; i < 4; i++)
+				{
+					int sx = x0 + (i & 1), sy = y0 + (i >> 1);
+					float weight = ((i & 1) ? fx : 1.0f - fx) * ((i >> 1) ? fy : 1.0f - fy);
+					if (weight <= 0.0f || sx < 0 || sy < 0 || sx >= (int)width_ || sy >= (int)height_)
+						continue;
+
+					uint32_t sample = (uint32_t)sx + (uint32_t)sy * width_;
+					uint32_t sample_count = history_counts_[sample];
+					float sample_depth = history_depth_[sample];
+					if (sample_count == 0 || sample_depth < 0.0f || history_surface_[sample] != surface ||
+						std::abs(sample_depth - expected_depth) > utility::kReprojectionDepthTolerance * expected_depth ||
+						glm::dot(history_normal_[sample], normal) < utility::kReprojectionNormalTolerance)
+						continue;
+
+					const PixelVariance& variance = history_variance_[sample];
+					mean += history_accumulation_.GetMean(sample, sample_count) * weight;
+					count += (float)sample_count * weight;
+					luminance += variance.Mean * weight;
+					if (sample_count > 1)
+						sample_variance += variance.M2 / (float)(sample_count - 1) * weight;
+					total_weight += weight;
+				}
+
+				if (total_weight <= 0.0f)
+					continue;
+
+				// the blended samples count as many as their pixels had on average, up to the cap
+				uint32_t sample_count = std::clamp((uint32_t)(count / total_weight + 0.5f), 1u, max_samples);
+				accumulation_.Set(pixel, mean / total_weight, sample_count);
+				sample_counts_[pixel] = sample_count;
+				variance_data_[pixel].Mean = luminance / total_weight;
+				variance_data_[pixel].M2 = sample_variance / total_weight * (float)(sample_count - 1);
+			}
+		});
+
+	// every tile has to prove it has converged again in the new view
+	std::fill(tile_converged_.begin(), tile_converged_.end(), (uint8_t)0);
+	UpdateConvergedRatio();
+}
+
+void Renderer::RenderPreview()
+{
+	RT_PROFILE_SCOPE(Preview);
+	Walnut::Timer timer;
+
+	uint32_t scale = preview_scale_;
+	thread_pool_->ParallelFor((uint32_t)tiles_.size(), [this, scale](uint32_t tile_index, uint32_t /*worker*/)
+		{
+			RenderPreviewTile(tiles_[tile_index], scale);
+		});
+
+	// pick the block size for the next moving frame
+	// halving the block size costs about four times as much
+	float elapsed = timer.ElapsedMillis();
+	if (elapsed > settings_.PreviewFrameBudget && preview_scale_ < utility::kMaxPreviewScale)
+	{
+		preview_scale_ *= 2;
+	}
+	else if (elapsed * 4.0f < settings_.PreviewFrameBudget && preview_scale_ > 1)
 	{
-		image_x_iterator_[i] = i;
+		preview_scale_ /= 2;
 	}
 
-	for (uint32_t i = 0; i < height; i++)
+	sample_offset_++;
+}
+
+void Renderer::RenderPreviewTile(const Tile& tile, uint32_t scale)
+{
+	// blocks are aligned to the image, a block belongs to the tile holding its first pixel
+	uint32_t first_x = (tile.MinX + scale - 1) / scale * scale;
+	uint32_t first_y = (tile.MinY + scale - 1) / scale * scale;
+
+	for (uint32_t block_y = first_y; block_y < tile.MaxY; block_y += scale)
 	{
-		image_y_iterator_[i] = i;
+		for (uint32_t block_x = first_x; block_x < tile.MaxX; block_x += scale)
+		{
+			uint32_t end_x = std::min(block_x + scale, width_);
+			uint32_t end_y = std::min(block_y + scale, height_);
+
+			// trace through the centre of the block
+			uint32_t x = std::min(block_x + scale / 2, end_x - 1);
+			uint32_t y = std::min(block_y + scale / 2, end_y - 1);
+			glm::vec4 color = RayGen(x, y, active_camera_->GetRayDirection(x, y), 1 + sample_offset_, nullptr);
+			uint32_t rgba = AccumulationBuffer::ToRGBA(glm::vec3(color), settings_.Display);
+
+			// nearest neighbour upsampling
+			for (uint32_t py = block_y; py < end_y; py++)
+			{
+				std::fill(image_data_.Data() + py * width_ + block_x, image_data_.Data() + py * width_ + end_x, rgba);
+			}
+		}
 	}
 }
 
-void Renderer::Render(const Scene& scene, const Camera& camera)
+std::vector<Renderer::BounceStats> Renderer::GetBounceStats() const
 {
-	active_scene_ = &scene;
-	active_camera_ = &camera;
-
-	// reset accumulation data on first frame
-	if (frame_index_ == 1)
+	std::vector<BounceStats> total;
+	for (const std::vector<BounceStats>& worker : worker_stats_)
 	{
-		memset(accumulation_data_, 0, final_image_->GetWidth() * final_image_->GetHeight() * sizeof(glm::vec4));
+		if (total.size() < worker.size())
+		{
+			total.resize(worker.size());
+		}
+
+		for (size_t i = 0; i < worker.size(); i++)
+		{
+			total[i].Rays += worker[i].Rays;
+			total[i].Milliseconds += worker[i].Milliseconds;
+			total[i].Terminated += worker[i].Terminated;
+		}
 	}
+	return total;
+}
 
-	// multithreaded rendering
+bool Renderer::IsPixelConverged(uint32_t pixel) const
+{
+	uint32_t sample_count = sample_counts_[pixel];
+	if (sample_count < std::max(settings_.MinSamples, 2u))
+		return false;
 
-	std::for_each(
-		// set execution policy to parallel
-		std::execution::par,
-		image_y_iterator_.begin(), 
-		image_y_iterator_.end(),
-		[this](uint32_t y)
-		{
-			std::for_each(
-				std::execution::par,
-				image_x_iterator_.begin(),
-				image_x_iterator_.end(),
-				[this, y](uint32_t x)
-				{
-					// set color to each pixel
-					glm::vec4 color = RayGen(x, y);
+	// standard error of the mean, relative to the mean
+	const PixelVariance& variance = variance_data_[pixel];
+	float sample_variance = variance.M2 / (float)(sample_count - 1);
+	float error = glm::sqrt(sample_variance / (float)sample_count);
 
-					// accumulate colour to be returned
-					accumulation_data_[x + y * final_image_->GetWidth()] += color;
-					glm::vec4 accumulated_color = accumulation_data_[x + y * final_image_->GetWidth()];
-					accumulated_color /= (float)frame_index_;
+	return error < settings_.NoiseThreshold * std::max(variance.Mean, utility::kMinLuminance);
+}
 
-					// clamp range to between 0 and 1
-					accumulated_color = glm::clamp(accumulated_color, glm::vec4(0.0f), glm::vec4(1.0f));
+void Renderer::BuildTiles()
+{
+	tile_size_ = std::max(settings_.TileSize, 1u);
 
-					// send color to image data
-					image_data_[x + y * final_image_->GetWidth()] = utility::ConvertToRGBA(accumulated_color);
-				});
-		});
+	uint32_t tiles_x = (width_ + tile_size_ - 1) / tile_size_;
+	uint32_t tiles_y = (height_ + tile_size_ - 1) / tile_size_;
 
-	final_image_->SetData(image_data_);
+	tiles_.clear();
+	tiles_.reserve(tiles_x * tiles_y);
 
-	// increments frame index if accumulation is turned on
-	if (settings_.Accumulate == true)
-	{
-		frame_index_++;
-	}
-	else
+	for (uint32_t ty = 0; ty < tiles_y; ty++)
 	{
-		//ResetFrameIndex();
-		frame_index_ = 1;
+		for (uint32_t tx = 0; tx < tiles_x; tx++)
+		{
+			Tile tile;
+			tile.MinX = tx * tile_size_;
+			tile.MinY = ty * tile_size_;
+			tile.MaxX = std::min(tile.MinX + tile_size_, width_);
+			tile.MaxY = std::min(tile.MinY + tile_size_, height_);
+			tiles_.push_back(tile);
+		}
 	}
+
+	// neighbouring tiles end up close together in the list,
+	// so each thread's share of the list covers a compact area of the image
+	std::sort(tiles_.begin(), tiles_.end(), [this](const Tile& a, const Tile& b)
+		{
+			return utility::MortonCode(a.MinX / tile_size_, a.MinY / tile_size_) < utility::MortonCode(b.MinX / tile_size_, b.MinY / tile_size_);
+		});
+
+	tile_times_.assign(tiles_.size(), 0.0f);
+	tile_converged_.assign(tiles_.size(), 0);
 }
 
-glm::vec4 Renderer::RayGen(uint32_t x, uint32_t y)
+glm::vec4 Renderer::RayGen(uint32_t x, uint32_t y, const glm::vec3& direction, uint32_t sample, std::vector<BounceStats>* stats)
 {
+	RT_PROFILE_SCOPE(RayGen);
+
 	// generate ray & set origin and direction
 	Ray ray;
 	ray.Origin = active_camera_->GetPosition();
-	ray.Direction = active_camera_->GetRayDirections()[x + y * final_image_->GetWidth()];
+	ray.Direction = direction;
 
 	// final colour to be returned
 	glm::vec3 light(0.0f);
@@ -136,38 +1203,78 @@ glm::vec4 Renderer::RayGen(uint32_t x, uint32_t y)
 	// colour contribution of the ray
 	glm::vec3 throughput{ 1.0f };
 
-	int bounces = 5;
+	uint32_t pixel = x + y * width_;
+
+	// solid angle pdf of the last bounce direction, for next event estimation
+	float bounce_pdf = 0.0f;
+
+	int bounces = (int)std::max(settings_.MaxDepth, 1u);
+	if (stats && stats->size() < (size_t)bounces)
+	{
+		stats->resize(bounces);
+	}
+
 	for (int i = 0; i < bounces; i++)
 	{
+		// independent random stream for this pixel, sample and bounce
+		RNG rng(seed_, pixel, sample, (uint32_t)i);
+		RT_PROFILE_RAYS((uint32_t)i, 1);
+
 		// get payload from trace ray
-		Renderer::HitInfo payload = TraceRay(ray);
+		Renderer::HitInfo payload;
+		if (stats)
+		{
+			auto start = std::chrono::steady_clock::now();
+			payload = TraceRay(ray);
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+			(*stats)[i].Rays++;
+			(*stats)[i].Milliseconds += elapsed.count();
+		}
+		else
+		{
+			payload = TraceRay(ray);
+		}
 		if (payload.HitDistance < 0.0f)
 		{
 			// demo: background colour
 			//glm::vec3 background_color = glm::vec3(1.0f, 0.0f, 0.0f);
-			glm::vec3 background_color = glm::vec3(0.529f, 0.808f, 0.922f);
+			glm::vec3 background_color = utility::kBackgroundColor;
 
 			// take into account background colour when rendering
 			light += background_color * throughput;
 			break;
 		}
 
-		// intersected sphere
-		const Sphere& sphere = active_scene_->Spheres[payload.ObjectIndex];
-		// associated material
-		const Material& material = active_scene_->Materials[sphere.MaterialIndex];
-
-		glm::vec3 sphere_color = material.Albedo;
+		// material of the intersected sphere or mesh
+		const Material& material = active_scene_->Materials[payload.MaterialIndex];
 
 		// darken the image by throughput
 		//light += material.Albedo * throughput;
 
-		// absorb material albedo
-		throughput *= material.Albedo;
-		light += material.GetEmission();
+		if (settings_.NextEventEstimation)
+		{
+			// emission the bounce ray found, shared with the previous bounce's light sample
+			float weight = i == 0 ? 1.0f : GetEmissionWeight(payload, ray.Origin, bounce_pdf);
+			light += throughput * material.GetEmission() * weight;
+
+			Ray shadow_ray;
+			float max_distance;
+			glm::vec3 contribution;
+			if (SampleLight(payload, material, rng, shadow_ray, max_distance, contribution) && !IsOccluded(shadow_ray, max_distance))
+				light += throughput * contribution;
+
+			throughput *= material.Albedo;
+		}
+		else
+		{
+			// absorb material albedo
+			throughput *= material.Albedo;
+			light += material.GetEmission();
+		}
 
 		// change origin and direction for the next bounce
-		ray.Origin = payload.WorldPosition + payload.WorldNormal * 0.0001f;
+		ray.Origin = payload.WorldPosition + payload.WorldNormal * utility::kRayOffset;
 
 		// demo: reflectance
 		// reflect according to the microfacet model
@@ -175,13 +1282,30 @@ glm::vec4 Renderer::RayGen(uint32_t x, uint32_t y)
 
 		/*
 		ray.Direction = glm::reflect(ray.Direction, 
-			payload.WorldNormal + material.Roughness * Walnut::Random::Vec3(-0.5f, 0.5f));
+			payload.WorldNormal + material.Roughness * rng.Vec3(-0.5f, 0.5f));
 		*/
 		
 
 		// demo: emissivity
 		// return a random direction, with is biased towards the normal
-		ray.Direction = glm::normalize(payload.WorldNormal) + Walnut::Random::InUnitSphere();
+		// the normal plus a uniform unit vector is cosine distributed around the normal, which the
+		// albedo only throughput and the pdf below rely on
+		ray.Direction = glm::normalize(payload.WorldNormal) + rng.OnUnitSphere();
+
+		if (settings_.NextEventEstimation)
+		{
+			float cosine = glm::dot(glm::normalize(payload.WorldNormal), glm::normalize(ray.Direction));
+			bounce_pdf = glm::max(cosine, 0.0f) / utility::kPi;
+		}
+
+		// decide whether the next ray is traced at all
+		bool roulette = settings_.RussianRoulette && settings_.NextEventEstimation && i + 1 < bounces && (uint32_t)i + 1 >= settings_.RouletteDepth;
+		if (roulette && !utility::SurviveRoulette(rng, throughput))
+		{
+			if (stats)
+				(*stats)[i].Terminated++;
+			break;
+		}
 	}
 
 	//color = normal * 0.5f + 0.5f; // sets x,y,z as r,g,b
@@ -190,90 +1314,586 @@ glm::vec4 Renderer::RayGen(uint32_t x, uint32_t y)
 
 Renderer::HitInfo Renderer::TraceRay(const Ray& ray)
 {
-	// (bx^2 + by^2)t^2 + (2(axbx + ayby))t + (ax^2 + ay^2 - r^2) = 0
-	// a = ray origin, b = ray direction, r = radius, t = scalar hit distance
+	RT_PROFILE_SCOPE(TraceRay);
 
-	// sphere object index
-	int closestSphere = -1;
+	HitInfo hit;
+	if (!Intersect(ray, hit))
+	{
+		// return miss payload if no spheres exist
+		return Miss(ray);
+	}
 
-	// set hit distance to highest float value
-	float hitDistance = FLT_MAX;
+	// return closest hit payload
+	return ClosestHit(ray, hit);
+}
 
-	// run ray-sphere intersection calculations for every sphere in the scene
-	for (size_t i = 0; i < active_scene_->Spheres.size(); i++)
-	{
-		const Sphere& sphere = active_scene_->Spheres[i];
-		glm::vec3 origin = ray.Origin - sphere.Position;
+bool Renderer::Intersect(const Ray& ray, HitInfo& hit)
+{
+	hit.Type = PrimitiveType::Sphere;
+	hit.ObjectIndex = -1;
+	hit.PrimitiveIndex = 0;
+	hit.InstanceIndex = -1;
 
-		//float a = rayDirection.x * rayDirection.x + rayDirection.y * rayDirection.y + rayDirection.z * rayDirection.z;
-		float a = glm::dot(ray.Direction, ray.Direction);
-		float b = 2.0f * glm::dot(origin, ray.Direction);
-		float c = glm::dot(origin, origin) - sphere.Radius * sphere.Radius;
+	// set hit distance to highest float value
+	float hitDistance = FLT_MAX;
 
-		// quadratic forumula discriminant : b^2 - 4ac
+	IntersectObjects(ray, bvh_, sphere_soa_, mesh_structures_, hitDistance, hit);
 
-		float discriminant = b * b - 4.0f * a * c;
-		if (discriminant < 0.0f)
+	// instances, the ray is moved into the object space of each prototype it reaches
+	// the direction is not renormalised, so distances along it stay the same as in world space
+	instance_bvh_.Traverse(ray, hitDistance, [&](uint32_t first, uint32_t count, float& leaf_hit_distance)
 		{
-			// move on to the next sphere
-			continue;
-		}
+			for (uint32_t i = first; i < first + count; i++)
+			{
+				uint32_t instance_index = instance_bvh_.GetIndices()[i];
+				const InstanceData& instance = instances_[instance_index];
+				const PrototypeAccelerationStructure& prototype = prototype_structures_[instance.PrototypeIndex];
 
-		// quadratic formula: (-b +- sqrt(discriminant)) / 2a
+				Ray object_ray;
+				object_ray.Origin = glm::vec3(instance.WorldToObject * glm::vec4(ray.Origin, 1.0f));
+				object_ray.Direction = glm::vec3(instance.WorldToObject * glm::vec4(ray.Direction, 0.0f));
 
-		// > 0, 2 solutions
-		// = 0, 1 solution
-		// < 0, 0 solutions
+				if (IntersectObjects(object_ray, prototype.SphereBvh, prototype.Spheres, prototype.Meshes, leaf_hit_distance, hit))
+					hit.InstanceIndex = (int)instance_index;
+			}
+		});
+
+	hit.HitDistance = hitDistance;
+	return hitDistance < FLT_MAX;
+}
 
-		// plus variant - not used for now
-		//float t0 = (-b + glm::sqrt(discriminant)) / (2.0f * a);
+bool Renderer::IntersectObjects(const Ray& ray, const BVH& sphere_bvh, const SphereSoA& spheres,
+	const std::vector<MeshAccelerationStructure>& meshes, float& hit_distance, HitInfo& hit) const
+{
+	bool found = false;
 
-		// minus variant
-		float closestT = (-b - glm::sqrt(discriminant)) / (2.0f * a);
+	// the same for every sphere, so it is computed once per ray
+	float a = glm::dot(ray.Direction, ray.Direction);
 
-		// checks if the closestT is less than the hitdistance
-		if (closestT > 0.0f && closestT < hitDistance)
+	// run ray-sphere intersection calculations for the spheres in every leaf the ray passes through
+	int closestSlot = -1;
+	sphere_bvh.Traverse(ray, hit_distance, [&](uint32_t first, uint32_t count, float& leaf_hit_distance)
 		{
-			hitDistance = closestT;
+			intersect_spheres_(spheres, first, count, ray, a, leaf_hit_distance, closestSlot);
+		});
 
-			// set closestSphere as the last sphere that we hit
-			closestSphere = (int)i;
-		}
+	if (closestSlot >= 0)
+	{
+		hit.Type = PrimitiveType::Sphere;
+		hit.ObjectIndex = (int)spheres.Index[closestSlot];
+		hit.PrimitiveIndex = 0;
+		found = true;
 	}
 
-	if (closestSphere < 0)
+	// every mesh has its own BVH, each one only has to beat the closest hit so far
+	if (!meshes.empty())
 	{
-		// return miss payload if no spheres exist
-		return Miss(ray);
+		WatertightRay watertight_ray(ray);
+		for (size_t mesh_index = 0; mesh_index < meshes.size(); mesh_index++)
+		{
+			const MeshAccelerationStructure& mesh = meshes[mesh_index];
+
+			int closestTriangle = -1;
+			mesh.Bvh.Traverse(ray, hit_distance, [&](uint32_t first, uint32_t count, float& leaf_hit_distance)
+				{
+					intersect_triangles_(mesh.Triangles, first, count, watertight_ray, leaf_hit_distance, closestTriangle);
+				});
+
+			if (closestTriangle >= 0)
+			{
+				hit.Type = PrimitiveType::Triangle;
+				hit.ObjectIndex = (int)mesh_index;
+				hit.PrimitiveIndex = mesh.Triangles.Index[closestTriangle];
+				found = true;
+			}
+		}
 	}
 
-	// return closest hit payload
-	return ClosestHit(ray, hitDistance, closestSphere);
+	return found;
 }
 
-Renderer::HitInfo Renderer::ClosestHit(const Ray& ray, float hit_distance, int object_index)
+Renderer::HitInfo Renderer::ClosestHit(const Ray& ray, const HitInfo& hit)
 {
+	RT_PROFILE_SCOPE(ClosestHit);
+
 	// payload to return
-	Renderer::HitInfo payload;
-	payload.HitDistance = hit_distance;
-	payload.ObjectIndex = object_index;
+	Renderer::HitInfo payload = hit;
+
+	// instanced geometry is shaded in its prototype's object space and the result moved back to world space
+	const std::vector<Sphere>* spheres = &active_scene_->Spheres;
+	const std::vector<Mesh>* meshes = &active_scene_->Meshes;
+	Ray object_ray = ray;
+	if (hit.InstanceIndex >= 0)
+	{
+		const InstanceData& instance = instances_[hit.InstanceIndex];
+		const Prototype& prototype = active_scene_->Prototypes[instance.PrototypeIndex];
+		spheres = &prototype.Spheres;
+		meshes = &prototype.Meshes;
+
+		object_ray.Origin = glm::vec3(instance.WorldToObject * glm::vec4(ray.Origin, 1.0f));
+		object_ray.Direction = glm::vec3(instance.WorldToObject * glm::vec4(ray.Direction, 0.0f));
+	}
+
+	if (hit.Type == PrimitiveType::Triangle)
+	{
+		const Mesh& mesh = (*meshes)[hit.ObjectIndex];
+		const uint32_t* indices = &mesh.Indices[(size_t)hit.PrimitiveIndex * 3];
+		const glm::vec3& v0 = mesh.Vertices[indices[0]];
+		const glm::vec3& v1 = mesh.Vertices[indices[1]];
+		const glm::vec3& v2 = mesh.Vertices[indices[2]];
 
-	const Sphere& closestSphere = active_scene_->Spheres[object_index];
+		payload.WorldPosition = object_ray.Origin + object_ray.Direction * hit.HitDistance;
 
-	glm::vec3 origin = ray.Origin - closestSphere.Position;
-	payload.WorldPosition = origin + ray.Direction * hit_distance;
-	payload.WorldNormal = glm::normalize(payload.WorldPosition);
+		// geometric normal, turned towards the ray since triangles have no inside
+		payload.WorldNormal = glm::normalize(glm::cross(v1 - v0, v2 - v0));
+		if (glm::dot(payload.WorldNormal, object_ray.Direction) > 0.0f)
+			payload.WorldNormal = -payload.WorldNormal;
 
-	// translate world pos by sphere pos
-	payload.WorldPosition += closestSphere.Position;
+		payload.MaterialIndex = mesh.MaterialIndex;
+	}
+	else
+	{
+		const Sphere& closestSphere = (*spheres)[hit.ObjectIndex];
+
+		glm::vec3 origin = object_ray.Origin - closestSphere.Position;
+		payload.WorldPosition = origin + object_ray.Direction * hit.HitDistance;
+		payload.WorldNormal = glm::normalize(payload.WorldPosition);
+
+		// translate world pos by sphere pos
+		payload.WorldPosition += closestSphere.Position;
+
+		payload.MaterialIndex = closestSphere.MaterialIndex;
+	}
+
+	if (hit.InstanceIndex >= 0)
+	{
+		// normals transform with the inverse transpose, which also keeps a flipped normal facing the ray
+		const glm::mat4& world_to_object = instances_[hit.InstanceIndex].WorldToObject;
+		payload.WorldPosition = ray.Origin + ray.Direction * hit.HitDistance;
+		payload.WorldNormal = glm::normalize(glm::transpose(glm::mat3(world_to_object)) * payload.WorldNormal);
+	}
 
 	return payload;
 }
 
 Renderer::HitInfo Renderer::Miss(const Ray& ray)
 {
+	RT_PROFILE_SCOPE(Miss);
+
 	// payload to return
 	Renderer::HitInfo payload;
 	payload.HitDistance = -1.0f;
 	return payload;
-}
\ No newline at end of file
+}
+
+bool Renderer::IsOccluded(const Ray& ray, float max_distance) const
+{
+	RT_PROFILE_SCOPE(Occlusion);
+	RT_PROFILE_COUNT(ShadowRays, 1);
+
+	return OccludedScene(ray, max_distance);
+}
+
+bool Renderer::OccludedScene(const Ray& ray, float max_distance) const
+{
+	if (OccludedObjects(ray, bvh_, sphere_soa_, mesh_structures_, max_distance))
+		return true;
+
+	return instance_bvh_.Occluded(ray, max_distance, [&](uint32_t first, uint32_t count)
+		{
+			for (uint32_t i = first; i < first + count; i++)
+			{
+				const InstanceData& instance = instances_[instance_bvh_.GetIndices()[i]];
+				const PrototypeAccelerationStructure& prototype = prototype_structures_[instance.PrototypeIndex];
+
+				Ray object_ray;
+				object_ray.Origin = glm::vec3(instance.WorldToObject * glm::vec4(ray.Origin, 1.0f));
+				object_ray.Direction = glm::vec3(instance.WorldToObject * glm::vec4(ray.Direction, 0.0f));
+
+				if (OccludedObjects(object_ray, prototype.SphereBvh, prototype.Spheres, prototype.Meshes, max_distance))
+					return true;
+			}
+			return false;
+		});
+}
+
+void Renderer::IsOccluded(const Ray* rays, const float* max_distances, uint32_t count, uint8_t* occluded) const
+{
+	RT_PROFILE_SCOPE(Occlusion);
+	RT_PROFILE_COUNT(ShadowRays, count);
+
+	// most scenes have no instances, which saves the top level traversal setup per ray
+	bool instances = !instance_bvh_.Empty();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		occluded[i] = instances
+			? OccludedScene(rays[i], max_distances[i])
+			: OccludedObjects(rays[i], bvh_, sphere_soa_, mesh_structures_, max_distances[i]);
+	}
+}
+
+bool Renderer::OccludedObjects(const Ray& ray, const BVH& sphere_bvh, const SphereSoA& spheres,
+	const std::vector<MeshAccelerationStructure>& meshes, float max_distance) const
+{
+	float a = glm::dot(ray.Direction, ray.Direction);
+	bool occluded = sphere_bvh.Occluded(ray, max_distance, [&](uint32_t first, uint32_t count)
+		{
+			float hit_distance = max_distance;
+			int slot = -1;
+			intersect_spheres_(spheres, first, count, ray, a, hit_distance, slot);
+			return slot >= 0;
+		});
+	if (occluded || meshes.empty())
+		return occluded;
+
+	WatertightRay watertight_ray(ray);
+	for (const MeshAccelerationStructure& mesh : meshes)
+	{
+		occluded = mesh.Bvh.Occluded(ray, max_distance, [&](uint32_t first, uint32_t count)
+			{
+				float hit_distance = max_distance;
+				int slot = -1;
+				intersect_triangles_(mesh.Triangles, first, count, watertight_ray, hit_distance, slot);
+				return slot >= 0;
+			});
+		if (occluded)
+			return true;
+	}
+	return false;
+}
+
+bool Renderer::SampleLight(const HitInfo& payload, const Material& material, RNG& rng,
+	Ray& shadow_ray, float& max_distance, glm::vec3& contribution) const
+{
+	if (lights_.empty())
+		return false;
+
+	// the same three draws every time, whether or not the sample is used
+	float pick = rng.Float();
+	float u1 = rng.Float();
+	float u2 = rng.Float();
+
+	// lights are picked in proportion to their power
+	size_t index = std::upper_bound(light_cdf_.begin(), light_cdf_.end(), pick) - light_cdf_.begin();
+	const Light& light = lights_[std::min(index, lights_.size() - 1)];
+	const Sphere& sphere = active_scene_->Spheres[light.Sphere];
+
+	// same origin as the bounce ray
+	glm::vec3 origin = payload.WorldPosition + payload.WorldNormal * utility::kRayOffset;
+	float cone_angle = utility::ConeAngle(origin, sphere);
+	if (cone_angle <= 0.0f)
+		return false;
+
+	// uniform direction inside the cone around the light's centre
+	glm::vec3 to_center = sphere.Position - origin;
+	float distance2 = glm::dot(to_center, to_center);
+	glm::vec3 w = to_center * glm::inversesqrt(distance2);
+	glm::vec3 u = glm::normalize(glm::cross(glm::abs(w.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f), w));
+	glm::vec3 v = glm::cross(w, u);
+
+	float cos_theta = 1.0f - u1 * cone_angle;
+	float sin_theta = glm::sqrt(glm::max(0.0f, 1.0f - cos_theta * cos_theta));
+	float phi = 2.0f * utility::kPi * u2;
+	glm::vec3 direction = (u * glm::cos(phi) + v * glm::sin(phi)) * sin_theta + w * cos_theta;
+
+	glm::vec3 normal = glm::normalize(payload.WorldNormal);
+	float cosine = glm::dot(normal, direction);
+	if (cosine <= 0.0f)
+		return false;
+
+	// distance to the near side of the light, anything closer is in the way
+	float b = glm::dot(direction, to_center);
+	float discriminant = glm::max(0.0f, b * b - (distance2 - sphere.Radius * sphere.Radius));
+	float light_distance = b - glm::sqrt(discriminant);
+
+	shadow_ray.Origin = origin;
+	shadow_ray.Direction = direction;
+	max_distance = light_distance * 0.999f;
+
+	float light_pdf = light.Probability / (2.0f * utility::kPi * cone_angle);
+	float bounce_pdf = cosine / utility::kPi;
+	float weight = utility::PowerHeuristic(light_pdf, bounce_pdf);
+
+	// diffuse reflection, albedo / pi
+	glm::vec3 emission = active_scene_->Materials[sphere.MaterialIndex].GetEmission();
+	contribution = material.Albedo / utility::kPi * emission * (cosine * weight / light_pdf);
+	return true;
+}
+
+float Renderer::GetEmissionWeight(const HitInfo& payload, const glm::vec3& origin, float bounce_pdf) const
+{
+	// only world spheres are in the light list, anything else can only be found by bounce rays
+	if (payload.InstanceIndex >= 0 || payload.Type != PrimitiveType::Sphere)
+		return 1.0f;
+
+	int light_index = sphere_lights_[payload.ObjectIndex];
+	if (light_index < 0)
+		return 1.0f;
+
+	const Light& light = lights_[light_index];
+	float cone_angle = utility::ConeAngle(origin, active_scene_->Spheres[light.Sphere]);
+	if (cone_angle <= 0.0f)
+		return 1.0f;
+
+	float light_pdf = light.Probability / (2.0f * utility::kPi * cone_angle);
+	return utility::PowerHeuristic(bounce_pdf, light_pdf);
+}
+
+void Renderer::BuildLightList(const Scene& scene)
+{
+	lights_.clear();
+	light_cdf_.clear();
+	sphere_lights_.assign(scene.Spheres.size(), -1);
+
+	// power is radiance times surface area, the constant 4 pi cancels
+	double total_power = 0.0;
+	std::vector<double> powers;
+	for (uint32_t i = 0; i < (uint32_t)scene.Spheres.size(); i++)
+	{
+		const Sphere& sphere = scene.Spheres[i];
+		const Material& material = scene.Materials[sphere.MaterialIndex];
+		if (material.EmissionPower <= 0.0f)
+			continue;
+
+		double power = (double)utility::Luminance(material.GetEmission()) * sphere.Radius * sphere.Radius;
+		if (power <= 0.0)
+			continue;
+
+		sphere_lights_[i] = (int)lights_.size();
+		lights_.push_back({ i, 0.0f });
+		powers.push_back(power);
+		total_power += power;
+	}
+
+	double sum = 0.0;
+	light_cdf_.resize(lights_.size());
+	for (size_t i = 0; i < lights_.size(); i++)
+	{
+		lights_[i].Probability = (float)(powers[i] / total_power);
+		sum += powers[i];
+		light_cdf_[i] = (float)(sum / total_power);
+	}
+
+	lights_valid_ = true;
+}
+
+bool Renderer::UpdateAccelerationStructure(const Scene& scene)
+{
+	bool rebuild_meshes = mesh_scene_ != &scene || mesh_structures_.size() != scene.Meshes.size() || prototype_structures_.size() != scene.Prototypes.size();
+	bool rebuild_instances = instance_scene_ != &scene || instance_bvh_.GetPrimitiveCount() != scene.Instances.size();
+	bool rebuild_spheres = bvh_scene_ != &scene || bvh_.GetPrimitiveCount() != scene.Spheres.size();
+	bool edited = scene_edited_ || scene.Version != scene_version_;
+
+	// frames where nothing changed do no work at all
+	if (!rebuild_meshes && !rebuild_instances && !rebuild_spheres && !edited)
+		return false;
+
+	if (rebuild_meshes)
+	{
+		BuildMeshAccelerationStructures(scene);
+		BuildPrototypeAccelerationStructures(scene);
+	}
+
+	// the top level structure is refitted like the sphere BVH, so moving instances does not rebuild it
+	if (rebuild_instances || scene_edited_)
+	{
+		UpdateInstances(scene);
+
+		if (rebuild_instances)
+			instance_bvh_.Build(instance_bounds_);
+		else
+			instance_bvh_.Refit(instance_bounds_);
+	}
+	else
+	{
+		// only the instances edited since the last frame, and the nodes above them
+		utility::CollectEdited(scene.InstanceVersions, scene_version_, scene.Instances.size(), edited_);
+		for (uint32_t index : edited_)
+		{
+			UpdateInstance(scene, index);
+		}
+
+		if (!edited_.empty())
+			instance_bvh_.Refit(instance_bounds_, edited_);
+	}
+
+	if (instance_bvh_.GetCostRatio() > utility::kRebuildCostRatio)
+		instance_bvh_.Build(instance_bounds_);
+
+	instance_scene_ = &scene;
+
+	// leaves hold about as many spheres as the SIMD kernel tests at once
+	uint32_t leaf_width = kernels::GetLaneCount(kernels::GetBestISA());
+
+	if (rebuild_spheres || scene_edited_)
+	{
+		UpdateSphereBounds(scene);
+
+		if (rebuild_spheres)
+			bvh_.Build(sphere_bounds_, leaf_width);
+		else
+			bvh_.Refit(sphere_bounds_);
+
+		// edits keep the topology, only rebuild once the refitted tree has degraded
+		if (bvh_.GetCostRatio() > utility::kRebuildCostRatio)
+			bvh_.Build(sphere_bounds_, leaf_width);
+
+		// the SoA mirror follows the leaf order, so it is refilled after a refit as well
+		sphere_soa_.Build(scene.Spheres, bvh_.GetIndices());
+	}
+	else
+	{
+		utility::CollectEdited(scene.SphereVersions, scene_version_, scene.Spheres.size(), edited_);
+		for (uint32_t index : edited_)
+		{
+			sphere_bounds_[index] = utility::SphereBounds(scene.Spheres[index]);
+		}
+
+		if (!edited_.empty())
+		{
+			bvh_.Refit(sphere_bounds_, edited_);
+
+			if (bvh_.GetCostRatio() > utility::kRebuildCostRatio)
+			{
+				bvh_.Build(sphere_bounds_, leaf_width);
+				sphere_soa_.Build(scene.Spheres, bvh_.GetIndices());
+			}
+			else
+			{
+				// the leaf order is unchanged, so only the edited slots are copied
+				for (uint32_t index : edited_)
+				{
+					sphere_soa_.Update(bvh_.GetSlot(index), scene.Spheres[index]);
+				}
+			}
+		}
+	}
+
+	bvh_scene_ = &scene;
+	scene_edited_ = false;
+	scene_version_ = scene.Version;
+	return true;
+}
+
+void Renderer::SetAccelerationStructure(const Scene& scene, BVH bvh)
+{
+	if (bvh.Empty() || bvh.GetPrimitiveCount() != scene.Spheres.size())
+		return;
+
+	// bounds are kept for later refits
+	UpdateSphereBounds(scene);
+
+	bvh_ = std::move(bvh);
+	sphere_soa_.Build(scene.Spheres, bvh_.GetIndices());
+
+	bvh_scene_ = &scene;
+	scene_edited_ = false;
+}
+
+void Renderer::UpdateSphereBounds(const Scene& scene)
+{
+	sphere_bounds_.resize(scene.Spheres.size());
+	for (size_t i = 0; i < scene.Spheres.size(); i++)
+	{
+		sphere_bounds_[i] = utility::SphereBounds(scene.Spheres[i]);
+	}
+}
+
+void Renderer::BuildMeshAccelerationStructures(const Scene& scene)
+{
+	mesh_structures_.resize(scene.Meshes.size());
+
+	for (size_t i = 0; i < scene.Meshes.size(); i++)
+	{
+		BuildMeshAccelerationStructure(scene.Meshes[i], mesh_structures_[i]);
+	}
+
+	mesh_scene_ = &scene;
+}
+
+void Renderer::BuildPrototypeAccelerationStructures(const Scene& scene)
+{
+	prototype_structures_.resize(scene.Prototypes.size());
+
+	uint32_t leaf_width = kernels::GetLaneCount(kernels::GetBestISA());
+	for (size_t i = 0; i < scene.Prototypes.size(); i++)
+	{
+		const Prototype& prototype = scene.Prototypes[i];
+		PrototypeAccelerationStructure& structure = prototype_structures_[i];
+		structure.Bounds = AABB();
+
+		std::vector<AABB> bounds(prototype.Spheres.size());
+		for (size_t j = 0; j < prototype.Spheres.size(); j++)
+		{
+			bounds[j] = utility::SphereBounds(prototype.Spheres[j]);
+			structure.Bounds.Grow(bounds[j]);
+		}
+
+		structure.SphereBvh.Build(bounds, leaf_width);
+		structure.Spheres.Build(prototype.Spheres, structure.SphereBvh.GetIndices());
+
+		structure.Meshes.resize(prototype.Meshes.size());
+		for (size_t j = 0; j < prototype.Meshes.size(); j++)
+		{
+			BuildMeshAccelerationStructure(prototype.Meshes[j], structure.Meshes[j]);
+			if (!structure.Meshes[j].Bvh.Empty())
+			{
+				const BVHNode& root = structure.Meshes[j].Bvh.GetNodes()[0];
+				structure.Bounds.Grow(AABB{ root.Min, root.Max });
+			}
+		}
+	}
+}
+
+void Renderer::BuildMeshAccelerationStructure(const Mesh& mesh, MeshAccelerationStructure& structure)
+{
+	std::vector<AABB> bounds(mesh.GetTriangleCount());
+	for (uint32_t triangle = 0; triangle < mesh.GetTriangleCount(); triangle++)
+	{
+		AABB& box = bounds[triangle];
+		for (int vertex = 0; vertex < 3; vertex++)
+			box.Grow(mesh.Vertices[mesh.Indices[(size_t)triangle * 3 + vertex]]);
+	}
+
+	// leaves are sized for the four wide triangle kernel
+	structure.Bvh.Build(bounds, TriangleSoA::kMaxLanes);
+	structure.Triangles.Build(mesh, structure.Bvh.GetIndices());
+}
+
+void Renderer::UpdateInstances(const Scene& scene)
+{
+	instances_.resize(scene.Instances.size());
+	instance_bounds_.resize(scene.Instances.size());
+
+	for (uint32_t i = 0; i < (uint32_t)scene.Instances.size(); i++)
+	{
+		UpdateInstance(scene, i);
+	}
+}
+
+void Renderer::UpdateInstance(const Scene& scene, uint32_t index)
+{
+	const Instance& instance = scene.Instances[index];
+	instances_[index].WorldToObject = glm::inverse(instance.Transform);
+	instances_[index].PrototypeIndex = instance.PrototypeIndex;
+
+	// world box around the eight transformed corners of the prototype's box
+	const AABB& object_bounds = prototype_structures_[instance.PrototypeIndex].Bounds;
+	AABB& world_bounds = instance_bounds_[index];
+	if (object_bounds.Min.x > object_bounds.Max.x)
+	{
+		// nothing to hit, a point at the instance's origin keeps it out of the way
+		world_bounds.Min = world_bounds.Max = glm::vec3(instance.Transform[3]);
+		return;
+	}
+
+	world_bounds = AABB();
+	for (int corner = 0; corner < 8; corner++)
+	{
+		glm::vec3 point{
+			corner & 1 ? object_bounds.Max.x : object_bounds.Min.x,
+			corner & 2 ? object_bounds.Max.y : object_bounds.Min.y,
+			corner & 4 ? object_bounds.Max.z : object_bounds.Min.z };
+		world_bounds.Grow(glm::vec3(instance.Transform * glm::vec4(point, 1.0f)));
+	}
+}
@@ -12,13 +12,22 @@
 
 #pragma once
 
-#include "Walnut/Image.h"
-
+#include "AccumulationBuffer.h"
+#include "BVH.h"
 #include "Camera.h"
+#include "Denoiser.h"
+#include "FramebufferSink.h"
 #include "Ray.h"
+#include "RNG.h"
 #include "Scene.h"
+#include "SphereKernels.h"
+#include "ThreadPool.h"
+#include "TriangleKernels.h"
 
+#include <atomic>
 #include <memory>
+#include <random>
+#include <string>
 #include <glm/glm.hpp>
 
 class Renderer
@@ -28,55 +37,550 @@ public:
 	{
 		// 
 		bool Accumulate = true;
+
+		// test several spheres per instruction with the widest SIMD kernel the CPU supports
+		// the scalar kernel gives bit-identical results, so this only changes speed
+		bool SIMD = true;
+
+		// number of render threads, 0 uses every hardware thread
+		uint32_t ThreadCount = 0;
+
+		// width and height of the square tiles handed to the render threads
+		uint32_t TileSize = 16;
+
+		// use Seed for the random streams so two runs produce identical images
+		// otherwise every renderer draws its own random seed
+		bool DeterministicSeed = false;
+		uint32_t Seed = 0;
+
+		// converged tiles stop receiving samples and the freed budget goes to noisy tiles
+		// only used while accumulating
+		bool AdaptiveSampling = false;
+
+		// a pixel has converged once the standard error of its mean luminance,
+		// relative to that mean, drops below this
+		float NoiseThreshold = 0.02f;
+
+		// samples a pixel needs before its variance estimate is trusted
+		uint32_t MinSamples = 16;
+
+		// most samples a noisy pixel receives in one frame
+		uint32_t MaxSamplesPerFrame = 4;
+
+		// while the camera moves, trace one ray per 8x8, 4x4 or 2x2 block of pixels
+		// the block size is picked so a frame stays within PreviewFrameBudget milliseconds
+		bool ProgressivePreview = true;
+		float PreviewFrameBudget = 16.0f;
+
+		// count the rays traced at each bounce and time them, for benchmarks
+		// the timing adds a clock read per ray, so leave it off when measuring throughput
+		bool CollectStats = false;
+
+		// trace a tile breadth first, one bounce of every path at a time, instead of
+		// following each path to the end, gives the same image
+		bool Wavefront = false;
+
+		// with Wavefront, group the rays of each bounce by direction before tracing them
+		bool SortRays = false;
+
+		// at every bounce, also sample one emissive sphere directly with a shadow ray,
+		// combined with the bounce ray through multiple importance sampling
+		// emission is then weighted by the path throughput, so the image is brighter off than on
+		bool NextEventEstimation = false;
+
+		// most rays per path, including the primary ray
+		uint32_t MaxDepth = 5;
+
+		// from RouletteDepth rays on, a path continues with a probability that follows its throughput
+		// and the survivors are scaled up to match, so dark paths end early without biasing the image
+		// only used with NextEventEstimation, the default mode adds emission regardless of throughput
+		bool RussianRoulette = false;
+		uint32_t RouletteDepth = 3;
+
+		// how accumulated samples are stored, see AccumulationFormat, changing it restarts accumulation
+		AccumulationFormat Accumulation = AccumulationFormat::RGB32F;
+
+		// curve, exposure and encoding of the displayed image, changing them does not restart accumulation
+		ToneMapping Display;
+
+		// trace the first hit of every pixel for its albedo, normal and depth, see GetAlbedo
+		// the primary rays do not change between samples, so this costs one ray per pixel per accumulation
+		bool AOVs = false;
+
+		// filter the resolved image with Denoiser, guided by the first hits, turns on AOVs
+		// the accumulated samples are kept as they are, so turning it off shows the raw image again
+		bool Denoise = false;
+
+		// each pass of the filter reaches twice as far as the one before
+		uint32_t DenoisePasses = 5;
+
+		// when the camera moves, carry each pixel's samples over to where its surface is in the new view
+		// instead of starting again, pixels whose surface was hidden or off screen before start from zero
+		// turns on AOVs and replaces ProgressivePreview, only used while accumulating
+		bool TemporalReprojection = false;
+
+		// most samples a pixel keeps through a move, view dependent shading like reflections is
+		// carried along with the rest, so lower values let it catch up with the new view sooner
+		uint32_t MaxReprojectedSamples = 32;
+
+		// resolve the image after every frame, offline renders that only keep the last one can
+		// turn this off and call Resolve once at the end
+		bool ResolveEveryFrame = true;
+
+		// samples of a pixel are numbered from FirstSample + 1, so renderers that each take a different
+		// range of one image's samples produce the same samples as a single renderer would
+		uint32_t FirstSample = 0;
+	};
+
+	// rays traced at one bounce depth and the time TraceRay spent on them
+	struct BounceStats
+	{
+		uint64_t Rays = 0;
+		double Milliseconds = 0.0;
+
+		// paths Russian roulette ended after this depth
+		uint64_t Terminated = 0;
+	};
+
+	// the accumulated samples and everything that decides which samples come next, see Checkpoint.h
+	// restoring it into a renderer of the same size continues the render as if it had never stopped
+	struct AccumulationState
+	{
+		uint32_t Width = 0, Height = 0;
+
+		// frames accumulated so far, plus one
+		uint32_t FrameIndex = 1;
+
+		// the random streams are hashed from the seed and each pixel's sample number, so these
+		// and the sample counts are the whole random state
+		uint32_t Seed = 0;
+		uint32_t SampleOffset = 0;
+
+		// the settings the samples were taken with
+		AccumulationFormat Format = AccumulationFormat::RGB32F;
+		uint32_t FirstSample = 0;
+		uint32_t TileSize = 16;
+		bool NextEventEstimation = false;
+		uint32_t MaxDepth = 5;
+		bool RussianRoulette = false;
+		uint32_t RouletteDepth = 3;
+		bool AdaptiveSampling = false;
+		float NoiseThreshold = 0.02f;
+		uint32_t MinSamples = 16;
+		uint32_t MaxSamplesPerFrame = 4;
+
+		// raw AccumulationBuffer contents
+		std::vector<uint8_t> Accumulation;
+		std::vector<uint32_t> SampleCounts;
+
+		// only with adaptive sampling, running mean and M2 of each pixel's luminance and a converged flag per tile
+		std::vector<float> Variance;
+		std::vector<uint8_t> TileConverged;
 	};
 
 public:
 	Renderer() = default;
 
 	void OnResize(uint32_t width, uint32_t height);
-	void Render(const Scene& scene, const Camera& camera);
 
-	std::shared_ptr<Walnut::Image> GetFinalImage() const { return final_image_; }
+	// returns false if the frame was cancelled, see SetCancelFlag
+	bool Render(const Scene& scene, const Camera& camera);
+
+	// checked before every tile, once it is set the remaining tiles are skipped and the partial
+	// samples are thrown away, so the next frame restarts accumulation, may be null
+	void SetCancelFlag(const std::atomic<bool>* cancel) { cancel_ = cancel; }
+
+	// sink that receives the image after every frame, may be null
+	void SetFramebufferSink(std::shared_ptr<FramebufferSink> sink)
+	{
+		sink_ = std::move(sink);
+		if (sink_ && image_data_.Data())
+			sink_->OnResize(width_, height_);
+	}
+
+	// tone maps the accumulated samples into the image and hands it to the sink, in parallel rows
+	void Resolve();
+
+	// RGBA image of the last resolved frame
+	const uint32_t* GetImageData() const { return image_data_.Data(); }
+	uint32_t GetWidth() const { return width_; }
+	uint32_t GetHeight() const { return height_; }
+
+	// accumulated samples of the current frame index, each pixel holds GetSampleCounts()[pixel] of them
+	const AccumulationBuffer& GetAccumulation() const { return accumulation_; }
+	const uint32_t* GetSampleCounts() const { return sample_counts_.Data(); }
+
+	// first hit of each pixel's primary ray, null until a frame has been rendered with Settings::AOVs or Denoise
+	// depth is the distance along the ray, negative where it missed, and the background has its colour as albedo
+	const glm::vec3* GetAlbedo() const { return aovs_valid_ ? aov_albedo_.Data() : nullptr; }
+	const glm::vec3* GetNormals() const { return aovs_valid_ ? aov_normal_.Data() : nullptr; }
+	const float* GetDepth() const { return aovs_valid_ ? aov_depth_.Data() : nullptr; }
+
+	// copies the accumulated samples into state, reusing its allocations
+	// returns false if nothing has been accumulated since the last reset
+	bool GetAccumulationState(AccumulationState& state) const;
+
+	// takes over the samples and settings of state, the next frame adds to them instead of starting again
+	// the renderer has to have been resized to the state's size first
+	// returns false with a reason in error if the state does not fit
+	bool SetAccumulationState(const AccumulationState& state, std::string* error = nullptr);
 
 	// to reset the frame index when the camera moves
 	void ResetFrameIndex() { frame_index_ = 1; }
 
+	// with TemporalReprojection the next frame carries the samples over to the new view,
+	// otherwise this resets accumulation and renders the next frame as a low resolution preview
+	void OnCameraMoved();
+
+	// pixels per side of a preview block, 1 means full resolution
+	uint32_t GetPreviewScale() const { return preview_scale_; }
+
+	// edits made through Scene's Mark functions are picked up on the next frame, which refits only what moved
+	// and restarts accumulation, this refits everything instead for edits made without them
+	void OnSceneEdited() { scene_edited_ = true; }
+
+	// uses a BVH built ahead of time, e.g. loaded with the scene, instead of building one on the first frame
+	// ignored if it does not cover scene's spheres
+	void SetAccelerationStructure(const Scene& scene, BVH bvh);
+
 	// return settings struct
 	Settings& GetSettings() { return settings_; }
+
+	// time spent on each tile in the last frame, in milliseconds
+	const std::vector<float>& GetTileTimes() const { return tile_times_; }
+
+	uint32_t GetThreadCount() const { return thread_pool_ ? thread_pool_->GetThreadCount() : 0; }
+
+	// fraction of pixels in converged tiles, between 0 and 1, only meaningful with adaptive sampling
+	float GetConvergedRatio() const { return converged_ratio_; }
+	bool IsConverged() const { return converged_ratio_ >= 1.0f; }
+
+	// visibility queries against the scene of the last Render, for shadow, ambient occlusion or line of sight tests
+	// true if anything blocks the ray before max_distance, the search stops at the first hit and builds no payload
+	bool IsOccluded(const Ray& ray, float max_distance) const;
+
+	// one query per ray on the calling thread, occluded[i] is set to 1 if rays[i] is blocked before max_distances[i]
+	void IsOccluded(const Ray* rays, const float* max_distances, uint32_t count, uint8_t* occluded) const;
+
+	// per bounce statistics summed over every thread since the last ResetStats
+	// index 0 holds the primary rays, empty unless Settings::CollectStats was on
+	std::vector<BounceStats> GetBounceStats() const;
+	void ResetStats() { worker_stats_.clear(); }
 private:
+	struct Tile
+	{
+		uint32_t MinX, MinY;
+		uint32_t MaxX, MaxY;
+	};
+
+	enum class PrimitiveType : uint8_t
+	{
+		Sphere = 0, Triangle
+	};
+
 	struct HitInfo
 	{
 		float HitDistance;
 		glm::vec3 WorldPosition;
 		glm::vec3 WorldNormal;
 
+		// ObjectIndex is the sphere, or the mesh and PrimitiveIndex the triangle within it
+		// for instanced geometry these index into the prototype of InstanceIndex, otherwise it is -1
+		PrimitiveType Type;
 		int ObjectIndex;
+		uint32_t PrimitiveIndex;
+		int InstanceIndex;
+
+		int MaterialIndex;
+	};
+
+	// triangles of one mesh in BVH leaf order, with the BVH over them
+	struct MeshAccelerationStructure
+	{
+		BVH Bvh;
+		TriangleSoA Triangles;
 	};
 
+	// bottom level structures of one prototype, in its object space
+	struct PrototypeAccelerationStructure
+	{
+		BVH SphereBvh;
+		SphereSoA Spheres;
+		std::vector<MeshAccelerationStructure> Meshes;
+
+		// bounds of everything in the prototype, empty if it holds nothing
+		AABB Bounds;
+	};
+
+	// per instance state of the top level structure
+	struct InstanceData
+	{
+		glm::mat4 WorldToObject;
+		uint32_t PrototypeIndex;
+	};
+
+	// emissive sphere of active_scene_->Spheres that next event estimation samples
+	struct Light
+	{
+		uint32_t Sphere;
+		float Probability;
+	};
+
+	// running mean and squared deviation of a pixel's luminance (Welford's algorithm)
+	// AccumulationState stores these as pairs of floats
+	struct PixelVariance
+	{
+		float Mean;
+		float M2;
+	};
+	static_assert(sizeof(PixelVariance) == 2 * sizeof(float), "PixelVariance layout changed, update AccumulationState");
+
+	// ray and path state of the wavefront integrator, kept per worker so it is only allocated once
+	struct WavefrontBuffers
+	{
+		// one entry per path, a path is one sample of one pixel
+		std::vector<glm::vec3> Light;
+		std::vector<glm::vec3> Throughput;
+
+		// solid angle pdf of the path's last bounce direction, for next event estimation
+		std::vector<float> BouncePdf;
+
+		// rays of the current bounce, Path is the path each ray belongs to
+		std::vector<float> OriginX, OriginY, OriginZ;
+		std::vector<float> DirectionX, DirectionY, DirectionZ;
+		std::vector<uint32_t> Path;
+
+		// closest hit of each ray, object -1 is a miss
+		std::vector<float> HitDistance;
+		std::vector<int> HitObject;
+		std::vector<PrimitiveType> HitType;
+		std::vector<uint32_t> HitPrimitive;
+		std::vector<int> HitInstance;
+
+		// rays spawned for the next bounce, and the sort keys used to reorder them
+		std::vector<float> NextOriginX, NextOriginY, NextOriginZ;
+		std::vector<float> NextDirectionX, NextDirectionY, NextDirectionZ;
+		std::vector<uint32_t> NextPath;
+		std::vector<uint8_t> SortKey;
+
+		// next event estimation shadow rays of the current bounce, tested together after shading
+		std::vector<Ray> ShadowRays;
+		std::vector<float> ShadowDistance;
+		std::vector<glm::vec3> ShadowLight;
+		std::vector<uint32_t> ShadowPath;
+		std::vector<uint8_t> ShadowOccluded;
+
+		void Resize(size_t paths);
+	};
+
+	// renders samples per pixel of a tile into the accumulation and image data
+	// returns true if every pixel of the tile has converged
+	bool RenderTile(const Tile& tile, uint32_t samples, std::vector<BounceStats>* stats);
+
+	// same as RenderTile, with the generate, extend and shade stages each run over every ray of the tile
+	bool RenderTileWavefront(const Tile& tile, uint32_t samples, std::vector<BounceStats>* stats, WavefrontBuffers& buffers);
+
+	// stable counting sort of the next bounce's rays by direction octant and major axis,
+	// leaves the sorted rays in the current ray arrays
+	void SortWavefrontRays(WavefrontBuffers& buffers, uint32_t count);
+
+	// adds one sample to a pixel's running sum and variance
+	void AccumulateSample(uint32_t pixel, const glm::vec3& color);
+
+	bool IsPixelConverged(uint32_t pixel) const;
+
+	// fraction of pixels in converged tiles, from tile_converged_
+	void UpdateConvergedRatio();
+
+	// first hit albedo, normal, depth and surface of every pixel, and the view they were traced from
+	void RenderAOVs();
+	void RenderAOVTile(const Tile& tile);
+
+	// moves the accumulated samples from the view of the last AOVs to the current camera's
+	void Reproject();
+
+	// Resolve through the denoiser
+	void ResolveDenoised();
+
+	// traces one ray per scale x scale block and fills the whole block with it, without accumulating
+	void RenderPreview();
+	void RenderPreviewTile(const Tile& tile, uint32_t scale);
+
+	// splits the image into tiles of settings_.TileSize in Morton order
+	void BuildTiles();
+
 	// ray generation shader
-	glm::vec4 RayGen(uint32_t x, uint32_t y);
+	// sample picks the random stream, so the nth sample of a pixel is the same in every run
+	// stats may be null
+	glm::vec4 RayGen(uint32_t x, uint32_t y, const glm::vec3& direction, uint32_t sample, std::vector<BounceStats>* stats);
 	// intersection shader
 	HitInfo TraceRay(const Ray& ray);
 
-	// closest hit shader
-	HitInfo ClosestHit(const Ray& ray, float hit_distance, int object_index);
+	// closest sphere or triangle along the ray, fills in the distance and what was hit
+	// returns false if the ray misses everything
+	bool Intersect(const Ray& ray, HitInfo& hit);
+
+	// closest sphere or triangle of one set of bottom level structures
+	// lowers hit_distance and sets the type, object and primitive of hit on a closer hit, returns true if there was one
+	bool IntersectObjects(const Ray& ray, const BVH& sphere_bvh, const SphereSoA& spheres,
+		const std::vector<MeshAccelerationStructure>& meshes, float& hit_distance, HitInfo& hit) const;
+
+	// closest hit shader, adds the position, normal and material to a hit from Intersect
+	HitInfo ClosestHit(const Ray& ray, const HitInfo& hit);
 
 	// miss shader
 	HitInfo Miss(const Ray& ray);
+
+	// IsOccluded without the profiling, so the batched query is not counted twice
+	bool OccludedScene(const Ray& ray, float max_distance) const;
+
+	// any hit test of one set of bottom level structures, see IsOccluded
+	bool OccludedObjects(const Ray& ray, const BVH& sphere_bvh, const SphereSoA& spheres,
+		const std::vector<MeshAccelerationStructure>& meshes, float max_distance) const;
+
+	// next event estimation, picks one emitter and a direction towards it, returns false if there is nothing to trace
+	// contribution is the light the hit reflects if shadow_ray is not blocked before max_distance,
+	// weighted against sampling the bounce direction with the power heuristic
+	bool SampleLight(const HitInfo& payload, const Material& material, RNG& rng,
+		Ray& shadow_ray, float& max_distance, glm::vec3& contribution) const;
+
+	// weight of the emission found by a bounce ray from origin with the given pdf, 1 if it was not a sampled light
+	float GetEmissionWeight(const HitInfo& payload, const glm::vec3& origin, float bounce_pdf) const;
+
+	// emissive spheres, picked in proportion to their power
+	void BuildLightList(const Scene& scene);
+
+	// build or refit the BVHs over the scene spheres and instances
+	// returns true if the scene changed since the last frame, which invalidates the accumulated image
+	bool UpdateAccelerationStructure(const Scene& scene);
+	void UpdateSphereBounds(const Scene& scene);
+
+	// meshes and prototypes do not change, so their BVHs are only built for a new scene
+	void BuildMeshAccelerationStructures(const Scene& scene);
+	void BuildPrototypeAccelerationStructures(const Scene& scene);
+	static void BuildMeshAccelerationStructure(const Mesh& mesh, MeshAccelerationStructure& structure);
+
+	// world bounds and inverse transforms of the instances
+	void UpdateInstances(const Scene& scene);
+	void UpdateInstance(const Scene& scene, uint32_t index);
 private:
-	std::shared_ptr<Walnut::Image> final_image_;
+	std::shared_ptr<FramebufferSink> sink_;
+	uint32_t width_ = 0, height_ = 0;
 
 	const Scene* active_scene_ = nullptr;
 	const Camera* active_camera_ = nullptr;
 
-	uint32_t* image_data_ = nullptr;
-	glm::vec4* accumulation_data_ = nullptr;
+	// kept across resizes, so shrinking the viewport does not reallocate
+	AlignedBuffer<uint32_t> image_data_;
+	AccumulationBuffer accumulation_;
+
+	// samples accumulated per pixel, which differ between pixels with adaptive sampling
+	AlignedBuffer<uint32_t> sample_counts_;
+	AlignedBuffer<PixelVariance> variance_data_;
+
+	// false until a frame has been accumulated at the current size, Resolve has nothing to show before
+	bool has_samples_ = false;
+
+	// first hit of every pixel, traced again whenever accumulation restarts or is reprojected
+	// the surface id tells objects apart, not the triangles of a mesh
+	AlignedBuffer<glm::vec3> aov_albedo_;
+	AlignedBuffer<glm::vec3> aov_normal_;
+	AlignedBuffer<float> aov_depth_;
+	AlignedBuffer<uint32_t> aov_surface_;
+	bool aovs_valid_ = false;
+
+	// camera the AOVs were traced from, a world position is projected into its pixels with
+	// aov_view_projection_ and its depth there is the distance to aov_position_
+	glm::mat4 aov_view_projection_{ 1.0f };
+	glm::vec3 aov_position_{ 0.0f };
+
+	// the previous view's samples and first hits while they are reprojected, swapped with the current ones
+	AccumulationBuffer history_accumulation_;
+	AlignedBuffer<uint32_t> history_counts_;
+	AlignedBuffer<PixelVariance> history_variance_;
+	AlignedBuffer<glm::vec3> history_normal_;
+	AlignedBuffer<float> history_depth_;
+	AlignedBuffer<uint32_t> history_surface_;
+
+	// set by OnCameraMoved with TemporalReprojection, the next frame reprojects before it samples
+	bool reproject_ = false;
+
+	// moves the random streams on with every reprojected move, so a pixel does not repeat the samples
+	// it took before its count was capped
+	uint32_t reprojections_ = 0;
+
+	Denoiser denoiser_;
 
 	// to count the number of frames since the first render
 	uint32_t frame_index_ = 1;
 
+	// set by SetAccumulationState, so building the acceleration structures on the next frame keeps the samples
+	bool restored_ = false;
+
+	// seed of the per-pixel random streams for the current frame
+	uint32_t seed_ = 0;
+	uint32_t random_seed_ = std::random_device{}();
+
+	// moves the random streams on every frame that is not accumulated, so the noise changes
+	uint32_t sample_offset_ = 0;
+
+	// set by another thread to abandon the frame in progress
+	const std::atomic<bool>* cancel_ = nullptr;
+
+	// progressive preview state
+	bool camera_moving_ = false;
+	uint32_t preview_scale_ = 4;
+
 	Settings settings_;
 
-	// iterate x and y
-	std::vector<uint32_t> image_x_iterator_, image_y_iterator_;
+	// acceleration structure over active_scene_->Spheres
+	BVH bvh_;
+	std::vector<AABB> sphere_bounds_;
+	const Scene* bvh_scene_ = nullptr;
+	bool scene_edited_ = false;
+
+	// Scene::Version on the last frame, and the spheres or instances edited since
+	uint64_t scene_version_ = 0;
+	std::vector<uint32_t> edited_;
+
+	// spheres in BVH leaf order and the kernel that intersects them
+	SphereSoA sphere_soa_;
+	kernels::IntersectSpheresFn intersect_spheres_ = kernels::IntersectSpheresScalar;
+
+	// one per entry of active_scene_->Meshes
+	std::vector<MeshAccelerationStructure> mesh_structures_;
+	const Scene* mesh_scene_ = nullptr;
+	kernels::IntersectTrianglesFn intersect_triangles_ = kernels::IntersectTrianglesScalar;
+
+	// one per entry of active_scene_->Prototypes
+	std::vector<PrototypeAccelerationStructure> prototype_structures_;
+
+	// top level structure over active_scene_->Instances, refitted when they move
+	BVH instance_bvh_;
+	std::vector<AABB> instance_bounds_;
+	std::vector<InstanceData> instances_;
+	const Scene* instance_scene_ = nullptr;
+
+	// lights of active_scene_, light_cdf_ is the running sum of their probabilities
+	// sphere_lights_ holds the light of every sphere, -1 if it does not glow
+	std::vector<Light> lights_;
+	std::vector<float> light_cdf_;
+	std::vector<int> sphere_lights_;
+	bool lights_valid_ = false;
+
+	// work is scheduled per tile rather than per pixel
+	std::unique_ptr<ThreadPool> thread_pool_;
+	std::vector<Tile> tiles_;
+	std::vector<float> tile_times_;
+	uint32_t tile_size_ = 0;
+
+	// adaptive sampling state per tile
+	std::vector<uint8_t> tile_converged_;
+	std::vector<uint32_t> active_tiles_;
+	float converged_ratio_ = 0.0f;
+
+	// bounce statistics, one list per worker thread so they are gathered without locking
+	std::vector<std::vector<BounceStats>> worker_stats_;
+
+	std::vector<WavefrontBuffers> worker_wavefront_;
 };
\ No newline at end of file
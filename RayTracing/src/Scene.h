@@ -13,6 +13,7 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <vector>
 
 struct Material
@@ -33,8 +34,66 @@ struct Sphere
 	int MaterialIndex = 0;
 };
 
+// indexed triangle mesh, three indices per triangle
+struct Mesh
+{
+	std::vector<glm::vec3> Vertices;
+	std::vector<uint32_t> Indices;
+	int MaterialIndex = 0;
+
+	uint32_t GetTriangleCount() const { return (uint32_t)(Indices.size() / 3); }
+};
+
+// spheres and meshes in their own object space, placed any number of times by instances
+// every instance shares the prototype's acceleration structure, so a copy costs one transform
+struct Prototype
+{
+	std::vector<Sphere> Spheres;
+	std::vector<Mesh> Meshes;
+};
+
+// one placement of a prototype
+struct Instance
+{
+	// object to world, any invertible affine transform
+	glm::mat4 Transform{ 1.0f };
+	uint32_t PrototypeIndex = 0;
+};
+
 struct Scene
 {
 	std::vector<Sphere> Spheres;
 	std::vector<Material> Materials;
+	std::vector<Mesh> Meshes;
+
+	std::vector<Prototype> Prototypes;
+	std::vector<Instance> Instances;
+
+	// change tracking for edits made in place
+	// Version grows with every edit, and each sphere and instance remembers the version of its last edit,
+	// so a renderer only has to remember the Version it last saw to find everything edited since
+	uint64_t Version = 0;
+	std::vector<uint64_t> SphereVersions;
+	std::vector<uint64_t> InstanceVersions;
+
+	// call after changing a sphere's position, radius or material
+	void MarkSphereEdited(size_t index)
+	{
+		Version++;
+		if (SphereVersions.size() < Spheres.size())
+			SphereVersions.resize(Spheres.size(), 0);
+		SphereVersions[index] = Version;
+	}
+
+	// call after changing an instance's transform
+	void MarkInstanceEdited(size_t index)
+	{
+		Version++;
+		if (InstanceVersions.size() < Instances.size())
+			InstanceVersions.resize(Instances.size(), 0);
+		InstanceVersions[index] = Version;
+	}
+
+	// materials have no acceleration structure, the renderer only restarts accumulation
+	void MarkMaterialEdited() { Version++; }
 };
\ No newline at end of file
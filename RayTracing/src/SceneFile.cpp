@@ -0,0 +1,411 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: SceneFile.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/SceneFile.cpp
+*/
+
+#include "SceneFile.h"
+#include "MappedFile.h"
+#include "MeshFile.h"
+#include "SphereKernels.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace utility
+{
+	// the sections are written straight from memory, so the file layout is the struct layout
+	static_assert(sizeof(Sphere) == 20, "Sphere layout changed, bump scene_file::kVersion");
+	static_assert(sizeof(Material) == 36, "Material layout changed, bump scene_file::kVersion");
+	static_assert(sizeof(BVHNode) == 32, "BVHNode layout changed, bump scene_file::kVersion");
+
+	static constexpr char kMagic[8] = { 'R', 'T', 'S', 'C', 'E', 'N', 'E', '\0' };
+	static constexpr uint64_t kSectionAlignment = 64;
+
+	struct SceneFileHeader
+	{
+		char Magic[8];
+		uint32_t Version;
+		uint32_t HeaderSize;
+
+		uint32_t SphereCount;
+		uint32_t MaterialCount;
+
+		// 0 when the file holds no BVH
+		uint32_t NodeCount;
+		uint32_t IndexCount;
+		uint32_t LeafWidth;
+		uint32_t Reserved;
+
+		// byte offsets from the start of the file
+		uint64_t SphereOffset;
+		uint64_t MaterialOffset;
+		uint64_t NodeOffset;
+		uint64_t IndexOffset;
+	};
+
+	static uint64_t AlignSection(uint64_t offset)
+	{
+		return (offset + kSectionAlignment - 1) / kSectionAlignment * kSectionAlignment;
+	}
+
+	static bool Fail(std::string* error, const std::string& message)
+	{
+		if (error)
+			*error = message;
+		return false;
+	}
+
+	// true if count elements of element_size starting at offset lie inside the file
+	static bool SectionFits(uint64_t offset, uint64_t count, uint64_t element_size, uint64_t file_size)
+	{
+		return offset <= file_size && count <= (file_size - offset) / element_size;
+	}
+
+	static bool CheckMaterials(const std::vector<Sphere>& spheres, const std::vector<Mesh>& meshes, size_t material_count,
+		std::string* error)
+	{
+		for (const Sphere& sphere : spheres)
+		{
+			if (sphere.MaterialIndex < 0 || (size_t)sphere.MaterialIndex >= material_count)
+				return Fail(error, "sphere uses material " + std::to_string(sphere.MaterialIndex) + " which does not exist");
+		}
+
+		for (const Mesh& mesh : meshes)
+		{
+			if (mesh.MaterialIndex < 0 || (size_t)mesh.MaterialIndex >= material_count)
+				return Fail(error, "mesh uses material " + std::to_string(mesh.MaterialIndex) + " which does not exist");
+		}
+		return true;
+	}
+
+	static bool HasExtension(const std::string& path, const char* extension)
+	{
+		size_t length = strlen(extension);
+		return path.size() >= length && path.compare(path.size() - length, length, extension) == 0;
+	}
+}
+
+bool scene_file::Write(const std::string& path, const Scene& scene, const BVH* bvh)
+{
+	if (!scene.Meshes.empty() || !scene.Instances.empty())
+		return false;
+
+	bool write_bvh = bvh && !bvh->Empty() && bvh->GetPrimitiveCount() == scene.Spheres.size();
+
+	utility::SceneFileHeader header = {};
+	memcpy(header.Magic, utility::kMagic, sizeof(header.Magic));
+	header.Version = kVersion;
+	header.HeaderSize = sizeof(header);
+	header.SphereCount = (uint32_t)scene.Spheres.size();
+	header.MaterialCount = (uint32_t)scene.Materials.size();
+	header.NodeCount = write_bvh ? (uint32_t)bvh->GetNodes().size() : 0;
+	header.IndexCount = write_bvh ? (uint32_t)bvh->GetIndices().size() : 0;
+	header.LeafWidth = write_bvh ? bvh->GetLeafWidth() : 0;
+
+	header.SphereOffset = utility::AlignSection(sizeof(header));
+	header.MaterialOffset = utility::AlignSection(header.SphereOffset + (uint64_t)header.SphereCount * sizeof(Sphere));
+	header.NodeOffset = utility::AlignSection(header.MaterialOffset + (uint64_t)header.MaterialCount * sizeof(Material));
+	header.IndexOffset = utility::AlignSection(header.NodeOffset + (uint64_t)header.NodeCount * sizeof(BVHNode));
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	// pads with zeros up to the next section
+	auto write_section = [&file](uint64_t offset, const void* data, uint64_t size)
+		{
+			static const char padding[utility::kSectionAlignment] = {};
+			uint64_t position = (uint64_t)file.tellp();
+			file.write(padding, (std::streamsize)(offset - position));
+			file.write((const char*)data, (std::streamsize)size);
+		};
+
+	file.write((const char*)&header, sizeof(header));
+	write_section(header.SphereOffset, scene.Spheres.data(), (uint64_t)header.SphereCount * sizeof(Sphere));
+	write_section(header.MaterialOffset, scene.Materials.data(), (uint64_t)header.MaterialCount * sizeof(Material));
+	if (write_bvh)
+	{
+		write_section(header.NodeOffset, bvh->GetNodes().data(), (uint64_t)header.NodeCount * sizeof(BVHNode));
+		write_section(header.IndexOffset, bvh->GetIndices().data(), (uint64_t)header.IndexCount * sizeof(uint32_t));
+	}
+
+	return (bool)file;
+}
+
+bool scene_file::Read(const std::string& path, Scene& scene, BVH* bvh, std::string* error)
+{
+	MappedFile file;
+	if (!file.Open(path))
+		return utility::Fail(error, "could not open " + path);
+
+	const uint8_t* data = file.GetData();
+	uint64_t size = file.GetSize();
+
+	utility::SceneFileHeader header;
+	if (size < sizeof(header))
+		return utility::Fail(error, "file is too small to be a scene");
+
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.Magic, utility::kMagic, sizeof(header.Magic)) != 0)
+		return utility::Fail(error, "not a .rtscene file");
+	if (header.Version != kVersion || header.HeaderSize != sizeof(header))
+		return utility::Fail(error, "scene file version " + std::to_string(header.Version) + ", expected " + std::to_string(kVersion));
+
+	if (!utility::SectionFits(header.SphereOffset, header.SphereCount, sizeof(Sphere), size) ||
+		!utility::SectionFits(header.MaterialOffset, header.MaterialCount, sizeof(Material), size) ||
+		!utility::SectionFits(header.NodeOffset, header.NodeCount, sizeof(BVHNode), size) ||
+		!utility::SectionFits(header.IndexOffset, header.IndexCount, sizeof(uint32_t), size))
+		return utility::Fail(error, "scene file is truncated");
+
+	// one bulk copy per section
+	Scene loaded;
+	loaded.Spheres.resize(header.SphereCount);
+	loaded.Materials.resize(header.MaterialCount);
+	memcpy(loaded.Spheres.data(), data + header.SphereOffset, (size_t)header.SphereCount * sizeof(Sphere));
+	memcpy(loaded.Materials.data(), data + header.MaterialOffset, (size_t)header.MaterialCount * sizeof(Material));
+
+	for (const Sphere& sphere : loaded.Spheres)
+	{
+		if (sphere.MaterialIndex < 0 || (uint32_t)sphere.MaterialIndex >= header.MaterialCount)
+			return utility::Fail(error, "sphere uses a material that does not exist");
+	}
+
+	if (bvh)
+	{
+		*bvh = BVH();
+
+		if (header.NodeCount > 0)
+		{
+			std::vector<BVHNode> nodes(header.NodeCount);
+			std::vector<uint32_t> indices(header.IndexCount);
+			memcpy(nodes.data(), data + header.NodeOffset, (size_t)header.NodeCount * sizeof(BVHNode));
+			memcpy(indices.data(), data + header.IndexOffset, (size_t)header.IndexCount * sizeof(uint32_t));
+
+			if (header.IndexCount != header.SphereCount || !bvh->Assign(std::move(nodes), std::move(indices), header.LeafWidth))
+				return utility::Fail(error, "stored BVH does not match the spheres");
+		}
+	}
+
+	scene = std::move(loaded);
+	return true;
+}
+
+bool scene_file::ImportText(const std::string& path, Scene& scene, std::string* error)
+{
+	std::ifstream file(path);
+	if (!file)
+		return utility::Fail(error, "could not open " + path);
+
+	Scene imported;
+	std::string line;
+	uint32_t line_number = 0;
+
+	// spheres and meshes go to this prototype until its end line, -1 outside of one
+	int prototype = -1;
+	while (std::getline(file, line))
+	{
+		line_number++;
+
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.resize(comment);
+
+		const char* cursor = line.c_str();
+		while (*cursor == ' ' || *cursor == '\t')
+			cursor++;
+		if (*cursor == '\0' || *cursor == '\r')
+			continue;
+
+		// reads the next count numbers of the line
+		auto parse = [&cursor](float* values, int count)
+			{
+				for (int i = 0; i < count; i++)
+				{
+					char* end;
+					values[i] = strtof(cursor, &end);
+					if (end == cursor)
+						return false;
+					cursor = end;
+				}
+				return true;
+			};
+
+		std::vector<Sphere>& spheres = prototype >= 0 ? imported.Prototypes[prototype].Spheres : imported.Spheres;
+		std::vector<Mesh>& meshes = prototype >= 0 ? imported.Prototypes[prototype].Meshes : imported.Meshes;
+
+		float values[9];
+		if (strncmp(cursor, "material", 8) == 0)
+		{
+			cursor += 8;
+			if (!parse(values, 9))
+				return utility::Fail(error, path + ":" + std::to_string(line_number) + ": expected 9 numbers after material");
+
+			Material& material = imported.Materials.emplace_back();
+			material.Albedo = { values[0], values[1], values[2] };
+			material.Roughness = values[3];
+			material.Metallic = values[4];
+			material.EmissionColor = { values[5], values[6], values[7] };
+			material.EmissionPower = values[8];
+		}
+		else if (strncmp(cursor, "sphere", 6) == 0)
+		{
+			cursor += 6;
+			if (!parse(values, 5))
+				return utility::Fail(error, path + ":" + std::to_string(line_number) + ": expected 5 numbers after sphere");
+
+			Sphere& sphere = spheres.emplace_back();
+			sphere.Position = { values[0], values[1], values[2] };
+			sphere.Radius = values[3];
+			sphere.MaterialIndex = (int)values[4];
+		}
+		else if (strncmp(cursor, "mesh", 4) == 0)
+		{
+			cursor += 4;
+			while (*cursor == ' ' || *cursor == '\t')
+				cursor++;
+
+			// the path runs up to the material index, the last word of the line
+			std::string rest = cursor;
+			while (!rest.empty() && (rest.back() == ' ' || rest.back() == '\t' || rest.back() == '\r'))
+				rest.pop_back();
+
+			size_t split = rest.find_last_of(" \t");
+			if (split == std::string::npos)
+				return utility::Fail(error, path + ":" + std::to_string(line_number) + ": expected a path and a material index after mesh");
+
+			std::string mesh_path = rest.substr(0, rest.find_last_not_of(" \t", split) + 1);
+			bool absolute = !mesh_path.empty() && (mesh_path[0] == '/' || mesh_path[0] == '\\' || (mesh_path.size() > 1 && mesh_path[1] == ':'));
+			if (!absolute && path.find_last_of("/\\") != std::string::npos)
+				mesh_path = path.substr(0, path.find_last_of("/\\") + 1) + mesh_path;
+
+			Mesh& mesh = meshes.emplace_back();
+			mesh.MaterialIndex = atoi(rest.c_str() + split + 1);
+
+			std::string mesh_error;
+			if (!mesh_file::Load(mesh_path, mesh, &mesh_error))
+				return utility::Fail(error, path + ":" + std::to_string(line_number) + ": " + mesh_error);
+		}
+		else if (strncmp(cursor, "prototype", 9) == 0)
+		{
+			if (prototype >= 0)
+				return utility::Fail(error, path + ":" + std::to_string(line_number) + ": prototypes cannot be nested");
+
+			prototype = (int)imported.Prototypes.size();
+			imported.Prototypes.emplace_back();
+		}
+		else if (strncmp(cursor, "end", 3) == 0)
+		{
+			if (prototype < 0)
+				return utility::Fail(error, path + ":" + std::to_string(line_number) + ": end without a prototype");
+
+			prototype = -1;
+		}
+		else if (strncmp(cursor, "instance", 8) == 0)
+		{
+			cursor += 8;
+			if (!parse(values, 8))
+				return utility::Fail(error, path + ":" + std::to_string(line_number) + ": expected 8 numbers after instance");
+			if (prototype >= 0)
+				return utility::Fail(error, path + ":" + std::to_string(line_number) + ": instances cannot be placed inside a prototype");
+			if (values[0] < 0.0f || (size_t)values[0] >= imported.Prototypes.size())
+				return utility::Fail(error, path + ":" + std::to_string(line_number) + ": instance of a prototype that does not exist");
+
+			// translation, then rotation about x, y and z in degrees, then uniform scale
+			glm::mat4 transform = glm::translate(glm::mat4(1.0f), { values[1], values[2], values[3] });
+			transform = glm::rotate(transform, glm::radians(values[4]), { 1.0f, 0.0f, 0.0f });
+			transform = glm::rotate(transform, glm::radians(values[5]), { 0.0f, 1.0f, 0.0f });
+			transform = glm::rotate(transform, glm::radians(values[6]), { 0.0f, 0.0f, 1.0f });
+			transform = glm::scale(transform, glm::vec3(values[7]));
+
+			Instance& instance = imported.Instances.emplace_back();
+			instance.Transform = transform;
+			instance.PrototypeIndex = (uint32_t)values[0];
+		}
+		else
+		{
+			return utility::Fail(error, path + ":" + std::to_string(line_number) + ": unknown item");
+		}
+	}
+
+	if (prototype >= 0)
+		return utility::Fail(error, path + ": prototype without an end");
+
+	// materials may be listed after the spheres that use them
+	std::string message;
+	if (!Validate(imported, &message))
+		return utility::Fail(error, path + ": " + message);
+
+	scene = std::move(imported);
+	return true;
+}
+
+bool scene_file::Validate(const Scene& scene, std::string* error)
+{
+	if (!utility::CheckMaterials(scene.Spheres, scene.Meshes, scene.Materials.size(), error))
+		return false;
+
+	for (const Prototype& prototype : scene.Prototypes)
+	{
+		if (!utility::CheckMaterials(prototype.Spheres, prototype.Meshes, scene.Materials.size(), error))
+			return false;
+	}
+
+	auto check_meshes = [error](const std::vector<Mesh>& meshes)
+		{
+			for (const Mesh& mesh : meshes)
+			{
+				if (!mesh_file::CheckIndices(mesh))
+					return utility::Fail(error, "mesh face uses a vertex that does not exist");
+			}
+			return true;
+		};
+
+	if (!check_meshes(scene.Meshes))
+		return false;
+
+	for (const Prototype& prototype : scene.Prototypes)
+	{
+		if (!check_meshes(prototype.Meshes))
+			return false;
+	}
+
+	for (const Instance& instance : scene.Instances)
+	{
+		if (instance.PrototypeIndex >= scene.Prototypes.size())
+			return utility::Fail(error, "instance of prototype " + std::to_string(instance.PrototypeIndex) + " which does not exist");
+	}
+	return true;
+}
+
+bool scene_file::Load(const std::string& path, Scene& scene, BVH* bvh, std::string* error)
+{
+	if (utility::HasExtension(path, ".rtscene"))
+		return Read(path, scene, bvh, error);
+
+	if (bvh)
+		*bvh = BVH();
+	return ImportText(path, scene, error);
+}
+
+void scene_file::BuildBVH(const Scene& scene, BVH& bvh)
+{
+	std::vector<AABB> bounds(scene.Spheres.size());
+	for (size_t i = 0; i < scene.Spheres.size(); i++)
+	{
+		const Sphere& sphere = scene.Spheres[i];
+		glm::vec3 extent{ glm::abs(sphere.Radius) };
+		bounds[i] = { sphere.Position - extent, sphere.Position + extent };
+	}
+
+	// same leaf width as the renderer uses on this machine
+	bvh.Build(bounds, kernels::GetLaneCount(kernels::GetBestISA()));
+}
@@ -0,0 +1,57 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: SceneFile.h
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/SceneFile.h
+*/
+
+#pragma once
+
+#include "BVH.h"
+#include "Scene.h"
+
+#include <string>
+
+// .rtscene binary scene files
+//
+// a fixed header followed by 64 byte aligned sections, all little endian:
+//   spheres    SphereCount x Sphere, in memory layout
+//   materials  MaterialCount x Material, in memory layout
+//   nodes      NodeCount x BVHNode, optional prebuilt BVH over the spheres
+//   indices    IndexCount x uint32_t, sphere indices in BVH leaf order
+// loading maps the file and copies each section into its array in one go
+// meshes and instances are not stored, only text scenes can hold them
+namespace scene_file
+{
+	static constexpr uint32_t kVersion = 1;
+
+	// writes the scene, and the BVH if one is given
+	// returns false if the file could not be written or the scene has meshes or instances
+	bool Write(const std::string& path, const Scene& scene, const BVH* bvh = nullptr);
+
+	// reads a .rtscene file, bvh receives the stored tree if there is one and is left empty otherwise
+	// returns false with a reason in error if the file is missing, truncated, from another version or inconsistent
+	bool Read(const std::string& path, Scene& scene, BVH* bvh = nullptr, std::string* error = nullptr);
+
+	// text scenes, one item per line, # starts a comment
+	//   material <albedo r g b> <roughness> <metallic> <emission r g b> <emission power>
+	//   sphere <position x y z> <radius> <material index>
+	//   mesh <.obj or .ply path, relative to the scene file> <material index>
+	//   prototype, then sphere and mesh lines in the prototype's object space, then end
+	//   instance <prototype index> <translation x y z> <rotation about x y z in degrees> <scale>
+	bool ImportText(const std::string& path, Scene& scene, std::string* error = nullptr);
+
+	// checks that every material, vertex and prototype index names something that exists
+	// Read and ImportText already do this, it is for scenes that arrive some other way
+	bool Validate(const Scene& scene, std::string* error = nullptr);
+
+	// .rtscene files are read, anything else is imported as text
+	bool Load(const std::string& path, Scene& scene, BVH* bvh = nullptr, std::string* error = nullptr);
+
+	// builds the BVH the renderer would build for this scene, to store alongside it
+	void BuildBVH(const Scene& scene, BVH& bvh);
+}
@@ -0,0 +1,256 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: Scenes.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/Scenes.cpp
+*/
+
+#include "Scenes.h"
+#include "RNG.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+Scene scenes::Default()
+{
+	Scene scene;
+
+	// materials in the scene
+	Material& floor = scene.Materials.emplace_back();
+	floor.Albedo = { 0.1f, 0.1f, 0.1f };
+	//floor.Albedo = { 1.0f, 1.0f, 1.0f };
+	floor.Roughness = 0.0f;
+	floor.EmissionColor = floor.Albedo;
+	floor.EmissionPower = 0;
+
+	Material& red = scene.Materials.emplace_back();
+	red.Albedo = { 1.0f, 0.0f, 0.0f };
+	red.Roughness = 0.1f;
+	red.EmissionColor = red.Albedo;
+	red.EmissionPower = 0.5;
+
+	Material& green = scene.Materials.emplace_back();
+	green.Albedo = { 0.0f, 1.0f, 0.0f };
+	green.Roughness = 0.1f;
+	green.EmissionColor = green.Albedo;
+	green.EmissionPower = 0.5;
+
+	Material& blue = scene.Materials.emplace_back();
+	blue.Albedo = { 0.0f, 0.0f, 1.0f };
+	blue.Roughness = 0.1f;
+	blue.EmissionColor = blue.Albedo;
+	blue.EmissionPower = 0.5;
+
+	Material& cyan = scene.Materials.emplace_back();
+	cyan.Albedo = { 0.0f, 1.0f, 1.0f };
+	cyan.Roughness = 0.1f;
+	cyan.EmissionColor = cyan.Albedo;
+	cyan.EmissionPower = 0.5;
+
+	Material& yellow = scene.Materials.emplace_back();
+	yellow.Albedo = { 1.0f, 1.0f, 0.0f };
+	yellow.Roughness = 0.1f;
+	yellow.EmissionColor = yellow.Albedo;
+	yellow.EmissionPower = 0.5;
+
+	Material& magenta = scene.Materials.emplace_back();
+	magenta.Albedo = { 1.0f, 0.0f, 1.0f };
+	magenta.Roughness = 0.1f;
+	magenta.EmissionColor = magenta.Albedo;
+	magenta.EmissionPower = 0.5;
+
+	// spheres in the scene
+	{
+		Sphere sphere;
+		sphere.Position = { 0.0f, -1000.5f, 0.0f };
+		sphere.Radius = 1000.0f;
+		sphere.MaterialIndex = 0;
+		scene.Spheres.push_back(sphere);
+	}
+
+	{
+		Sphere sphere;
+		sphere.Position = { 0.0f, 0.0f, 0.0f };
+		sphere.Radius = 0.5f;
+		sphere.MaterialIndex = 1;
+		scene.Spheres.push_back(sphere);
+	}
+
+	{
+		Sphere sphere;
+		sphere.Position = { 1.1f, 0.0f, 0.0f };
+		sphere.Radius = 0.5f;
+		sphere.MaterialIndex = 2;
+		scene.Spheres.push_back(sphere);
+	}
+
+	{
+		Sphere sphere;
+		sphere.Position = { 0.0f, 0.0f, 1.1f };
+		sphere.Radius = 0.5f;
+		sphere.MaterialIndex = 3;
+		scene.Spheres.push_back(sphere);
+	}
+
+	return scene;
+}
+
+float scenes::RandomSpheresExtent(uint32_t count)
+{
+	// about one sphere per unit cube
+	return 0.5f * std::cbrt((float)std::max(count, 1u));
+}
+
+Scene scenes::RandomSpheres(uint32_t count, uint32_t seed)
+{
+	Scene scene;
+
+	float extent = RandomSpheresExtent(count);
+
+	// floor just below the cube
+	Material& floor = scene.Materials.emplace_back();
+	floor.Albedo = { 0.5f, 0.5f, 0.5f };
+	floor.Roughness = 1.0f;
+
+	{
+		Sphere sphere;
+		sphere.Radius = 1000.0f;
+		sphere.Position = { 0.0f, -1000.0f - extent, 0.0f };
+		sphere.MaterialIndex = 0;
+		scene.Spheres.push_back(sphere);
+	}
+
+	// a small palette, one in ten materials glows
+	constexpr uint32_t kMaterialCount = 20;
+	RNG rng(seed, 0, 0, 0);
+	for (uint32_t i = 0; i < kMaterialCount; i++)
+	{
+		Material& material = scene.Materials.emplace_back();
+		material.Albedo = rng.Vec3(0.2f, 1.0f);
+		material.Roughness = rng.Float();
+		material.EmissionColor = material.Albedo;
+		material.EmissionPower = i % 10 == 0 ? 2.0f : 0.0f;
+	}
+
+	scene.Spheres.reserve(count + 1);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Sphere sphere;
+		sphere.Position = rng.Vec3(-extent, extent);
+		sphere.Radius = 0.1f + 0.2f * rng.Float();
+		sphere.MaterialIndex = 1 + (int)(rng.UInt() % kMaterialCount);
+		scene.Spheres.push_back(sphere);
+	}
+
+	return scene;
+}
+
+Scene scenes::EmissiveGrid(uint32_t side)
+{
+	Scene scene;
+
+	Material& floor = scene.Materials.emplace_back();
+	floor.Albedo = { 0.1f, 0.1f, 0.1f };
+	floor.Roughness = 0.0f;
+
+	{
+		Sphere sphere;
+		sphere.Position = { 0.0f, -1000.5f, 0.0f };
+		sphere.Radius = 1000.0f;
+		sphere.MaterialIndex = 0;
+		scene.Spheres.push_back(sphere);
+	}
+
+	// one material per sphere, the colour runs across the grid
+	float offset = 0.5f * (float)(side - 1);
+	for (uint32_t z = 0; z < side; z++)
+	{
+		for (uint32_t x = 0; x < side; x++)
+		{
+			Material& material = scene.Materials.emplace_back();
+			material.Albedo = { (float)(x + 1) / (float)side, 0.5f, (float)(z + 1) / (float)side };
+			material.Roughness = 0.1f;
+			material.EmissionColor = material.Albedo;
+			material.EmissionPower = 1.0f;
+
+			Sphere sphere;
+			sphere.Position = { (float)x - offset, 0.0f, (float)z - offset };
+			sphere.Radius = 0.4f;
+			sphere.MaterialIndex = (int)scene.Materials.size() - 1;
+			scene.Spheres.push_back(sphere);
+		}
+	}
+
+	return scene;
+}
+
+Scene scenes::InstancedClusters(uint32_t instance_count, uint32_t cluster_size, uint32_t seed)
+{
+	Scene scene;
+
+	float extent = RandomSpheresExtent(instance_count);
+
+	Material& floor = scene.Materials.emplace_back();
+	floor.Albedo = { 0.5f, 0.5f, 0.5f };
+	floor.Roughness = 1.0f;
+
+	{
+		Sphere sphere;
+		sphere.Radius = 1000.0f;
+		sphere.Position = { 0.0f, -1000.0f - extent, 0.0f };
+		sphere.MaterialIndex = 0;
+		scene.Spheres.push_back(sphere);
+	}
+
+	constexpr uint32_t kMaterialCount = 20;
+	RNG rng(seed, 0, 0, 0);
+	for (uint32_t i = 0; i < kMaterialCount; i++)
+	{
+		Material& material = scene.Materials.emplace_back();
+		material.Albedo = rng.Vec3(0.2f, 1.0f);
+		material.Roughness = rng.Float();
+		material.EmissionColor = material.Albedo;
+		material.EmissionPower = i % 10 == 0 ? 2.0f : 0.0f;
+	}
+
+	// small spheres packed into a ball of radius 0.4
+	Prototype& cluster = scene.Prototypes.emplace_back();
+	cluster.Spheres.reserve(cluster_size);
+	for (uint32_t i = 0; i < cluster_size; i++)
+	{
+		glm::vec3 direction = rng.InUnitSphere();
+		float distance = 0.4f * std::cbrt(rng.Float());
+		glm::vec3 position = direction * distance;
+
+		Sphere sphere;
+		sphere.Position = position;
+		sphere.Radius = 0.02f + 0.04f * rng.Float();
+		sphere.MaterialIndex = 1 + (int)(rng.UInt() % kMaterialCount);
+		cluster.Spheres.push_back(sphere);
+	}
+
+	scene.Instances.reserve(instance_count);
+	for (uint32_t i = 0; i < instance_count; i++)
+	{
+		glm::vec3 position = rng.Vec3(-extent, extent);
+		glm::vec3 axis = rng.InUnitSphere();
+		float angle = 6.2831853f * rng.Float();
+		float scale = 0.5f + rng.Float();
+
+		glm::mat4 transform = glm::translate(glm::mat4(1.0f), position);
+		transform = glm::rotate(transform, angle, axis);
+		transform = glm::scale(transform, glm::vec3(scale));
+
+		Instance& instance = scene.Instances.emplace_back();
+		instance.Transform = transform;
+		instance.PrototypeIndex = 0;
+	}
+
+	return scene;
+}
@@ -0,0 +1,39 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: Scenes.h
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/Scenes.h
+*/
+
+#pragma once
+
+#include "Scene.h"
+
+#include <cstdint>
+
+// built-in scenes shared by the Walnut app, the headless app and the benchmark
+namespace scenes
+{
+	// floor with three emissive spheres
+	Scene Default();
+
+	// count spheres of random size and colour scattered through a cube on top of the floor
+	// the cube grows with count so the density stays the same, a tenth of the spheres glow
+	// the same count and seed always give the same scene
+	Scene RandomSpheres(uint32_t count, uint32_t seed = 1);
+
+	// half extent of the cube RandomSpheres fills, to place a camera in front of it
+	float RandomSpheresExtent(uint32_t count);
+
+	// side x side grid of emissive spheres over a dark floor, most paths end on a light
+	Scene EmissiveGrid(uint32_t side);
+
+	// instance_count randomly turned and scaled copies of one cluster of cluster_size spheres,
+	// spread through the same cube RandomSpheres(instance_count) fills
+	// only one cluster is stored, so memory grows with the instances rather than the spheres
+	Scene InstancedClusters(uint32_t instance_count, uint32_t cluster_size, uint32_t seed = 1);
+}
@@ -0,0 +1,166 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: SphereKernels.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/SphereKernels.cpp
+*/
+
+#include "SphereKernels.h"
+
+#include <limits>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace utility
+{
+#if defined(__x86_64__) || defined(_M_X64)
+	static kernels::ISA DetectISA()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		int max_leaf = info[0];
+
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+
+		// the OS has to save the wider registers on context switches
+		unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+		bool ymm_state = (xcr0 & 0x6) == 0x6;
+		bool zmm_state = (xcr0 & 0xe6) == 0xe6;
+
+		bool avx2 = false, avx512f = false;
+		if (max_leaf >= 7)
+		{
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+			avx512f = (info[1] & (1 << 16)) != 0;
+		}
+
+		if (avx512f && zmm_state)
+			return kernels::ISA::AVX512;
+		if (avx && avx2 && ymm_state)
+			return kernels::ISA::AVX2;
+		return kernels::ISA::SSE;
+#else
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f"))
+			return kernels::ISA::AVX512;
+		if (__builtin_cpu_supports("avx2"))
+			return kernels::ISA::AVX2;
+		return kernels::ISA::SSE;
+#endif
+	}
+#else
+	static kernels::ISA DetectISA()
+	{
+		return kernels::ISA::Scalar;
+	}
+#endif
+}
+
+void SphereSoA::Build(const std::vector<Sphere>& spheres, const std::vector<uint32_t>& order)
+{
+	// padding slots hold NaN so they can never produce a hit
+	size_t padded = order.size() + kMaxLanes;
+	float nan = std::numeric_limits<float>::quiet_NaN();
+
+	X.assign(padded, nan);
+	Y.assign(padded, nan);
+	Z.assign(padded, nan);
+	Radius.assign(padded, nan);
+	Index = order;
+
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const Sphere& sphere = spheres[order[i]];
+		X[i] = sphere.Position.x;
+		Y[i] = sphere.Position.y;
+		Z[i] = sphere.Position.z;
+		Radius[i] = sphere.Radius;
+	}
+}
+
+kernels::ISA kernels::GetBestISA()
+{
+	static const ISA isa = utility::DetectISA();
+	return isa;
+}
+
+const char* kernels::GetISAName(ISA isa)
+{
+	switch (isa)
+	{
+	case ISA::SSE: return "SSE";
+	case ISA::AVX2: return "AVX2";
+	case ISA::AVX512: return "AVX-512";
+	default: return "Scalar";
+	}
+}
+
+uint32_t kernels::GetLaneCount(ISA isa)
+{
+	switch (isa)
+	{
+	case ISA::SSE: return 4;
+	case ISA::AVX2: return 8;
+	case ISA::AVX512: return 16;
+	default: return 1;
+	}
+}
+
+kernels::IntersectSpheresFn kernels::GetIntersectSpheres(ISA isa)
+{
+	switch (isa)
+	{
+#if defined(__x86_64__) || defined(_M_X64)
+	case ISA::SSE: return IntersectSpheresSSE;
+	case ISA::AVX2: return IntersectSpheresAVX2;
+	case ISA::AVX512: return IntersectSpheresAVX512;
+#endif
+	default: return IntersectSpheresScalar;
+	}
+}
+
+void kernels::IntersectSpheresScalar(const SphereSoA& spheres, uint32_t first, uint32_t count,
+	const Ray& ray, float a, float& hit_distance, int& hit_slot)
+{
+	// (bx^2 + by^2)t^2 + (2(axbx + ayby))t + (ax^2 + ay^2 - r^2) = 0
+	// a = ray origin, b = ray direction, r = radius, t = scalar hit distance
+
+	for (uint32_t slot = first; slot < first + count; slot++)
+	{
+		glm::vec3 origin = ray.Origin - glm::vec3(spheres.X[slot], spheres.Y[slot], spheres.Z[slot]);
+		float radius = spheres.Radius[slot];
+
+		float b = 2.0f * glm::dot(origin, ray.Direction);
+		float c = glm::dot(origin, origin) - radius * radius;
+
+		// quadratic forumula discriminant : b^2 - 4ac
+		float discriminant = b * b - 4.0f * a * c;
+		if (discriminant < 0.0f)
+		{
+			// move on to the next sphere
+			continue;
+		}
+
+		// quadratic formula: (-b +- sqrt(discriminant)) / 2a
+		// only the minus variant, the nearer of the two solutions, is used
+		float closestT = (-b - glm::sqrt(discriminant)) / (2.0f * a);
+
+		// checks if the closestT is less than the hitdistance
+		if (closestT > 0.0f && closestT < hit_distance)
+		{
+			hit_distance = closestT;
+			hit_slot = (int)slot;
+		}
+	}
+}
@@ -0,0 +1,80 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: SphereKernels.h
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/SphereKernels.h
+*/
+
+#pragma once
+
+#include "Ray.h"
+#include "Scene.h"
+
+#include <cstdint>
+#include <vector>
+
+// structure of arrays mirror of Scene::Spheres, stored in BVH leaf order
+// so the spheres of a leaf are contiguous and can be loaded straight into SIMD registers
+struct SphereSoA
+{
+	// widest kernel, the arrays are padded by this many entries so full width loads never run past the end
+	static constexpr uint32_t kMaxLanes = 16;
+
+	std::vector<float> X, Y, Z, Radius;
+
+	// index into Scene::Spheres for every slot
+	std::vector<uint32_t> Index;
+
+	// order is the BVH primitive order, see BVH::GetIndices
+	void Build(const std::vector<Sphere>& spheres, const std::vector<uint32_t>& order);
+
+	// copies one edited sphere into its slot, see BVH::GetSlot
+	void Update(uint32_t slot, const Sphere& sphere)
+	{
+		X[slot] = sphere.Position.x;
+		Y[slot] = sphere.Position.y;
+		Z[slot] = sphere.Position.z;
+		Radius[slot] = sphere.Radius;
+	}
+};
+
+namespace kernels
+{
+	enum class ISA
+	{
+		Scalar = 0, SSE, AVX2, AVX512
+	};
+
+	// tests the spheres in slots [first, first + count) against the ray
+	// a is glm::dot(ray.Direction, ray.Direction), which is the same for every sphere
+	// on a closer hit, lowers hit_distance and sets hit_slot to the SoA slot
+	// every kernel produces bit-identical results to the scalar one
+	using IntersectSpheresFn = void(*)(const SphereSoA& spheres, uint32_t first, uint32_t count,
+		const Ray& ray, float a, float& hit_distance, int& hit_slot);
+
+	// widest instruction set supported by the CPU and the build
+	ISA GetBestISA();
+	const char* GetISAName(ISA isa);
+
+	// number of spheres tested per instruction
+	uint32_t GetLaneCount(ISA isa);
+
+	IntersectSpheresFn GetIntersectSpheres(ISA isa);
+
+	void IntersectSpheresScalar(const SphereSoA& spheres, uint32_t first, uint32_t count,
+		const Ray& ray, float a, float& hit_distance, int& hit_slot);
+
+#if defined(__x86_64__) || defined(_M_X64)
+	// each lives in its own translation unit, compiled for that instruction set
+	void IntersectSpheresSSE(const SphereSoA& spheres, uint32_t first, uint32_t count,
+		const Ray& ray, float a, float& hit_distance, int& hit_slot);
+	void IntersectSpheresAVX2(const SphereSoA& spheres, uint32_t first, uint32_t count,
+		const Ray& ray, float a, float& hit_distance, int& hit_slot);
+	void IntersectSpheresAVX512(const SphereSoA& spheres, uint32_t first, uint32_t count,
+		const Ray& ray, float a, float& hit_distance, int& hit_slot);
+#endif
+}
@@ -0,0 +1,91 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: SphereKernelsAVX2.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/SphereKernelsAVX2.cpp
+
+	Notes: Compiled with AVX2 enabled, only called after kernels::GetBestISA has checked the CPU.
+*/
+
+#include "SphereKernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+#include <immintrin.h>
+
+void kernels::IntersectSpheresAVX2(const SphereSoA& spheres, uint32_t first, uint32_t count,
+	const Ray& ray, float a, float& hit_distance, int& hit_slot)
+{
+	// same operations in the same order as the scalar kernel, so results are bit-identical
+	// mul and add are kept separate on purpose, a fused multiply-add would round differently
+	const __m256 origin_x = _mm256_set1_ps(ray.Origin.x);
+	const __m256 origin_y = _mm256_set1_ps(ray.Origin.y);
+	const __m256 origin_z = _mm256_set1_ps(ray.Origin.z);
+	const __m256 direction_x = _mm256_set1_ps(ray.Direction.x);
+	const __m256 direction_y = _mm256_set1_ps(ray.Direction.y);
+	const __m256 direction_z = _mm256_set1_ps(ray.Direction.z);
+
+	const __m256 two = _mm256_set1_ps(2.0f);
+	const __m256 four_a = _mm256_set1_ps(4.0f * a);
+	const __m256 two_a = _mm256_set1_ps(2.0f * a);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+	const __m256i lanes = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+
+	__m256 closest = _mm256_set1_ps(hit_distance);
+
+	for (uint32_t i = 0; i < count; i += 8)
+	{
+		uint32_t slot = first + i;
+
+		__m256 ox = _mm256_sub_ps(origin_x, _mm256_loadu_ps(&spheres.X[slot]));
+		__m256 oy = _mm256_sub_ps(origin_y, _mm256_loadu_ps(&spheres.Y[slot]));
+		__m256 oz = _mm256_sub_ps(origin_z, _mm256_loadu_ps(&spheres.Z[slot]));
+		__m256 radius = _mm256_loadu_ps(&spheres.Radius[slot]);
+
+		// b = 2 * dot(origin, direction)
+		__m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ox, direction_x), _mm256_mul_ps(oy, direction_y)), _mm256_mul_ps(oz, direction_z));
+		b = _mm256_mul_ps(two, b);
+
+		// c = dot(origin, origin) - r^2
+		__m256 c = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ox, ox), _mm256_mul_ps(oy, oy)), _mm256_mul_ps(oz, oz));
+		c = _mm256_sub_ps(c, _mm256_mul_ps(radius, radius));
+
+		__m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(four_a, c));
+
+		// (-b - sqrt(discriminant)) / 2a
+		__m256 t = _mm256_div_ps(_mm256_sub_ps(_mm256_xor_ps(b, sign), _mm256_sqrt_ps(discriminant)), two_a);
+
+		__m256 mask = _mm256_cmp_ps(discriminant, zero, _CMP_GE_OQ);
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, zero, _CMP_GT_OQ));
+		mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, closest, _CMP_LT_OQ));
+
+		// lanes past the end of the leaf
+		__m256i valid = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)(count - i)), lanes);
+		mask = _mm256_and_ps(mask, _mm256_castsi256_ps(valid));
+
+		int bits = _mm256_movemask_ps(mask);
+		if (bits == 0)
+			continue;
+
+		// resolve the hits in lane order, exactly like the scalar loop
+		alignas(32) float distances[8];
+		_mm256_store_ps(distances, t);
+		for (int lane = 0; lane < 8; lane++)
+		{
+			if ((bits & (1 << lane)) && distances[lane] < hit_distance)
+			{
+				hit_distance = distances[lane];
+				hit_slot = (int)(slot + lane);
+			}
+		}
+
+		closest = _mm256_set1_ps(hit_distance);
+	}
+}
+
+#endif
@@ -0,0 +1,90 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: SphereKernelsAVX512.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/SphereKernelsAVX512.cpp
+
+	Notes: Compiled with AVX-512F enabled, only called after kernels::GetBestISA has checked the CPU.
+*/
+
+#include "SphereKernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+#include <immintrin.h>
+
+void kernels::IntersectSpheresAVX512(const SphereSoA& spheres, uint32_t first, uint32_t count,
+	const Ray& ray, float a, float& hit_distance, int& hit_slot)
+{
+	// same operations in the same order as the scalar kernel, so results are bit-identical
+	// mul and add are kept separate on purpose, a fused multiply-add would round differently
+	const __m512 origin_x = _mm512_set1_ps(ray.Origin.x);
+	const __m512 origin_y = _mm512_set1_ps(ray.Origin.y);
+	const __m512 origin_z = _mm512_set1_ps(ray.Origin.z);
+	const __m512 direction_x = _mm512_set1_ps(ray.Direction.x);
+	const __m512 direction_y = _mm512_set1_ps(ray.Direction.y);
+	const __m512 direction_z = _mm512_set1_ps(ray.Direction.z);
+
+	const __m512 two = _mm512_set1_ps(2.0f);
+	const __m512 four_a = _mm512_set1_ps(4.0f * a);
+	const __m512 two_a = _mm512_set1_ps(2.0f * a);
+	const __m512 zero = _mm512_setzero_ps();
+	const __m512i sign = _mm512_set1_epi32((int)0x80000000);
+
+	__m512 closest = _mm512_set1_ps(hit_distance);
+
+	for (uint32_t i = 0; i < count; i += 16)
+	{
+		uint32_t slot = first + i;
+
+		__m512 ox = _mm512_sub_ps(origin_x, _mm512_loadu_ps(&spheres.X[slot]));
+		__m512 oy = _mm512_sub_ps(origin_y, _mm512_loadu_ps(&spheres.Y[slot]));
+		__m512 oz = _mm512_sub_ps(origin_z, _mm512_loadu_ps(&spheres.Z[slot]));
+		__m512 radius = _mm512_loadu_ps(&spheres.Radius[slot]);
+
+		// b = 2 * dot(origin, direction)
+		__m512 b = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ox, direction_x), _mm512_mul_ps(oy, direction_y)), _mm512_mul_ps(oz, direction_z));
+		b = _mm512_mul_ps(two, b);
+
+		// c = dot(origin, origin) - r^2
+		__m512 c = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ox, ox), _mm512_mul_ps(oy, oy)), _mm512_mul_ps(oz, oz));
+		c = _mm512_sub_ps(c, _mm512_mul_ps(radius, radius));
+
+		__m512 discriminant = _mm512_sub_ps(_mm512_mul_ps(b, b), _mm512_mul_ps(four_a, c));
+
+		// (-b - sqrt(discriminant)) / 2a, negated through the sign bit since AVX-512F has no float xor
+		__m512 minus_b = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(b), sign));
+		__m512 t = _mm512_div_ps(_mm512_sub_ps(minus_b, _mm512_sqrt_ps(discriminant)), two_a);
+
+		// lanes past the end of the leaf
+		uint32_t remaining = count - i;
+		__mmask16 mask = remaining >= 16 ? (__mmask16)0xffff : (__mmask16)((1u << remaining) - 1);
+
+		mask = _mm512_mask_cmp_ps_mask(mask, discriminant, zero, _CMP_GE_OQ);
+		mask = _mm512_mask_cmp_ps_mask(mask, t, zero, _CMP_GT_OQ);
+		mask = _mm512_mask_cmp_ps_mask(mask, t, closest, _CMP_LT_OQ);
+
+		if (mask == 0)
+			continue;
+
+		// resolve the hits in lane order, exactly like the scalar loop
+		alignas(64) float distances[16];
+		_mm512_store_ps(distances, t);
+		for (int lane = 0; lane < 16; lane++)
+		{
+			if ((mask & (1 << lane)) && distances[lane] < hit_distance)
+			{
+				hit_distance = distances[lane];
+				hit_slot = (int)(slot + lane);
+			}
+		}
+
+		closest = _mm512_set1_ps(hit_distance);
+	}
+}
+
+#endif
@@ -0,0 +1,90 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: SphereKernelsSSE.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/SphereKernelsSSE.cpp
+
+	Notes: SSE2 is part of x64, so this kernel needs no extra compiler flags.
+*/
+
+#include "SphereKernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+#include <emmintrin.h>
+
+void kernels::IntersectSpheresSSE(const SphereSoA& spheres, uint32_t first, uint32_t count,
+	const Ray& ray, float a, float& hit_distance, int& hit_slot)
+{
+	// same operations in the same order as the scalar kernel, so results are bit-identical
+	const __m128 origin_x = _mm_set1_ps(ray.Origin.x);
+	const __m128 origin_y = _mm_set1_ps(ray.Origin.y);
+	const __m128 origin_z = _mm_set1_ps(ray.Origin.z);
+	const __m128 direction_x = _mm_set1_ps(ray.Direction.x);
+	const __m128 direction_y = _mm_set1_ps(ray.Direction.y);
+	const __m128 direction_z = _mm_set1_ps(ray.Direction.z);
+
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 four_a = _mm_set1_ps(4.0f * a);
+	const __m128 two_a = _mm_set1_ps(2.0f * a);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	const __m128i lanes = _mm_set_epi32(3, 2, 1, 0);
+
+	__m128 closest = _mm_set1_ps(hit_distance);
+
+	for (uint32_t i = 0; i < count; i += 4)
+	{
+		uint32_t slot = first + i;
+
+		__m128 ox = _mm_sub_ps(origin_x, _mm_loadu_ps(&spheres.X[slot]));
+		__m128 oy = _mm_sub_ps(origin_y, _mm_loadu_ps(&spheres.Y[slot]));
+		__m128 oz = _mm_sub_ps(origin_z, _mm_loadu_ps(&spheres.Z[slot]));
+		__m128 radius = _mm_loadu_ps(&spheres.Radius[slot]);
+
+		// b = 2 * dot(origin, direction)
+		__m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, direction_x), _mm_mul_ps(oy, direction_y)), _mm_mul_ps(oz, direction_z));
+		b = _mm_mul_ps(two, b);
+
+		// c = dot(origin, origin) - r^2
+		__m128 c = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oy, oy)), _mm_mul_ps(oz, oz));
+		c = _mm_sub_ps(c, _mm_mul_ps(radius, radius));
+
+		__m128 discriminant = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(four_a, c));
+
+		// (-b - sqrt(discriminant)) / 2a
+		__m128 t = _mm_div_ps(_mm_sub_ps(_mm_xor_ps(b, sign), _mm_sqrt_ps(discriminant)), two_a);
+
+		__m128 mask = _mm_cmpge_ps(discriminant, zero);
+		mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, zero));
+		mask = _mm_and_ps(mask, _mm_cmplt_ps(t, closest));
+
+		// lanes past the end of the leaf
+		__m128i valid = _mm_cmplt_epi32(lanes, _mm_set1_epi32((int)(count - i)));
+		mask = _mm_and_ps(mask, _mm_castsi128_ps(valid));
+
+		int bits = _mm_movemask_ps(mask);
+		if (bits == 0)
+			continue;
+
+		// resolve the hits in lane order, exactly like the scalar loop
+		alignas(16) float distances[4];
+		_mm_store_ps(distances, t);
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if ((bits & (1 << lane)) && distances[lane] < hit_distance)
+			{
+				hit_distance = distances[lane];
+				hit_slot = (int)(slot + lane);
+			}
+		}
+
+		closest = _mm_set1_ps(hit_distance);
+	}
+}
+
+#endif
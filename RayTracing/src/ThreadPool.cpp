@@ -0,0 +1,189 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: ThreadPool.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/ThreadPool.cpp
+*/
+
+#include "ThreadPool.h"
+#include "Profiler.h"
+
+#include <algorithm>
+
+namespace utility
+{
+	static uint64_t PackRange(uint32_t begin, uint32_t end)
+	{
+		return ((uint64_t)end << 32) | begin;
+	}
+
+	static uint32_t RangeBegin(uint64_t range) { return (uint32_t)range; }
+	static uint32_t RangeEnd(uint64_t range) { return (uint32_t)(range >> 32); }
+}
+
+ThreadPool::ThreadPool(uint32_t thread_count)
+{
+	thread_count_ = thread_count > 0 ? thread_count : GetHardwareThreadCount();
+	ranges_ = std::make_unique<WorkRange[]>(thread_count_);
+
+	// the calling thread is worker 0, so one thread fewer is spawned
+	for (uint32_t worker = 1; worker < thread_count_; worker++)
+	{
+		threads_.emplace_back(&ThreadPool::WorkerLoop, this, worker);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	wake_.notify_all();
+
+	for (std::thread& thread : threads_)
+	{
+		thread.join();
+	}
+}
+
+uint32_t ThreadPool::GetHardwareThreadCount()
+{
+	uint32_t count = std::thread::hardware_concurrency();
+	return count > 0 ? count : 1;
+}
+
+void ThreadPool::ParallelFor(uint32_t count, const std::function<void(uint32_t index, uint32_t worker)>& task)
+{
+	if (count == 0)
+		return;
+
+	// split the indices into one contiguous range per worker
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		for (uint32_t worker = 0; worker < thread_count_; worker++)
+		{
+			uint32_t begin = (uint32_t)((uint64_t)count * worker / thread_count_);
+			uint32_t end = (uint32_t)((uint64_t)count * (worker + 1) / thread_count_);
+			ranges_[worker].Range.store(utility::PackRange(begin, end), std::memory_order_relaxed);
+		}
+
+		task_ = &task;
+		busy_workers_ = (uint32_t)threads_.size();
+		generation_++;
+	}
+	wake_.notify_all();
+
+	RunWorker(0);
+
+	// the last steals may still be running on other threads
+	std::unique_lock<std::mutex> lock(mutex_);
+	done_.wait(lock, [this]() { return busy_workers_ == 0; });
+	task_ = nullptr;
+}
+
+void ThreadPool::WorkerLoop(uint32_t worker)
+{
+	RT_PROFILE_THREAD(("worker " + std::to_string(worker)).c_str());
+
+	uint64_t seen_generation = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			wake_.wait(lock, [&]() { return stop_ || generation_ != seen_generation; });
+
+			if (stop_)
+				return;
+
+			seen_generation = generation_;
+		}
+
+		RunWorker(worker);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			busy_workers_--;
+		}
+		done_.notify_one();
+	}
+}
+
+void ThreadPool::RunWorker(uint32_t worker)
+{
+	const std::function<void(uint32_t, uint32_t)>& task = *task_;
+
+	uint32_t index;
+	while (PopFront(worker, index) || Steal(worker, index))
+	{
+		task(index, worker);
+	}
+}
+
+bool ThreadPool::PopFront(uint32_t worker, uint32_t& index)
+{
+	std::atomic<uint64_t>& range = ranges_[worker].Range;
+	uint64_t current = range.load(std::memory_order_acquire);
+
+	while (true)
+	{
+		uint32_t begin = utility::RangeBegin(current);
+		uint32_t end = utility::RangeEnd(current);
+		if (begin >= end)
+			return false;
+
+		// fails if a thief shrank the range in the meantime, current is then reloaded
+		if (range.compare_exchange_weak(current, utility::PackRange(begin + 1, end), std::memory_order_acq_rel))
+		{
+			index = begin;
+			return true;
+		}
+	}
+}
+
+bool ThreadPool::Steal(uint32_t worker, uint32_t& index)
+{
+	while (true)
+	{
+		// the victim with the most work left
+		uint32_t victim = worker;
+		uint32_t most = 0;
+		for (uint32_t i = 1; i < thread_count_; i++)
+		{
+			uint32_t candidate = (worker + i) % thread_count_;
+			uint64_t range = ranges_[candidate].Range.load(std::memory_order_relaxed);
+			uint32_t remaining = utility::RangeEnd(range) - std::min(utility::RangeBegin(range), utility::RangeEnd(range));
+			if (remaining > most)
+			{
+				most = remaining;
+				victim = candidate;
+			}
+		}
+
+		if (most == 0)
+			return false;
+
+		// take the back half, the victim keeps working through the front
+		std::atomic<uint64_t>& range = ranges_[victim].Range;
+		uint64_t current = range.load(std::memory_order_acquire);
+		uint32_t begin = utility::RangeBegin(current);
+		uint32_t end = utility::RangeEnd(current);
+		if (begin >= end)
+			continue;
+
+		uint32_t split = end - (end - begin + 1) / 2;
+		if (!range.compare_exchange_strong(current, utility::PackRange(begin, split), std::memory_order_acq_rel))
+			continue;
+
+		// run the first stolen index now and keep the rest, where other thieves can find it
+		index = split;
+		ranges_[worker].Range.store(utility::PackRange(split + 1, end), std::memory_order_release);
+		return true;
+	}
+}
@@ -0,0 +1,69 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: ThreadPool.h
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/ThreadPool.h
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// persistent worker threads running parallel loops
+// every worker owns a contiguous range of indices and takes from its front
+// a worker that runs dry steals the back half of the largest remaining range
+class ThreadPool
+{
+public:
+	// thread_count includes the calling thread, 0 uses every hardware thread
+	explicit ThreadPool(uint32_t thread_count = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	uint32_t GetThreadCount() const { return thread_count_; }
+
+	// runs task(index, worker) for every index in [0, count) and returns once all are done
+	// worker is in [0, GetThreadCount()), the calling thread is worker 0
+	void ParallelFor(uint32_t count, const std::function<void(uint32_t index, uint32_t worker)>& task);
+
+	static uint32_t GetHardwareThreadCount();
+private:
+	void WorkerLoop(uint32_t worker);
+	void RunWorker(uint32_t worker);
+
+	bool PopFront(uint32_t worker, uint32_t& index);
+	bool Steal(uint32_t worker, uint32_t& index);
+private:
+	// begin in the low 32 bits, end in the high 32 bits, so both change in one atomic operation
+	// padded to a cache line so workers don't contend on each other's ranges
+	struct alignas(64) WorkRange
+	{
+		std::atomic<uint64_t> Range{ 0 };
+	};
+
+	uint32_t thread_count_ = 1;
+	std::vector<std::thread> threads_;
+	std::unique_ptr<WorkRange[]> ranges_;
+
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::condition_variable done_;
+
+	const std::function<void(uint32_t, uint32_t)>* task_ = nullptr;
+	uint64_t generation_ = 0;
+	uint32_t busy_workers_ = 0;
+	bool stop_ = false;
+};
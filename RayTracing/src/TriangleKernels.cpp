@@ -0,0 +1,135 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: TriangleKernels.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/TriangleKernels.cpp
+*/
+
+#include "TriangleKernels.h"
+
+#include <glm/glm.hpp>
+
+#include <limits>
+#include <utility>
+
+void TriangleSoA::Build(const Mesh& mesh, const std::vector<uint32_t>& order)
+{
+	// padding slots hold NaN so they can never produce a hit
+	size_t padded = order.size() + kMaxLanes;
+	float nan = std::numeric_limits<float>::quiet_NaN();
+
+	for (int vertex = 0; vertex < 3; vertex++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+			V[vertex][axis].assign(padded, nan);
+	}
+	Index = order;
+
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const uint32_t* indices = &mesh.Indices[(size_t)order[i] * 3];
+		for (int vertex = 0; vertex < 3; vertex++)
+		{
+			const glm::vec3& position = mesh.Vertices[indices[vertex]];
+			V[vertex][0][i] = position.x;
+			V[vertex][1][i] = position.y;
+			V[vertex][2][i] = position.z;
+		}
+	}
+}
+
+WatertightRay::WatertightRay(const Ray& ray)
+{
+	Origin[0] = ray.Origin.x;
+	Origin[1] = ray.Origin.y;
+	Origin[2] = ray.Origin.z;
+
+	glm::vec3 extent = glm::abs(ray.Direction);
+	Kz = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+	Kx = (Kz + 1) % 3;
+	Ky = (Kx + 1) % 3;
+
+	// keep the winding of the sheared triangles
+	if (ray.Direction[Kz] < 0.0f)
+		std::swap(Kx, Ky);
+
+	Sx = ray.Direction[Kx] / ray.Direction[Kz];
+	Sy = ray.Direction[Ky] / ray.Direction[Kz];
+	Sz = 1.0f / ray.Direction[Kz];
+}
+
+kernels::IntersectTrianglesFn kernels::GetIntersectTriangles(ISA isa)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+	if (isa != ISA::Scalar)
+		return IntersectTrianglesSSE;
+#endif
+	return IntersectTrianglesScalar;
+}
+
+void kernels::IntersectTrianglesScalar(const TriangleSoA& triangles, uint32_t first, uint32_t count,
+	const WatertightRay& ray, float& hit_distance, int& hit_slot)
+{
+	const std::vector<float>* v0 = triangles.V[0];
+	const std::vector<float>* v1 = triangles.V[1];
+	const std::vector<float>* v2 = triangles.V[2];
+
+	for (uint32_t slot = first; slot < first + count; slot++)
+	{
+		// vertices relative to the ray origin
+		float a_x = v0[ray.Kx][slot] - ray.Origin[ray.Kx];
+		float a_y = v0[ray.Ky][slot] - ray.Origin[ray.Ky];
+		float a_z = v0[ray.Kz][slot] - ray.Origin[ray.Kz];
+		float b_x = v1[ray.Kx][slot] - ray.Origin[ray.Kx];
+		float b_y = v1[ray.Ky][slot] - ray.Origin[ray.Ky];
+		float b_z = v1[ray.Kz][slot] - ray.Origin[ray.Kz];
+		float c_x = v2[ray.Kx][slot] - ray.Origin[ray.Kx];
+		float c_y = v2[ray.Ky][slot] - ray.Origin[ray.Ky];
+		float c_z = v2[ray.Kz][slot] - ray.Origin[ray.Kz];
+
+		// shear so the ray runs along +z
+		float ax = a_x - ray.Sx * a_z;
+		float ay = a_y - ray.Sy * a_z;
+		float bx = b_x - ray.Sx * b_z;
+		float by = b_y - ray.Sy * b_z;
+		float cx = c_x - ray.Sx * c_z;
+		float cy = c_y - ray.Sy * c_z;
+
+		// scaled barycentrics from the 2D edge functions
+		float u = cx * by - cy * bx;
+		float v = ax * cy - ay * cx;
+		float w = bx * ay - by * ax;
+
+		// exactly on an edge in single precision, decide it in double so the answer is consistent
+		if (u == 0.0f || v == 0.0f || w == 0.0f)
+		{
+			u = (float)((double)cx * (double)by - (double)cy * (double)bx);
+			v = (float)((double)ax * (double)cy - (double)ay * (double)cx);
+			w = (float)((double)bx * (double)ay - (double)by * (double)ax);
+		}
+
+		// mixed signs mean the ray passes outside, either winding is accepted
+		if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f))
+			continue;
+
+		float det = u + v + w;
+		if (det == 0.0f)
+			continue;
+
+		// interpolated, scaled hit distance
+		float az = ray.Sz * a_z;
+		float bz = ray.Sz * b_z;
+		float cz = ray.Sz * c_z;
+		float t = (u * az + v * bz + w * cz) / det;
+
+		if (t > 0.0f && t < hit_distance)
+		{
+			hit_distance = t;
+			hit_slot = (int)slot;
+		}
+	}
+}
@@ -0,0 +1,72 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: TriangleKernels.h
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/TriangleKernels.h
+*/
+
+#pragma once
+
+#include "Ray.h"
+#include "Scene.h"
+#include "SphereKernels.h"
+
+#include <cstdint>
+#include <vector>
+
+// structure of arrays copy of a mesh's triangles in BVH leaf order, one array per vertex component
+struct TriangleSoA
+{
+	// the arrays are padded by this many NaN entries so full width loads never run past the end
+	static constexpr uint32_t kMaxLanes = 4;
+
+	// V[vertex][axis], e.g. V[2][1] holds the y of every triangle's third vertex
+	std::vector<float> V[3][3];
+
+	// triangle index in the mesh for every slot
+	std::vector<uint32_t> Index;
+
+	// order is the BVH primitive order, see BVH::GetIndices
+	void Build(const Mesh& mesh, const std::vector<uint32_t>& order);
+};
+
+// per ray setup of the watertight ray-triangle test
+// Woop, Benthin and Wald - Watertight Ray/Triangle Intersection (2013)
+// the ray is sheared so it points down +z, then edge functions are evaluated in 2D,
+// so neighbouring triangles agree exactly on their shared edges and rays never slip through
+struct WatertightRay
+{
+	float Origin[3];
+
+	// kz is the axis the direction is largest along, kx and ky the other two
+	int Kx, Ky, Kz;
+
+	// shear constants
+	float Sx, Sy, Sz;
+
+	WatertightRay(const Ray& ray);
+};
+
+namespace kernels
+{
+	// tests the triangles in slots [first, first + count) against the ray
+	// on a closer hit, lowers hit_distance and sets hit_slot to the SoA slot
+	// every kernel produces bit-identical results to the scalar one
+	using IntersectTrianglesFn = void(*)(const TriangleSoA& triangles, uint32_t first, uint32_t count,
+		const WatertightRay& ray, float& hit_distance, int& hit_slot);
+
+	// SSE for every x64 instruction set, the four wide kernel already matches the leaf width
+	IntersectTrianglesFn GetIntersectTriangles(ISA isa);
+
+	void IntersectTrianglesScalar(const TriangleSoA& triangles, uint32_t first, uint32_t count,
+		const WatertightRay& ray, float& hit_distance, int& hit_slot);
+
+#if defined(__x86_64__) || defined(_M_X64)
+	void IntersectTrianglesSSE(const TriangleSoA& triangles, uint32_t first, uint32_t count,
+		const WatertightRay& ray, float& hit_distance, int& hit_slot);
+#endif
+}
@@ -0,0 +1,118 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: TriangleKernelsSSE.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/TriangleKernelsSSE.cpp
+
+	Notes: SSE2 is part of x64, so this kernel needs no extra compiler flags.
+*/
+
+#include "TriangleKernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+#include <emmintrin.h>
+
+void kernels::IntersectTrianglesSSE(const TriangleSoA& triangles, uint32_t first, uint32_t count,
+	const WatertightRay& ray, float& hit_distance, int& hit_slot)
+{
+	// same operations in the same order as the scalar kernel, so results are bit-identical
+	const float* v0x = triangles.V[0][ray.Kx].data();
+	const float* v0y = triangles.V[0][ray.Ky].data();
+	const float* v0z = triangles.V[0][ray.Kz].data();
+	const float* v1x = triangles.V[1][ray.Kx].data();
+	const float* v1y = triangles.V[1][ray.Ky].data();
+	const float* v1z = triangles.V[1][ray.Kz].data();
+	const float* v2x = triangles.V[2][ray.Kx].data();
+	const float* v2y = triangles.V[2][ray.Ky].data();
+	const float* v2z = triangles.V[2][ray.Kz].data();
+
+	const __m128 origin_x = _mm_set1_ps(ray.Origin[ray.Kx]);
+	const __m128 origin_y = _mm_set1_ps(ray.Origin[ray.Ky]);
+	const __m128 origin_z = _mm_set1_ps(ray.Origin[ray.Kz]);
+	const __m128 shear_x = _mm_set1_ps(ray.Sx);
+	const __m128 shear_y = _mm_set1_ps(ray.Sy);
+	const __m128 shear_z = _mm_set1_ps(ray.Sz);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128i lanes = _mm_set_epi32(3, 2, 1, 0);
+
+	__m128 closest = _mm_set1_ps(hit_distance);
+
+	for (uint32_t i = 0; i < count; i += 4)
+	{
+		uint32_t slot = first + i;
+		uint32_t remaining = count - i < 4 ? count - i : 4;
+
+		__m128 a_x = _mm_sub_ps(_mm_loadu_ps(v0x + slot), origin_x);
+		__m128 a_y = _mm_sub_ps(_mm_loadu_ps(v0y + slot), origin_y);
+		__m128 a_z = _mm_sub_ps(_mm_loadu_ps(v0z + slot), origin_z);
+		__m128 b_x = _mm_sub_ps(_mm_loadu_ps(v1x + slot), origin_x);
+		__m128 b_y = _mm_sub_ps(_mm_loadu_ps(v1y + slot), origin_y);
+		__m128 b_z = _mm_sub_ps(_mm_loadu_ps(v1z + slot), origin_z);
+		__m128 c_x = _mm_sub_ps(_mm_loadu_ps(v2x + slot), origin_x);
+		__m128 c_y = _mm_sub_ps(_mm_loadu_ps(v2y + slot), origin_y);
+		__m128 c_z = _mm_sub_ps(_mm_loadu_ps(v2z + slot), origin_z);
+
+		__m128 ax = _mm_sub_ps(a_x, _mm_mul_ps(shear_x, a_z));
+		__m128 ay = _mm_sub_ps(a_y, _mm_mul_ps(shear_y, a_z));
+		__m128 bx = _mm_sub_ps(b_x, _mm_mul_ps(shear_x, b_z));
+		__m128 by = _mm_sub_ps(b_y, _mm_mul_ps(shear_y, b_z));
+		__m128 cx = _mm_sub_ps(c_x, _mm_mul_ps(shear_x, c_z));
+		__m128 cy = _mm_sub_ps(c_y, _mm_mul_ps(shear_y, c_z));
+
+		__m128 u = _mm_sub_ps(_mm_mul_ps(cx, by), _mm_mul_ps(cy, bx));
+		__m128 v = _mm_sub_ps(_mm_mul_ps(ax, cy), _mm_mul_ps(ay, cx));
+		__m128 w = _mm_sub_ps(_mm_mul_ps(bx, ay), _mm_mul_ps(by, ax));
+
+		__m128 valid = _mm_castsi128_ps(_mm_cmplt_epi32(lanes, _mm_set1_epi32((int)remaining)));
+
+		// edge cases are rare, the scalar kernel redoes them in double precision
+		__m128 on_edge = _mm_or_ps(_mm_or_ps(_mm_cmpeq_ps(u, zero), _mm_cmpeq_ps(v, zero)), _mm_cmpeq_ps(w, zero));
+		if (_mm_movemask_ps(_mm_and_ps(on_edge, valid)) != 0)
+		{
+			IntersectTrianglesScalar(triangles, slot, remaining, ray, hit_distance, hit_slot);
+			closest = _mm_set1_ps(hit_distance);
+			continue;
+		}
+
+		__m128 negative = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(u, zero), _mm_cmplt_ps(v, zero)), _mm_cmplt_ps(w, zero));
+		__m128 positive = _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(u, zero), _mm_cmpgt_ps(v, zero)), _mm_cmpgt_ps(w, zero));
+
+		__m128 det = _mm_add_ps(_mm_add_ps(u, v), w);
+
+		__m128 az = _mm_mul_ps(shear_z, a_z);
+		__m128 bz = _mm_mul_ps(shear_z, b_z);
+		__m128 cz = _mm_mul_ps(shear_z, c_z);
+		__m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(u, az), _mm_mul_ps(v, bz)), _mm_mul_ps(w, cz));
+		t = _mm_div_ps(t, det);
+
+		__m128 mask = _mm_andnot_ps(_mm_and_ps(negative, positive), valid);
+		mask = _mm_and_ps(mask, _mm_cmpneq_ps(det, zero));
+		mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, zero));
+		mask = _mm_and_ps(mask, _mm_cmplt_ps(t, closest));
+
+		int bits = _mm_movemask_ps(mask);
+		if (bits == 0)
+			continue;
+
+		// resolve the hits in lane order, exactly like the scalar loop
+		alignas(16) float distances[4];
+		_mm_store_ps(distances, t);
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if ((bits & (1 << lane)) && distances[lane] < hit_distance)
+			{
+				hit_distance = distances[lane];
+				hit_slot = (int)(slot + lane);
+			}
+		}
+
+		closest = _mm_set1_ps(hit_distance);
+	}
+}
+
+#endif
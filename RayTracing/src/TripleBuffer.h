@@ -0,0 +1,60 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: TripleBuffer.h
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/TripleBuffer.h
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// hands the latest value from one producer thread to one consumer thread, neither side ever waits
+// each side owns a slot, the third is shared and swapped in a single atomic exchange,
+// so a value published twice before the consumer looks is simply replaced
+template<typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() = default;
+
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+	// producer side, the slot holds whatever was published two values ago, so fill all of it
+	T& GetWriteSlot() { return slots_[write_]; }
+
+	void Publish()
+	{
+		write_ = shared_.exchange(write_ | kFresh, std::memory_order_acq_rel) & kIndexMask;
+	}
+
+	// consumer side, takes the newest published value, returns false if nothing new was published since the last call
+	bool Acquire()
+	{
+		if (!(shared_.load(std::memory_order_relaxed) & kFresh))
+			return false;
+
+		read_ = shared_.exchange(read_, std::memory_order_acq_rel) & kIndexMask;
+		return true;
+	}
+
+	// the last acquired value, stays valid until the next Acquire
+	T& GetReadSlot() { return slots_[read_]; }
+	const T& GetReadSlot() const { return slots_[read_]; }
+private:
+	static constexpr uint32_t kIndexMask = 3;
+	static constexpr uint32_t kFresh = 4;
+
+	T slots_[3];
+	uint32_t write_ = 0;
+	uint32_t read_ = 1;
+
+	// index of the shared slot, with kFresh set while it holds a value the consumer has not taken
+	std::atomic<uint32_t> shared_{ 2 };
+};
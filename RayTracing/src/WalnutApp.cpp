@@ -16,104 +16,53 @@
 #include "Walnut/Image.h"
 #include "Walnut/Timer.h"
 
+#include "Profiler.h"
 #include "Renderer.h"
+#include "RenderThread.h"
 #include "Camera.h"
+#include "SceneFile.h"
+#include "Scenes.h"
+#include "WalnutImageSink.h"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cstdio>
+
 using namespace Walnut;
 
 class FrontEnd : public Walnut::Layer
 {
 public:
-	FrontEnd()
+	// scene_path is a .rtscene or text scene, the default scene is used if it is empty or fails to load
+	FrontEnd(const std::string& scene_path)
 		: camera_(45.0f, 0.1f, 100.0f)
 	{
-		// materials in the scene
-		Material& floor = scene_.Materials.emplace_back();
-		floor.Albedo = { 0.1f, 0.1f, 0.1f };
-		//floor.Albedo = { 1.0f, 1.0f, 1.0f };
-		floor.Roughness = 0.0f;
-		floor.EmissionColor = floor.Albedo;
-		floor.EmissionPower = 0;
-
-		Material& red = scene_.Materials.emplace_back();
-		red.Albedo = { 1.0f, 0.0f, 0.0f };
-		red.Roughness = 0.1f;
-		red.EmissionColor = red.Albedo;
-		red.EmissionPower = 0.5;
-
-		Material& green = scene_.Materials.emplace_back();
-		green.Albedo = { 0.0f, 1.0f, 0.0f };
-		green.Roughness = 0.1f;
-		green.EmissionColor = green.Albedo;
-		green.EmissionPower = 0.5;
-
-		Material& blue = scene_.Materials.emplace_back();
-		blue.Albedo = { 0.0f, 0.0f, 1.0f };
-		blue.Roughness = 0.1f;
-		blue.EmissionColor = blue.Albedo;
-		blue.EmissionPower = 0.5;
+		scene_ = scenes::Default();
 
-		Material& cyan = scene_.Materials.emplace_back();
-		cyan.Albedo = { 0.0f, 1.0f, 1.0f };
-		cyan.Roughness = 0.1f;
-		cyan.EmissionColor = cyan.Albedo;
-		cyan.EmissionPower = 0.5;
-
-		Material& yellow = scene_.Materials.emplace_back();
-		yellow.Albedo = { 1.0f, 1.0f, 0.0f };
-		yellow.Roughness = 0.1f;
-		yellow.EmissionColor = yellow.Albedo;
-		yellow.EmissionPower = 0.5;
-
-		Material& magenta = scene_.Materials.emplace_back();
-		magenta.Albedo = { 1.0f, 0.0f, 1.0f };
-		magenta.Roughness = 0.1f;
-		magenta.EmissionColor = magenta.Albedo;
-		magenta.EmissionPower = 0.5;
-
-		// spheres in the scene
+		BVH bvh;
+		if (!scene_path.empty())
 		{
-			Sphere sphere;
-			sphere.Position = { 0.0f, -1000.5f, 0.0f };
-			sphere.Radius = 1000.0f;
-			sphere.MaterialIndex = 0;
-			scene_.Spheres.push_back(sphere);
+			std::string error;
+			if (!scene_file::Load(scene_path, scene_, &bvh, &error))
+				fprintf(stderr, "could not load %s: %s\n", scene_path.c_str(), error.c_str());
 		}
 
-		{
-			Sphere sphere;
-			sphere.Position = { 0.0f, 0.0f, 0.0f };
-			sphere.Radius = 0.5f;
-			sphere.MaterialIndex = 1;
-			scene_.Spheres.push_back(sphere);
-		}
+		// the render thread keeps its own copy of the scene, edits made here are sent over object by object
+		render_thread_ = std::make_unique<RenderThread>(scene_, std::move(bvh), 45.0f, 0.1f, 100.0f);
 
-		{
-			Sphere sphere;
-			sphere.Position = { 1.1f, 0.0f, 0.0f };
-			sphere.Radius = 0.5f;
-			sphere.MaterialIndex = 2;
-			scene_.Spheres.push_back(sphere);
-		}
-
-		{
-			Sphere sphere;
-			sphere.Position = { 0.0f, 0.0f, 1.1f };
-			sphere.Radius = 0.5f;
-			sphere.MaterialIndex = 3;
-			scene_.Spheres.push_back(sphere);
-		}
+		// display the rendered frames in the viewport
+		image_sink_ = std::make_shared<WalnutImageSink>();
 
+		RT_PROFILE_THREAD("ui");
 	}
 
 	virtual void OnUpdate(float ts) override
 	{
-		// reset accumulation when moving camera
+		// reset accumulation and render a preview when moving camera
 		if (camera_.OnUpdate(ts))
 		{
-			renderer_.ResetFrameIndex();
+			camera_moved_ = true;
 		}
 	}
 
@@ -130,14 +79,151 @@ public:
 		}
 		*/
 
+		// settings are sent to the render thread with the camera at the end of the UI frame
+		Renderer::Settings& settings = settings_;
+
 		// accumulate path tracing
-		ImGui::Checkbox("Accumulate", &renderer_.GetSettings().Accumulate);
+		ImGui::Checkbox("Accumulate", &settings.Accumulate);
+
+		// intersection kernel picked at runtime from the CPU features
+		ImGui::Checkbox("SIMD", &settings.SIMD);
+		ImGui::SameLine();
+		ImGui::Text("(%s)", kernels::GetISAName(kernels::GetBestISA()));
+
+		// breadth first integrator, the image is the same either way
+		ImGui::Checkbox("Wavefront", &settings.Wavefront);
+		if (settings.Wavefront)
+		{
+			ImGui::SameLine();
+			ImGui::Checkbox("Sort rays", &settings.SortRays);
+		}
+
+		// sample the emissive spheres directly at every bounce
+		if (ImGui::Checkbox("Next event estimation", &settings.NextEventEstimation))
+		{
+			reset_accumulation_ = true;
+		}
+
+		// longest paths, and whether dark paths may end before that
+		int max_depth = (int)settings.MaxDepth;
+		if (ImGui::SliderInt("Max depth", &max_depth, 1, 16))
+		{
+			settings.MaxDepth = (uint32_t)max_depth;
+			reset_accumulation_ = true;
+		}
+		if (ImGui::Checkbox("Russian roulette", &settings.RussianRoulette))
+		{
+			reset_accumulation_ = true;
+		}
+
+		// accumulation storage, the change takes effect on the next frame
+		int accumulation = (int)settings.Accumulation;
+		if (ImGui::Combo("Accumulation", &accumulation, "RGB float\0RGB half\0Fixed point\0"))
+		{
+			settings.Accumulation = (AccumulationFormat)accumulation;
+		}
+
+		// display only, accumulation carries on
+		int tonemapper = (int)settings.Display.Operator;
+		if (ImGui::Combo("Tone mapping", &tonemapper, "Clamp\0Reinhard\0ACES\0"))
+		{
+			settings.Display.Operator = (Tonemapper)tonemapper;
+		}
+		ImGui::DragFloat("Exposure", &settings.Display.Exposure, 0.05f, -10.0f, 10.0f);
+		ImGui::Checkbox("sRGB", &settings.Display.SRGB);
+
+		// also display only, the first hits are traced on the next frame
+		ImGui::Checkbox("Denoise", &settings.Denoise);
+		if (settings.Denoise)
+		{
+			int denoise_passes = (int)settings.DenoisePasses;
+			if (ImGui::SliderInt("Denoise passes", &denoise_passes, 1, 8))
+			{
+				settings.DenoisePasses = (uint32_t)denoise_passes;
+			}
+		}
+
+		// render threads and tile size, 0 threads uses every hardware thread
+		int thread_count = (int)settings.ThreadCount;
+		if (ImGui::SliderInt("Threads", &thread_count, 0, (int)ThreadPool::GetHardwareThreadCount()))
+		{
+			settings.ThreadCount = (uint32_t)thread_count;
+		}
+
+		int tile_size = (int)settings.TileSize;
+		if (ImGui::SliderInt("Tile size", &tile_size, 4, 128))
+		{
+			settings.TileSize = (uint32_t)tile_size;
+		}
+
+		// fixed seed, so the same view always converges through the same images
+		if (ImGui::Checkbox("Deterministic seed", &settings.DeterministicSeed))
+		{
+			reset_accumulation_ = true;
+		}
+		if (settings.DeterministicSeed)
+		{
+			int seed = (int)settings.Seed;
+			if (ImGui::InputInt("Seed", &seed))
+			{
+				settings.Seed = (uint32_t)seed;
+				reset_accumulation_ = true;
+			}
+		}
+
+		// stop sampling converged tiles and spend the time on noisy ones
+		ImGui::Checkbox("Adaptive sampling", &settings.AdaptiveSampling);
+		if (settings.AdaptiveSampling)
+		{
+			ImGui::DragFloat("Noise threshold", &settings.NoiseThreshold, 0.001f, 0.001f, 1.0f);
+			ImGui::Text("Converged: %.1f%%", frame_.ConvergedRatio * 100.0f);
+		}
+
+		// lower resolution while the camera moves
+		ImGui::Checkbox("Progressive preview", &settings.ProgressivePreview);
+		if (settings.ProgressivePreview)
+		{
+			ImGui::DragFloat("Preview budget (ms)", &settings.PreviewFrameBudget, 0.5f, 1.0f, 200.0f);
+			ImGui::Text("Preview resolution: 1/%u", frame_.PreviewScale);
+		}
+
+		// keep the samples of surfaces that stay in view while the camera moves, instead of the preview
+		ImGui::Checkbox("Temporal reprojection", &settings.TemporalReprojection);
+		if (settings.TemporalReprojection)
+		{
+			int max_reprojected = (int)settings.MaxReprojectedSamples;
+			if (ImGui::SliderInt("Max reprojected samples", &max_reprojected, 1, 256))
+				settings.MaxReprojectedSamples = (uint32_t)max_reprojected;
+		}
+
+		// precomputed ray directions cost width * height vectors and a rebuild on every move
+		ImGui::Checkbox("Cache ray directions", &cache_ray_directions_);
+
+		// slowest tile vs average shows how evenly the work is spread
+		const std::vector<float>& tile_times = frame_.TileTimes;
+		if (!tile_times.empty())
+		{
+			float total = 0.0f, slowest = 0.0f;
+			for (float time : tile_times)
+			{
+				total += time;
+				slowest = std::max(slowest, time);
+			}
+			ImGui::Text("Tiles: %zu, avg %.3fms, max %.3fms", tile_times.size(), total / tile_times.size(), slowest);
+		}
 
 		if (ImGui::Button("Reset accumulation"))
 		{
-			renderer_.ResetFrameIndex();
+			reset_accumulation_ = true;
 		}
 
+#ifdef RT_PROFILE
+		if (ImGui::CollapsingHeader("Profiler"))
+		{
+			DrawProfiler();
+		}
+#endif
+
 		ImGui::End();
 
 		ImGui::Begin("Scene spheres");
@@ -148,9 +234,16 @@ public:
 			ImGui::PushID(i);
 
 			Sphere& sphere = scene_.Spheres[i];
-			ImGui::DragFloat3("Position", glm::value_ptr(sphere.Position), 0.1f);
-			ImGui::DragFloat("Radius", &sphere.Radius, 0.1f);
-			ImGui::DragInt("Material", &sphere.MaterialIndex, 1.0f, 0, (int)scene_.Materials.size() - 1);
+
+			// the renderer refits the nodes above an edited sphere and restarts accumulation
+			bool edited = ImGui::DragFloat3("Position", glm::value_ptr(sphere.Position), 0.1f);
+			edited |= ImGui::DragFloat("Radius", &sphere.Radius, 0.1f);
+			edited |= ImGui::DragInt("Material", &sphere.MaterialIndex, 1.0f, 0, (int)scene_.Materials.size() - 1);
+			if (edited)
+			{
+				scene_.MarkSphereEdited(i);
+				render_thread_->MarkSphereEdited((uint32_t)i);
+			}
 
 			ImGui::Separator();
 			ImGui::PopID();
@@ -158,6 +251,30 @@ public:
 
 		ImGui::End();
 
+		if (!scene_.Instances.empty())
+		{
+			ImGui::Begin("Scene instances");
+
+			for (size_t i = 0; i < scene_.Instances.size(); i++)
+			{
+				ImGui::PushID(i);
+
+				Instance& instance = scene_.Instances[i];
+
+				// moving an instance only refits the top level structure
+				if (ImGui::DragFloat3("Position", glm::value_ptr(instance.Transform[3]), 0.1f))
+				{
+					scene_.MarkInstanceEdited(i);
+					render_thread_->MarkInstanceEdited((uint32_t)i);
+				}
+				ImGui::Text("Prototype %u", instance.PrototypeIndex);
+
+				ImGui::Separator();
+				ImGui::PopID();
+			}
+
+			ImGui::End();
+		}
 
 		ImGui::Begin("Scene materials");
 
@@ -168,11 +285,16 @@ public:
 
 			Material& material = scene_.Materials[i];
 
-			ImGui::ColorEdit3("Albedo", glm::value_ptr(material.Albedo));
-			ImGui::DragFloat("Rougness", &material.Roughness, 0.05f, 0.0f, 1.0f);
-			//ImGui::DragFloat("Metallic", &material.Metallic, 0.05f, 0.0f, 1.0f);
-			ImGui::ColorEdit3("Emission colour", glm::value_ptr(material.EmissionColor));
-			ImGui::DragFloat("Emission power", &material.EmissionPower, 0.05f, 0.0f, FLT_MAX);
+			bool edited = ImGui::ColorEdit3("Albedo", glm::value_ptr(material.Albedo));
+			edited |= ImGui::DragFloat("Rougness", &material.Roughness, 0.05f, 0.0f, 1.0f);
+			//edited |= ImGui::DragFloat("Metallic", &material.Metallic, 0.05f, 0.0f, 1.0f);
+			edited |= ImGui::ColorEdit3("Emission colour", glm::value_ptr(material.EmissionColor));
+			edited |= ImGui::DragFloat("Emission power", &material.EmissionPower, 0.05f, 0.0f, FLT_MAX);
+			if (edited)
+			{
+				scene_.MarkMaterialEdited();
+				render_thread_->MarkMaterialEdited((uint32_t)i);
+			}
 
 			ImGui::Separator();
 			ImGui::PopID();
@@ -190,7 +312,24 @@ public:
 		viewport_width_ = ImGui::GetContentRegionAvail().x;
 		viewport_height_ = ImGui::GetContentRegionAvail().y;
 
-		auto image = renderer_.GetFinalImage();
+		// upload the latest finished frame, if the render thread has one the viewport has not shown yet
+		if (render_thread_->AcquireFrame())
+		{
+			const RenderThread::Frame& frame = render_thread_->GetFrame();
+			RT_PROFILE_SCOPE(Upload);
+			image_sink_->OnResize(frame.Width, frame.Height);
+			image_sink_->SetData(frame.Pixels.data(), frame.Width, frame.Height);
+
+			frame_.RenderTime = frame.RenderTime;
+			frame_.PreviewScale = frame.PreviewScale;
+			frame_.ConvergedRatio = frame.ConvergedRatio;
+			frame_.TileTimes = frame.TileTimes;
+
+			fps_ = 1000.f / frame.RenderTime;
+			render_time_ = frame.RenderTime;
+		}
+
+		auto image = image_sink_->GetImage();
 		if (image)
 		{
 			// if there is an image, then display the image
@@ -204,25 +343,132 @@ public:
 		Render();
 	}
 
+	// hands this UI frame's settings, camera and scene edits to the render thread, never waits for it
 	void Render()
 	{
-		Timer timer;
-
-		renderer_.OnResize(viewport_width_, viewport_height_);
 		camera_.OnResize(viewport_width_, viewport_height_);
-		renderer_.Render(scene_, camera_);
 
-		fps_ = 1000.f / timer.ElapsedMillis();
-		render_time_ = timer.ElapsedMillis();
+		// only the edited objects are copied, never the whole scene
+		render_thread_->SubmitEdits(scene_);
+
+		RenderThread::Request request;
+		request.Settings = settings_;
+		request.Width = viewport_width_;
+		request.Height = viewport_height_;
+		request.Position = camera_.GetPosition();
+		request.Direction = camera_.GetDirection();
+		request.CacheRayDirections = cache_ray_directions_;
+		render_thread_->Submit(request);
+
+		// after the request, so the render thread applies them to this frame's settings and view
+		if (camera_moved_)
+			render_thread_->OnCameraMoved();
+		else if (reset_accumulation_)
+			render_thread_->ResetAccumulation();
+
+		camera_moved_ = false;
+		reset_accumulation_ = false;
 	}
+
+#ifdef RT_PROFILE
+	// CPU time per frame of each stage, summed over the render threads, refreshed twice a second so it can be read
+	void DrawProfiler()
+	{
+		if (profile_timer_.ElapsedMillis() > 500.0f)
+		{
+			std::vector<profiler::ThreadStats> stats = profiler::GetStats();
+			profile_interval_.resize(stats.size());
+			for (size_t i = 0; i < stats.size(); i++)
+			{
+				profile_interval_[i] = i < profile_last_.size() ? profiler::Difference(stats[i], profile_last_[i]) : stats[i];
+			}
+			profile_last_ = std::move(stats);
+			profile_timer_.Reset();
+		}
+
+		profiler::ThreadStats total = profiler::Sum(profile_interval_);
+		uint64_t frames = total.StageCalls[(size_t)profiler::Stage::Frame];
+		if (frames == 0)
+		{
+			ImGui::Text("No frames rendered");
+			return;
+		}
+
+		for (uint32_t stage = 0; stage < (uint32_t)profiler::Stage::Count; stage++)
+		{
+			if (total.StageCalls[stage] == 0)
+				continue;
+
+			ImGui::Text("%-10s %9.3fms %10.0f calls", profiler::GetStageName((profiler::Stage)stage),
+				total.StageNanoseconds[stage] / 1e6 / frames, (double)total.StageCalls[stage] / frames);
+		}
+
+		ImGui::Separator();
+		for (uint32_t depth = 0; depth < profiler::kMaxDepth; depth++)
+		{
+			if (total.RaysAtDepth[depth] > 0)
+				ImGui::Text("Rays at depth %u: %.0f", depth, (double)total.RaysAtDepth[depth] / frames);
+		}
+		for (uint32_t counter = 0; counter < (uint32_t)profiler::Counter::Count; counter++)
+		{
+			ImGui::Text("%s: %.0f", profiler::GetCounterName((profiler::Counter)counter), (double)total.Counters[counter] / frames);
+		}
+
+		// a thread that spends much less time in tiles than the others ran out of work
+		ImGui::Separator();
+		const size_t tile = (size_t)profiler::Stage::Tile;
+		double busiest = 0.0, sum = 0.0;
+		uint32_t threads = 0;
+		for (const profiler::ThreadStats& thread : profile_interval_)
+		{
+			if (thread.StageNanoseconds[tile] == 0)
+				continue;
+
+			double milliseconds = thread.StageNanoseconds[tile] / 1e6 / frames;
+			ImGui::Text("%-10s %9.3fms in tiles", thread.Name.c_str(), milliseconds);
+			busiest = std::max(busiest, milliseconds);
+			sum += milliseconds;
+			threads++;
+		}
+		if (threads > 0)
+			ImGui::Text("Busiest thread / average: %.2f", busiest * threads / sum);
+
+		// timeline of frames, tiles and resolves for chrome://tracing or Perfetto
+		if (!profiler::IsCapturing())
+		{
+			if (ImGui::Button("Start trace"))
+				profiler::BeginCapture();
+		}
+		else if (ImGui::Button("Save trace.json"))
+		{
+			profiler::EndCapture("trace.json");
+		}
+	}
+#endif
 private:
 	// data members
 
-	Renderer renderer_;
+	std::unique_ptr<RenderThread> render_thread_;
+	Renderer::Settings settings_;
+	std::shared_ptr<WalnutImageSink> image_sink_;
 	Camera camera_;
 	Scene scene_;
 	uint32_t viewport_width_ = 0, viewport_height_ = 0;
 
+	// UI state not yet handed to the render thread
+	bool camera_moved_ = false;
+	bool reset_accumulation_ = false;
+	bool cache_ray_directions_ = false;
+
+	// renderer state that came with the last displayed frame, without its pixels
+	RenderThread::Frame frame_;
+
+#ifdef RT_PROFILE
+	Timer profile_timer_;
+	std::vector<profiler::ThreadStats> profile_last_;
+	std::vector<profiler::ThreadStats> profile_interval_;
+#endif
+
 	float fps_ = 0.0f;
 	float render_time_ = 0.0f;
 };
@@ -233,7 +479,7 @@ Walnut::Application* Walnut::CreateApplication(int argc, char** argv)
 	spec.Name = "Ray Tracing";
 
 	Walnut::Application* app = new Walnut::Application(spec);
-	app->PushLayer<FrontEnd>();
+	app->PushLayer(std::make_shared<FrontEnd>(argc > 1 ? argv[1] : ""));
 	app->SetMenubarCallback([app]()
 		{
 			if (ImGui::BeginMenu("File"))
@@ -0,0 +1,48 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: WalnutImageSink.h
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/src/WalnutImageSink.h
+*/
+
+#pragma once
+
+#include "Walnut/Image.h"
+
+#include "FramebufferSink.h"
+
+#include <memory>
+
+// uploads every frame to a Walnut::Image so it can be displayed in the viewport
+class WalnutImageSink : public FramebufferSink
+{
+public:
+	void OnResize(uint32_t width, uint32_t height) override
+	{
+		if (image_)
+		{
+			// no resize necessary
+			if (image_->GetWidth() == width && image_->GetHeight() == height)
+				return;
+
+			image_->Resize(width, height);
+		}
+		else
+		{
+			image_ = std::make_shared<Walnut::Image>(width, height, Walnut::ImageFormat::RGBA);
+		}
+	}
+
+	void SetData(const uint32_t* data, uint32_t /*width*/, uint32_t /*height*/) override
+	{
+		image_->SetData(data);
+	}
+
+	std::shared_ptr<Walnut::Image> GetImage() const { return image_; }
+private:
+	std::shared_ptr<Walnut::Image> image_;
+};
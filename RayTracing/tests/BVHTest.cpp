@@ -0,0 +1,139 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: BVHTest.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/tests/BVHTest.cpp
+*/
+
+#include "Tests.h"
+
+#include "BVH.h"
+
+#include <cstdio>
+#include <functional>
+
+namespace utility
+{
+	static constexpr uint32_t kPrimitiveCount = 200;
+	static constexpr uint32_t kLeafWidth = 4;
+
+	// boxes scattered on a lattice, enough for a few levels of interior nodes
+	static std::vector<AABB> Boxes()
+	{
+		std::vector<AABB> bounds(kPrimitiveCount);
+		for (uint32_t i = 0; i < kPrimitiveCount; i++)
+		{
+			bounds[i].Min = glm::vec3((float)(i % 10), (float)(i * 7 % 13), (float)(i * 11 % 17));
+			bounds[i].Max = bounds[i].Min + glm::vec3(0.5f);
+		}
+		return bounds;
+	}
+
+	// first interior node after the root, 0 if there is none
+	static size_t FindInterior(const std::vector<BVHNode>& nodes, size_t after)
+	{
+		for (size_t i = after + 1; i < nodes.size(); i++)
+		{
+			if (i != 1 && !nodes[i].IsLeaf())
+				return i;
+		}
+		return 0;
+	}
+
+	// first leaf holding more than one primitive, 0 if there is none
+	static size_t FindLeaf(const std::vector<BVHNode>& nodes)
+	{
+		for (size_t i = 2; i < nodes.size(); i++)
+		{
+			if (nodes[i].IsLeaf() && nodes[i].Count > 1)
+				return i;
+		}
+		return 0;
+	}
+
+	// corrupts a copy of a good tree and expects Assign to refuse it and leave the BVH empty
+	static bool Refused(const BVH& good, const char* what, const std::function<bool(std::vector<BVHNode>&, std::vector<uint32_t>&)>& corrupt)
+	{
+		std::vector<BVHNode> nodes = good.GetNodes();
+		std::vector<uint32_t> indices = good.GetIndices();
+		if (!corrupt(nodes, indices))
+		{
+			printf("  the tree is too small to test %s\n", what);
+			return false;
+		}
+
+		// start from a loaded tree, so a refusal has something to clear
+		BVH bvh;
+		bvh.Assign(good.GetNodes(), good.GetIndices(), kLeafWidth);
+
+		if (bvh.Assign(std::move(nodes), std::move(indices), kLeafWidth))
+		{
+			printf("  accepted a tree with %s\n", what);
+			return false;
+		}
+		if (!bvh.Empty() || bvh.GetPrimitiveCount() != 0)
+		{
+			printf("  refused a tree with %s but kept nodes\n", what);
+			return false;
+		}
+		return true;
+	}
+}
+
+bool tests::StoredBVH()
+{
+	BVH good;
+	good.Build(utility::Boxes(), utility::kLeafWidth);
+
+	BVH copy;
+	if (!copy.Assign(good.GetNodes(), good.GetIndices(), utility::kLeafWidth) || copy.GetNodes().size() != good.GetNodes().size())
+	{
+		printf("  refused a tree straight from Build\n");
+		return false;
+	}
+
+	bool passed = true;
+
+	// two interior nodes share one pair of children, the other pair is orphaned
+	passed &= utility::Refused(good, "shared children", [](std::vector<BVHNode>& nodes, std::vector<uint32_t>&)
+		{
+			size_t first = utility::FindInterior(nodes, 0);
+			size_t second = utility::FindInterior(nodes, first);
+			if (first == 0 || second == 0)
+				return false;
+			nodes[first].LeftFirst = nodes[second].LeftFirst;
+			return true;
+		});
+
+	// one primitive listed twice and another not at all
+	passed &= utility::Refused(good, "a duplicate index", [](std::vector<BVHNode>&, std::vector<uint32_t>& indices)
+		{
+			indices[3] = indices[4];
+			return true;
+		});
+
+	// a leaf loses its last primitive, which no other leaf holds
+	passed &= utility::Refused(good, "an uncovered primitive", [](std::vector<BVHNode>& nodes, std::vector<uint32_t>&)
+		{
+			size_t leaf = utility::FindLeaf(nodes);
+			if (leaf == 0)
+				return false;
+			nodes[leaf].Count--;
+			return true;
+		});
+
+	// a leaf reaches into its neighbour's primitives
+	passed &= utility::Refused(good, "overlapping leaves", [](std::vector<BVHNode>& nodes, std::vector<uint32_t>&)
+		{
+			size_t leaf = utility::FindLeaf(nodes);
+			if (leaf == 0)
+				return false;
+			nodes[leaf].LeftFirst++;
+			return true;
+		});
+	return passed;
+}
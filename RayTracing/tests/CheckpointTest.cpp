@@ -0,0 +1,143 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: CheckpointTest.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/tests/CheckpointTest.cpp
+*/
+
+#include "Tests.h"
+
+#include "Camera.h"
+#include "Checkpoint.h"
+#include "Renderer.h"
+#include "Scenes.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+namespace utility
+{
+	static constexpr uint32_t kWidth = 48;
+	static constexpr uint32_t kHeight = 32;
+
+	// frames before the checkpoint, and after it in both the original and the resumed renderer
+	static constexpr uint32_t kFramesBefore = 3;
+	static constexpr uint32_t kFramesAfter = 2;
+
+	static void Configure(Renderer& renderer, AccumulationFormat format, bool adaptive_sampling)
+	{
+		Renderer::Settings& settings = renderer.GetSettings();
+		settings.Accumulation = format;
+		settings.AdaptiveSampling = adaptive_sampling;
+		settings.MinSamples = 2;
+		settings.NoiseThreshold = 0.5f;
+		settings.TileSize = 8;
+		settings.DeterministicSeed = true;
+		settings.Seed = 7;
+		settings.ResolveEveryFrame = false;
+		renderer.OnResize(kWidth, kHeight);
+	}
+
+	static bool SameState(const Renderer::AccumulationState& a, const Renderer::AccumulationState& b)
+	{
+		return a.Width == b.Width && a.Height == b.Height && a.FrameIndex == b.FrameIndex && a.Seed == b.Seed &&
+			a.SampleOffset == b.SampleOffset && a.Format == b.Format && a.FirstSample == b.FirstSample && a.TileSize == b.TileSize &&
+			a.NextEventEstimation == b.NextEventEstimation && a.MaxDepth == b.MaxDepth && a.RussianRoulette == b.RussianRoulette &&
+			a.RouletteDepth == b.RouletteDepth && a.AdaptiveSampling == b.AdaptiveSampling && a.NoiseThreshold == b.NoiseThreshold &&
+			a.MinSamples == b.MinSamples && a.MaxSamplesPerFrame == b.MaxSamplesPerFrame && a.Accumulation == b.Accumulation &&
+			a.SampleCounts == b.SampleCounts && a.Variance == b.Variance && a.TileConverged == b.TileConverged;
+	}
+
+	// renders, checkpoints through a file and resumes in a second renderer, which then has to
+	// render exactly what the first one does
+	static bool RoundTrip(const Scene& scene, const Camera& camera, const std::string& path, AccumulationFormat format, bool adaptive_sampling)
+	{
+		Renderer original;
+		Configure(original, format, adaptive_sampling);
+		for (uint32_t frame = 0; frame < kFramesBefore; frame++)
+			original.Render(scene, camera);
+
+		checkpoint::Checkpoint saved;
+		saved.Position = camera.GetPosition();
+		saved.Direction = camera.GetDirection();
+		saved.SceneHash = checkpoint::HashScene(scene);
+		std::string error;
+		if (!original.GetAccumulationState(saved.State) || !checkpoint::Write(path, saved, &error))
+		{
+			printf("  could not write the checkpoint: %s\n", error.c_str());
+			return false;
+		}
+
+		checkpoint::Checkpoint loaded;
+		if (!checkpoint::Read(path, loaded, &error))
+		{
+			printf("  could not read the checkpoint back: %s\n", error.c_str());
+			return false;
+		}
+		if (!SameState(saved.State, loaded.State) || loaded.SceneHash != saved.SceneHash ||
+			loaded.Position != saved.Position || loaded.Direction != saved.Direction)
+		{
+			printf("  the checkpoint read back differs from the one written\n");
+			return false;
+		}
+
+		// the resumed renderer starts from defaults, the state has to bring every setting that matters
+		Renderer resumed;
+		resumed.OnResize(kWidth, kHeight);
+		if (!resumed.SetAccumulationState(loaded.State, &error))
+		{
+			printf("  could not resume: %s\n", error.c_str());
+			return false;
+		}
+
+		for (uint32_t frame = 0; frame < kFramesAfter; frame++)
+		{
+			original.Render(scene, camera);
+			resumed.Render(scene, camera);
+		}
+
+		Renderer::AccumulationState expected, actual;
+		original.GetAccumulationState(expected);
+		resumed.GetAccumulationState(actual);
+		if (!SameState(expected, actual))
+		{
+			printf("  the resumed render differs from the uninterrupted one\n");
+			return false;
+		}
+		return true;
+	}
+}
+
+bool tests::CheckpointRoundTrip()
+{
+	Scene scene = scenes::Default();
+	Camera camera(45.0f, 0.1f, 100.0f);
+	camera.OnResize(utility::kWidth, utility::kHeight);
+
+	std::string path = (std::filesystem::temp_directory_path() / "rt_checkpoint_test.ckpt").string();
+
+	static constexpr AccumulationFormat kFormats[] = { AccumulationFormat::RGB32F, AccumulationFormat::RGB16F, AccumulationFormat::Fixed64 };
+	static constexpr const char* kFormatNames[] = { "rgb32f", "rgb16f", "fixed64" };
+
+	bool passed = true;
+	for (int format = 0; format < 3; format++)
+	{
+		for (bool adaptive_sampling : { false, true })
+		{
+			if (!utility::RoundTrip(scene, camera, path, kFormats[format], adaptive_sampling))
+			{
+				printf("  with %s accumulation, adaptive sampling %s\n", kFormatNames[format], adaptive_sampling ? "on" : "off");
+				passed = false;
+			}
+		}
+	}
+
+	std::error_code remove_error;
+	std::filesystem::remove(path, remove_error);
+	return passed;
+}
@@ -0,0 +1,158 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: DistributedTest.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/tests/DistributedTest.cpp
+*/
+
+#include "Tests.h"
+
+#include "Distributed.h"
+#include "Scene.h"
+
+#include <cstdio>
+#include <cstring>
+#include <functional>
+
+namespace utility
+{
+	// a scene with something in every array the message carries
+	static Scene FullScene()
+	{
+		Scene scene;
+
+		Material& red = scene.Materials.emplace_back();
+		red.Albedo = { 0.9f, 0.1f, 0.1f };
+		red.Roughness = 0.3f;
+		Material& light = scene.Materials.emplace_back();
+		light.EmissionColor = { 1.0f, 0.8f, 0.6f };
+		light.EmissionPower = 5.0f;
+
+		Sphere sphere;
+		sphere.Position = { 1.0f, 2.0f, 3.0f };
+		sphere.Radius = 0.75f;
+		sphere.MaterialIndex = 1;
+		scene.Spheres.push_back(sphere);
+
+		Mesh quad;
+		quad.Vertices = { { 0.0f, 0.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 0.0f }, { 0.0f, 1.0f, 0.0f } };
+		quad.Indices = { 0, 1, 2, 0, 2, 3 };
+		quad.MaterialIndex = 0;
+		scene.Meshes.push_back(quad);
+
+		Prototype& prototype = scene.Prototypes.emplace_back();
+		sphere.Position = { 0.0f, 0.5f, 0.0f };
+		sphere.MaterialIndex = 0;
+		prototype.Spheres.push_back(sphere);
+		quad.MaterialIndex = 1;
+		prototype.Meshes.push_back(quad);
+
+		Instance& instance = scene.Instances.emplace_back();
+		instance.Transform[3] = { -2.0f, 0.0f, 4.0f, 1.0f };
+		instance.Transform[0][0] = 2.0f;
+		instance.PrototypeIndex = 0;
+
+		return scene;
+	}
+
+	// the elements are sent in memory layout, so equal bytes is what a round trip must give
+	template<typename T>
+	static bool SameBytes(const std::vector<T>& a, const std::vector<T>& b)
+	{
+		return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+	}
+
+	static bool SameMeshes(const std::vector<Mesh>& a, const std::vector<Mesh>& b)
+	{
+		if (a.size() != b.size())
+			return false;
+
+		for (size_t i = 0; i < a.size(); i++)
+		{
+			if (!SameBytes(a[i].Vertices, b[i].Vertices) || !SameBytes(a[i].Indices, b[i].Indices) || a[i].MaterialIndex != b[i].MaterialIndex)
+				return false;
+		}
+		return true;
+	}
+
+	static bool SameScene(const Scene& a, const Scene& b)
+	{
+		if (!SameBytes(a.Spheres, b.Spheres) || !SameBytes(a.Materials, b.Materials) || !SameMeshes(a.Meshes, b.Meshes) ||
+			!SameBytes(a.Instances, b.Instances) || a.Prototypes.size() != b.Prototypes.size())
+			return false;
+
+		for (size_t i = 0; i < a.Prototypes.size(); i++)
+		{
+			if (!SameBytes(a.Prototypes[i].Spheres, b.Prototypes[i].Spheres) || !SameMeshes(a.Prototypes[i].Meshes, b.Prototypes[i].Meshes))
+				return false;
+		}
+		return true;
+	}
+
+	// writes the scene after one change and expects the worker side to refuse it
+	static bool Refused(const char* what, const std::function<void(Scene&)>& change)
+	{
+		Scene scene = FullScene();
+		change(scene);
+
+		std::vector<uint8_t> data;
+		distributed::WriteScene(scene, data);
+
+		Scene read;
+		if (distributed::ReadScene(data.data(), data.size(), read))
+		{
+			printf("  accepted a scene with %s\n", what);
+			return false;
+		}
+		return true;
+	}
+}
+
+bool tests::WireFormat()
+{
+	Scene scene = utility::FullScene();
+	std::vector<uint8_t> data;
+	distributed::WriteScene(scene, data);
+
+	Scene read;
+	if (!distributed::ReadScene(data.data(), data.size(), read) || !utility::SameScene(scene, read))
+	{
+		printf("  the scene did not survive a round trip\n");
+		return false;
+	}
+
+	// the instances come last and are never empty here, so every shorter message is missing something
+	for (size_t size = 0; size < data.size(); size++)
+	{
+		if (distributed::ReadScene(data.data(), size, read))
+		{
+			printf("  accepted a message cut to %zu of %zu bytes\n", size, data.size());
+			return false;
+		}
+	}
+
+	// a count far larger than the message must not be trusted either
+	std::vector<uint8_t> corrupt = data;
+	uint64_t huge = ~0ull;
+	memcpy(corrupt.data(), &huge, sizeof(huge));
+	if (distributed::ReadScene(corrupt.data(), corrupt.size(), read))
+	{
+		printf("  accepted a message with a corrupt sphere count\n");
+		return false;
+	}
+
+	bool passed = true;
+	passed &= utility::Refused("a sphere material out of range", [](Scene& s) { s.Spheres[0].MaterialIndex = 2; });
+	passed &= utility::Refused("a negative sphere material", [](Scene& s) { s.Spheres[0].MaterialIndex = -1; });
+	passed &= utility::Refused("a mesh material out of range", [](Scene& s) { s.Meshes[0].MaterialIndex = 2; });
+	passed &= utility::Refused("a mesh vertex out of range", [](Scene& s) { s.Meshes[0].Indices[4] = 4; });
+	passed &= utility::Refused("a prototype sphere material out of range", [](Scene& s) { s.Prototypes[0].Spheres[0].MaterialIndex = 7; });
+	passed &= utility::Refused("a prototype mesh material out of range", [](Scene& s) { s.Prototypes[0].Meshes[0].MaterialIndex = 2; });
+	passed &= utility::Refused("a prototype mesh vertex out of range", [](Scene& s) { s.Prototypes[0].Meshes[0].Indices[0] = 100; });
+	passed &= utility::Refused("an instance of a missing prototype", [](Scene& s) { s.Instances[0].PrototypeIndex = 1; });
+	return passed;
+}
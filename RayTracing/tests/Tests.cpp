@@ -0,0 +1,48 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: Tests.cpp
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/tests/Tests.cpp
+*/
+
+#include "Tests.h"
+
+#include <cstdio>
+
+namespace utility
+{
+	struct Test
+	{
+		const char* Name;
+		bool (*Run)();
+	};
+
+	static constexpr Test kTests[] =
+	{
+		{ "sampling", tests::Sampling },
+		{ "stored BVH", tests::StoredBVH },
+		{ "checkpoint round trip", tests::CheckpointRoundTrip },
+		{ "wire format", tests::WireFormat },
+	};
+}
+
+// runs every test, the exit code is the number that failed
+int main()
+{
+	int failed = 0;
+	for (const utility::Test& test : utility::kTests)
+	{
+		printf("%s\n", test.Name);
+		bool passed = test.Run();
+		printf("  %s\n", passed ? "passed" : "FAILED");
+		if (!passed)
+			failed++;
+	}
+
+	printf("%d of %d tests failed\n", failed, (int)(sizeof(utility::kTests) / sizeof(utility::kTests[0])));
+	return failed;
+}
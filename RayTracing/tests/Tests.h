@@ -0,0 +1,28 @@
+/*
+	MIT License
+	Copyright (c) 2023 Athir Azizi
+
+	Title: Tests.h
+	Author: https://github.com/athirazizi
+	Date: 2023
+
+	Availability: https://github.com/athirazizi/RayTracing/blob/master/RayTracing/tests/Tests.h
+*/
+
+#pragma once
+
+// each test prints what went wrong and returns false if it failed
+namespace tests
+{
+	// next event estimation and plain path tracing converge to the same image
+	bool Sampling();
+
+	// BVH::Assign refuses stored trees that traversal could run off the end of
+	bool StoredBVH();
+
+	// a render checkpointed to a file and resumed takes the same samples as one that never stopped
+	bool CheckpointRoundTrip();
+
+	// scenes survive the coordinator to worker message unchanged, and malformed ones are refused
+	bool WireFormat();
+}
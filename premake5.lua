@@ -4,6 +4,13 @@ workspace "RayTracing"
    configurations { "Debug", "Release", "Dist" }
    startproject "RayTracing"
 
+-- premake5 --profile ... compiles in the RT_PROFILE instrumentation, see RayTracing/src/Profiler.h
+newoption
+{
+   trigger = "profile",
+   description = "Time the renderer's stages and allow timeline capture"
+}
+
 outputdir = "%{cfg.buildcfg}-%{cfg.system}-%{cfg.architecture}"
 include "Walnut/WalnutExternal.lua"
 